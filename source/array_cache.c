@@ -0,0 +1,274 @@
+/*
+ * This file is part of vitaGL
+ * Copyright 2017, 2018, 2019, 2020 Rinnegatamante
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * array_cache.c:
+ * Implementation for client arrays persistent cache
+ */
+
+#include "shared.h"
+
+#define ARRAY_CACHE_BUCKETS_NUM 256 // Number of buckets for the client arrays cache lookup table
+#define ARRAY_CACHE_ENTRIES_NUM 1024 // Max number of tracked client array ranges
+#define ARRAY_CACHE_DEFAULT_SIZE (4 * 1024 * 1024) // Default size in bytes for the client arrays cache
+#define ARRAY_CACHE_FULL_HASH_SIZE 1024 // Max size in bytes for a client array to be fully hashed
+#define ARRAY_CACHE_HASH_SAMPLES 256 // Number of words sampled when hashing bigger client arrays
+
+extern GLboolean use_vram;
+
+// Client array cache entry struct
+typedef struct array_cache_entry {
+	const uint8_t *src; // Client array starting address
+	uint32_t stride; // Client array stride in bytes
+	uint32_t size; // Size in bytes of a single element
+	uint32_t count; // Number of elements
+	uint32_t hash; // Sampled content hash
+	uint32_t frame; // Last frame the entry got used in (as returned by get_current_frame)
+	void *data; // Packed GPU copy (NULL if the range has been seen only once)
+	struct array_cache_entry *bucket_next; // Next entry in the same lookup table bucket
+	struct array_cache_entry *lru_prev; // More recently used entry
+	struct array_cache_entry *lru_next; // Less recently used entry
+} array_cache_entry;
+
+static GLboolean array_cache_state = GL_FALSE; // Current state for client arrays cache
+static uint32_t array_cache_budget = ARRAY_CACHE_DEFAULT_SIZE; // Max size in bytes for cached GPU copies
+static uint32_t array_cache_used = 0; // Current size in bytes of cached GPU copies
+static uint32_t array_cache_entries = 0; // Current number of tracked client array ranges
+static uint32_t array_cache_hits = 0; // Number of draws served from the cache
+static uint32_t array_cache_misses = 0; // Number of draws that required a copy on vitaGL mempool
+static array_cache_entry *array_cache_table[ARRAY_CACHE_BUCKETS_NUM]; // Lookup table
+static array_cache_entry *lru_head = NULL; // Most recently used entry
+static array_cache_entry *lru_tail = NULL; // Least recently used entry
+
+static uint32_t array_cache_bucket(const uint8_t *src, uint32_t stride, uint32_t size, uint32_t count) {
+	uint32_t h = (uint32_t)src ^ (stride << 16) ^ (size << 24) ^ (count * 0x9E3779B1);
+	h ^= h >> 15;
+	h *= 0x85EBCA6B;
+	h ^= h >> 13;
+	return h & (ARRAY_CACHE_BUCKETS_NUM - 1);
+}
+
+static uint32_t array_cache_hash(const uint8_t *src, uint32_t len) {
+	// FNV-1a over the whole range for small arrays, over evenly spaced words for bigger ones
+	uint32_t h = 0x811C9DC5;
+	uint32_t i;
+	if (len <= ARRAY_CACHE_FULL_HASH_SIZE) {
+		for (i = 0; i < len; i++) {
+			h ^= src[i];
+			h *= 0x01000193;
+		}
+	} else {
+		uint32_t step = (len - 4) / (ARRAY_CACHE_HASH_SAMPLES - 1);
+		uint32_t w;
+		for (i = 0; i < ARRAY_CACHE_HASH_SAMPLES; i++) {
+			memcpy(&w, &src[i * step], sizeof(uint32_t));
+			h ^= w;
+			h *= 0x01000193;
+		}
+		memcpy(&w, &src[len - 4], sizeof(uint32_t));
+		h ^= w;
+		h *= 0x01000193;
+	}
+	return h;
+}
+
+static void lru_unlink(array_cache_entry *e) {
+	if (e->lru_prev)
+		e->lru_prev->lru_next = e->lru_next;
+	else
+		lru_head = e->lru_next;
+	if (e->lru_next)
+		e->lru_next->lru_prev = e->lru_prev;
+	else
+		lru_tail = e->lru_prev;
+}
+
+static void lru_push_front(array_cache_entry *e) {
+	e->lru_prev = NULL;
+	e->lru_next = lru_head;
+	if (lru_head)
+		lru_head->lru_prev = e;
+	else
+		lru_tail = e;
+	lru_head = e;
+}
+
+static void array_cache_release(array_cache_entry *e) {
+	array_cache_entry **p = &array_cache_table[array_cache_bucket(e->src, e->stride, e->size, e->count)];
+	while (*p != e)
+		p = &(*p)->bucket_next;
+	*p = e->bucket_next;
+	lru_unlink(e);
+	if (e->data) {
+		// GPU copy may still be read by frames the GPU is not done with
+		if (is_frame_completed(e->frame))
+			vgl_mem_free(e->data);
+		else
+			queue_mem_free(e->data);
+		array_cache_used -= e->size * e->count;
+	}
+	free(e);
+	array_cache_entries--;
+}
+
+static GLboolean array_cache_make_room(uint32_t size) {
+	// Evicting least recently used entries, entries used by frames not yet completed may still be read by the GPU
+	array_cache_entry *e = lru_tail;
+	while ((array_cache_used + size > array_cache_budget) && e) {
+		array_cache_entry *prev = e->lru_prev;
+		if (e->data && is_frame_completed(e->frame))
+			array_cache_release(e);
+		e = prev;
+	}
+	return array_cache_used + size <= array_cache_budget;
+}
+
+static void array_cache_pack(uint8_t *dst, const uint8_t *src, uint32_t stride, uint32_t size, uint32_t count) {
+	if (stride == size)
+		memcpy_neon(dst, src, count * size);
+	else {
+		int i;
+		for (i = 0; i < count; i++) {
+			memcpy_neon(dst, src, size);
+			dst += size;
+			src += stride;
+		}
+	}
+}
+
+void *array_cache_get(const void *pointer, uint32_t stride, uint32_t size, uint32_t count) {
+	if (!array_cache_state || !count)
+		return NULL;
+
+	const uint8_t *src = (const uint8_t *)pointer;
+	if (!stride)
+		stride = size;
+	uint32_t bytes = size * count;
+	uint32_t hash = array_cache_hash(src, stride * (count - 1) + size);
+
+	// Looking for a fingerprint for the given client array range
+	uint32_t bucket = array_cache_bucket(src, stride, size, count);
+	array_cache_entry *e = array_cache_table[bucket];
+	while (e) {
+		if (e->src == src && e->stride == stride && e->size == size && e->count == count)
+			break;
+		e = e->bucket_next;
+	}
+
+	if (e) {
+		lru_unlink(e);
+		lru_push_front(e);
+		if (e->hash == hash && e->data) {
+			e->frame = get_current_frame();
+			array_cache_hits++;
+			return e->data;
+		}
+
+		// Content changed: the GPU copy is stale but can be refreshed in place once the GPU is done with it
+		if (e->hash != hash) {
+			if (e->data) {
+				// Hash is kept in sync with the GPU copy so that a stale copy can never be hit
+				if (is_frame_completed(e->frame)) {
+					array_cache_pack(e->data, src, stride, size, count);
+					e->hash = hash;
+					e->frame = get_current_frame();
+					array_cache_misses++;
+					return e->data;
+				}
+			} else
+				e->hash = hash;
+			array_cache_misses++;
+			return NULL;
+		}
+
+		// Range seen unchanged for the second time, promoting it to a persistent GPU copy
+		if (bytes <= array_cache_budget && array_cache_make_room(bytes)) {
+			vglMemType type = use_vram ? VGL_MEM_VRAM : VGL_MEM_RAM;
+			e->data = gpu_alloc_mapped(bytes, &type);
+			if (e->data) {
+				array_cache_pack(e->data, src, stride, size, count);
+				array_cache_used += bytes;
+				e->frame = get_current_frame();
+			}
+		}
+		array_cache_misses++;
+		return e->data;
+	}
+
+	// First time we see this range, storing only its fingerprint
+	if (array_cache_entries >= ARRAY_CACHE_ENTRIES_NUM) {
+		e = lru_tail;
+		while (e && e->data && !is_frame_completed(e->frame))
+			e = e->lru_prev;
+		if (!e) {
+			array_cache_misses++;
+			return NULL;
+		}
+		array_cache_release(e);
+	}
+	e = (array_cache_entry *)malloc(sizeof(array_cache_entry));
+	if (e) {
+		e->src = src;
+		e->stride = stride;
+		e->size = size;
+		e->count = count;
+		e->hash = hash;
+		e->frame = get_current_frame();
+		e->data = NULL;
+		e->bucket_next = array_cache_table[bucket];
+		array_cache_table[bucket] = e;
+		lru_push_front(e);
+		array_cache_entries++;
+	}
+	array_cache_misses++;
+	return NULL;
+}
+
+void array_cache_reset(void) {
+	while (lru_head)
+		array_cache_release(lru_head);
+}
+
+/*
+ * ------------------------------
+ * - IMPLEMENTATION STARTS HERE -
+ * ------------------------------
+ */
+
+void vglEnableClientArrayCache(GLboolean usage) {
+	array_cache_state = usage;
+	if (!usage) {
+		waitRenderingDone();
+		array_cache_reset();
+	}
+}
+
+void vglSetClientArrayCacheSize(uint32_t size) {
+	array_cache_budget = size;
+	if (array_cache_used > size) {
+		waitRenderingDone();
+		array_cache_make_room(0);
+	}
+}
+
+void vglGetClientArrayCacheStats(uint32_t *hits, uint32_t *misses) {
+	if (hits)
+		*hits = array_cache_hits;
+	if (misses)
+		*misses = array_cache_misses;
+}
@@ -24,8 +24,9 @@
 #include "shared.h"
 
 #define MAX_CUSTOM_SHADERS 128 // Maximum number of linkable custom shaders
-#define MAX_SHADER_PARAMS 8 // Maximum number of parameters per custom shader
+#define MAX_SHADER_PARAMS VERTEX_ATTRIBS_NUM // Maximum number of parameters per custom shader (must not exceed vertex program variants streams)
 #define MAX_TEXUNITS_USAGE 3 // Maximum number of texture units per custom shader
+#define MAX_UNIFORM_BLOCKS 14 // Maximum number of uniform blocks per custom program
 
 // Internal stuffs
 GLboolean use_shark = GL_TRUE; // Flag to check if vitaShaRK should be initialized at vitaGL boot
@@ -41,15 +42,29 @@ shark_opt compiler_opts = SHARK_OPT_DEFAULT;
 
 GLuint cur_program = 0; // Current in use custom program (0 = No custom program)
 
+static uint32_t unifs_frame = 0; // Current frame index, used to invalidate uniform buffers allocated on vitaGL mempool
+static uint32_t unifs_bytes = 0; // Uniform bytes uploaded in current frame
+static uint32_t unifs_reused = 0; // Draws reusing previous uniform buffers in current frame
+static uint32_t unifs_bytes_last = 0; // Uniform bytes uploaded in last frame
+static uint32_t unifs_reused_last = 0; // Draws reusing previous uniform buffers in last frame
+
 // Uniform struct
 typedef struct uniform {
-	GLboolean isVertex;
-	const SceGxmProgramParameter *ptr;
-	void *chain;
-	float *data;
-	uint32_t size;
+	uint32_t hash; // Hash of the uniform name
+	const SceGxmProgramParameter *vert_ptr; // Vertex program parameter (NULL if unused in vertex shader)
+	const SceGxmProgramParameter *frag_ptr; // Fragment program parameter (NULL if unused in fragment shader)
+	float *data; // Uniform data, packed in the owning program uniforms buffer
+	uint32_t size; // Uniform size in floats
+	GLboolean is_set; // Flag to check if the uniform has been ever set
 } uniform;
 
+// Uniform block struct
+typedef struct uniform_block {
+	const SceGxmProgramParameter *vert_ptr; // Vertex program parameter (NULL if unused in vertex shader)
+	const SceGxmProgramParameter *frag_ptr; // Fragment program parameter (NULL if unused in fragment shader)
+	GLuint binding; // Uniform buffer binding point the block is sourced from
+} uniform_block;
+
 // Generic shader struct
 typedef struct shader {
 	GLenum type;
@@ -58,6 +73,7 @@ typedef struct shader {
 	const SceGxmProgram *prog;
 	uint32_t size;
 	char *log;
+	shader_job *job; // Pending asynchronous compilation (NULL if none)
 } shader;
 
 // Program struct holding vertex/fragment shader info
@@ -74,9 +90,26 @@ typedef struct program {
 	GLuint attr_num;
 	GLuint stream_num;
 	const SceGxmProgramParameter *wvp;
-	uniform *uniforms;
+	uniform *uniforms; // Uniforms table, resolved at link time (location = index)
+	uint32_t uniforms_num; // Number of entries in the uniforms table
+	float *uniforms_data; // Packed data for all the uniforms
+	uint16_t *set_unifs; // Indices of the uniforms set at least once
+	uint32_t set_unifs_num; // Number of uniforms set at least once
+	uniform_block blocks[MAX_UNIFORM_BLOCKS]; // Uniform blocks, resolved at link time (index = block index)
+	char *attr_binds[MAX_SHADER_PARAMS]; // Attribute names requested through glBindAttribLocation
+	const SceGxmProgramParameter *attribs[MAX_SHADER_PARAMS]; // Vertex attributes, resolved at link time (index = generic attribute index)
+	uint16_t attr_regs[MAX_SHADER_PARAMS]; // Register indices of the vertex attributes in streams order
+	uint8_t attr_idxs[MAX_SHADER_PARAMS]; // Generic attribute indices of the vertex attributes in streams order
+	GLuint attribs_num; // Number of vertex attributes used by the vertex shader
+	uint32_t blocks_num; // Number of resolved uniform blocks
 	GLboolean has_vertex_unifs;
 	GLboolean has_fragment_unifs;
+	GLboolean unifs_dirty; // Flag to check if uniforms changed since last draw
+	GLboolean unifs_implicit_wvp; // Implicit wvp usage for last uploaded uniform buffers
+	uint32_t unifs_frame; // Frame index for last uploaded uniform buffers
+	matrix4x4 unifs_wvp; // Wvp matrix in last uploaded vertex uniform buffer
+	void *vert_unifs; // Last uploaded vertex uniform buffer (NULL if none)
+	void *frag_unifs; // Last uploaded fragment uniform buffer (NULL if none)
 } program;
 
 // Internal shaders array
@@ -85,17 +118,24 @@ static shader shaders[MAX_CUSTOM_SHADERS];
 // Internal programs array
 static program progs[MAX_CUSTOM_SHADERS / 2];
 
+vertex_attrib vertex_attribs[VERTEX_ATTRIBS_NUM]; // Current generic vertex attributes arrays
+
 void resetCustomShaders(void) {
 	// Init custom shaders
 	int i;
 	for (i = 0; i < MAX_CUSTOM_SHADERS; i++) {
 		shaders[i].valid = 0;
 		shaders[i].log = NULL;
+		shaders[i].job = NULL;
 		progs[i >> 1].valid = 0;
 	}
+	for (i = 0; i < MAX_SHADER_PARAMS; i++) {
+		vertex_attribs[i].enabled = GL_FALSE;
+		vertex_attribs[i].buffer = -1;
+	}
 }
 
-void _vglDrawObjects_CustomShadersIMPL(GLenum mode, GLsizei count, GLboolean implicit_wvp) {
+void _vglDrawObjects_CustomShadersIMPL(GLenum mode, GLsizei count, GLsizei instances, GLboolean implicit_wvp) {
 	program *p = &progs[cur_program - 1];
 	
 	// Check if a blend info rebuild is required
@@ -104,34 +144,122 @@ void _vglDrawObjects_CustomShadersIMPL(GLenum mode, GLsizei count, GLboolean imp
 		rebuild_frag_shader(p->fshader->id, &p->fprog, p->vshader->prog);
 	}
 	
+	// Binding generic vertex attributes streams if the program has no vglBindAttribLocation bound layout
+	int i;
+	if (!p->attr_num) {
+		stream_layout layouts[MAX_SHADER_PARAMS];
+		void *ptrs[MAX_SHADER_PARAMS];
+		uint32_t vertex_count = 0;
+		for (i = 0; i < p->attribs_num; i++) {
+			vertex_attrib *a = &vertex_attribs[p->attr_idxs[i]];
+			if (a->enabled) {
+				// Streams point straight into the bound buffer object or vitaGL mempools, other client arrays are copied on vitaGL mempool
+				GLboolean is_mapped = (a->buffer >= 0) || vgl_mem_is_mapped(a->array.pointer);
+				layouts[i] = get_array_layout(&a->array, a->normalized, is_mapped);
+				layouts[i].index_source = p->stream[p->attr_idxs[i]].indexSource;
+				if (a->buffer >= 0)
+					ptrs[i] = (uint8_t *)get_buffer_memblock(a->buffer) + (uint32_t)a->array.pointer;
+				else if (is_mapped)
+					ptrs[i] = (void *)a->array.pointer;
+				else if (layouts[i].index_source == SCE_GXM_INDEX_SOURCE_INSTANCE_16BIT)
+					ptrs[i] = _glDraw_CopyVertexArray(&a->array, 0, instances);
+				else {
+					if (!vertex_count)
+						vertex_count = _glDrawElements_CountVertices(count, (uint16_t *)texture_units[client_texture_unit].index_object);
+					ptrs[i] = _glDraw_CopyVertexArray(&a->array, 0, vertex_count);
+				}
+			} else {
+				// Disabled attributes read a constant (0, 0, 0, 1) value
+				vector4f *val = (vector4f *)gpu_pool_memalign(sizeof(vector4f), sizeof(vector4f));
+				val->r = val->g = val->b = 0.0f;
+				val->a = 1.0f;
+				layouts[i].format = SCE_GXM_ATTRIBUTE_FORMAT_F32;
+				layouts[i].num = 4;
+				layouts[i].index_source = SCE_GXM_INDEX_SOURCE_INDEX_16BIT;
+				layouts[i].stride = 0;
+				ptrs[i] = val;
+			}
+		}
+		
+		// Patched vertex programs are cached per streams layout
+		p->vprog = get_vertex_program_variant(p->vshader->id, p->attr_regs, layouts, p->attribs_num);
+		for (i = 0; i < p->attribs_num; i++) {
+			sceGxmSetVertexStream(gxm_context, i, ptrs[i]);
+		}
+	}
+	
 	// Setting up required shader
 	sceGxmSetVertexProgram(gxm_context, p->vprog);
 	sceGxmSetFragmentProgram(gxm_context, p->fprog);
 	
-	// Uploading both fragment and vertex uniforms data
-	void *vbuffer, *fbuffer;
-	if (p->has_vertex_unifs || (p->wvp && implicit_wvp)) sceGxmReserveVertexDefaultUniformBuffer(gxm_context, &vbuffer);
-	if (p->has_fragment_unifs) sceGxmReserveFragmentDefaultUniformBuffer(gxm_context, &fbuffer);
-	uniform *u = p->uniforms;
-	while (u != NULL) {
-		if (u->isVertex)
-			sceGxmSetUniformDataF(vbuffer, u->ptr, 0, u->size, u->data);
-		else
-			sceGxmSetUniformDataF(fbuffer, u->ptr, 0, u->size, u->data);
-		u = (uniform *)u->chain;
-	}
-	
-	// Uploading internal GL wvp if implicit wvp is asked
-	if (p->wvp && implicit_wvp) {
+	// Checking if uniform buffers from last draw with this program can be reused
+	GLboolean upload_wvp = p->wvp && implicit_wvp;
+	if (upload_wvp) {
 		if (mvp_modified) {
 			matrix4x4_multiply(mvp_matrix, projection_matrix, modelview_matrix);
 			mvp_modified = GL_FALSE;
 		}
-		sceGxmSetUniformDataF(vbuffer, p->wvp, 0, 16, (const float *)mvp_matrix);
+		if (memcmp(p->unifs_wvp, mvp_matrix, sizeof(matrix4x4))) {
+			matrix4x4_copy(p->unifs_wvp, mvp_matrix);
+			p->unifs_dirty = GL_TRUE;
+		}
+	}
+	if (p->unifs_implicit_wvp != upload_wvp || p->unifs_frame != unifs_frame)
+		p->unifs_dirty = GL_TRUE;
+	
+	if (p->unifs_dirty) {
+		// Uploading both fragment and vertex uniforms data on vitaGL mempool so that they can be rebound by next draws
+		p->vert_unifs = p->frag_unifs = NULL;
+		uint32_t vsize = 0, fsize = 0;
+		if (p->has_vertex_unifs || upload_wvp) {
+			vsize = sceGxmProgramGetDefaultUniformBufferSize(p->vshader->prog);
+			p->vert_unifs = gpu_pool_memalign(vsize, sizeof(float));
+		}
+		if (p->has_fragment_unifs) {
+			fsize = sceGxmProgramGetDefaultUniformBufferSize(p->fshader->prog);
+			p->frag_unifs = gpu_pool_memalign(fsize, sizeof(float));
+		}
+		
+		// Falling back to default uniform buffers reservation if vitaGL mempool is full
+		void *vbuffer = p->vert_unifs, *fbuffer = p->frag_unifs;
+		if (vsize && !vbuffer) sceGxmReserveVertexDefaultUniformBuffer(gxm_context, &vbuffer);
+		if (fsize && !fbuffer) sceGxmReserveFragmentDefaultUniformBuffer(gxm_context, &fbuffer);
+		int i;
+		for (i = 0; i < p->set_unifs_num; i++) {
+			uniform *u = &p->uniforms[p->set_unifs[i]];
+			if (u->vert_ptr)
+				sceGxmSetUniformDataF(vbuffer, u->vert_ptr, 0, u->size, u->data);
+			if (u->frag_ptr)
+				sceGxmSetUniformDataF(fbuffer, u->frag_ptr, 0, u->size, u->data);
+		}
+		
+		// Uploading internal GL wvp if implicit wvp is asked
+		if (upload_wvp)
+			sceGxmSetUniformDataF(vbuffer, p->wvp, 0, 16, (const float *)mvp_matrix);
+		unifs_bytes += vsize + fsize;
+		
+		// Uniform buffers reserved from the context ring buffer can't outlive current draw
+		p->unifs_dirty = (vsize && !p->vert_unifs) || (fsize && !p->frag_unifs);
+		p->unifs_implicit_wvp = upload_wvp;
+		p->unifs_frame = unifs_frame;
+	} else
+		unifs_reused++;
+	if (p->vert_unifs) sceGxmSetVertexDefaultUniformBuffer(gxm_context, p->vert_unifs);
+	if (p->frag_unifs) sceGxmSetFragmentDefaultUniformBuffer(gxm_context, p->frag_unifs);
+	
+	// Binding uniform buffer objects by reference on their sceGxm uniform buffer slots
+	for (i = 0; i < p->blocks_num; i++) {
+		uniform_block *b = &p->blocks[i];
+		void *ptr = get_uniform_buffer_binding(b->binding);
+		if (ptr) {
+			if (b->vert_ptr)
+				sceGxmSetVertexUniformBuffer(gxm_context, sceGxmProgramParameterGetResourceIndex(b->vert_ptr), ptr);
+			if (b->frag_ptr)
+				sceGxmSetFragmentUniformBuffer(gxm_context, sceGxmProgramParameterGetResourceIndex(b->frag_ptr), ptr);
+		}
 	}
 	
 	// Uploading textures on relative texture units
-	int i;
 	for (i = 0; i < MAX_TEXUNITS_USAGE; i++) {
 		if (p->texunits[i]) {
 			texture_unit *tex_unit = &texture_units[client_texture_unit + i];
@@ -140,6 +268,14 @@ void _vglDrawObjects_CustomShadersIMPL(GLenum mode, GLsizei count, GLboolean imp
 	}
 }
 
+void custom_shaders_new_frame(void) {
+	// Uniform buffers allocated on vitaGL mempool are freed at the end of the frame
+	unifs_bytes_last = unifs_bytes;
+	unifs_reused_last = unifs_reused;
+	unifs_bytes = unifs_reused = 0;
+	unifs_frame++;
+}
+
 #if defined(HAVE_SHARK) && defined(HAVE_SHARK_LOG)
 static char *shark_log = NULL;
 void shark_log_cb(const char *msg, shark_log_level msg_level, int line) {
@@ -165,6 +301,233 @@ void shark_log_cb(const char *msg, shark_log_level msg_level, int line) {
 }
 #endif
 
+#ifdef HAVE_SHARK
+char *grab_shark_log(void) {
+#ifdef HAVE_SHARK_LOG
+	char *res = shark_log;
+	shark_log = NULL;
+	return res;
+#else
+	return NULL;
+#endif
+}
+
+static void register_compiled_shader(shader *s, SceGxmProgram *prog) {
+	s->prog = prog;
+	if (prog) {
+		sceGxmShaderPatcherRegisterProgram(gxm_shader_patcher, s->prog, &s->id);
+		s->prog = sceGxmShaderPatcherGetProgramFromId(s->id);
+	}
+}
+#endif
+
+static uint32_t uniform_name_hash(const char *name, uint32_t len) {
+	// FNV-1a over the uniform name
+	uint32_t h = 0x811C9DC5;
+	uint32_t i;
+	for (i = 0; i < len; i++) {
+		h ^= (uint8_t)name[i];
+		h *= 0x01000193;
+	}
+	return h;
+}
+
+static void free_uniforms(program *p) {
+	free(p->uniforms);
+	free(p->uniforms_data);
+	free(p->set_unifs);
+	p->uniforms = NULL;
+	p->uniforms_data = NULL;
+	p->set_unifs = NULL;
+	p->uniforms_num = p->set_unifs_num = 0;
+	p->has_fragment_unifs = GL_FALSE;
+	p->has_vertex_unifs = GL_FALSE;
+}
+
+static uniform *find_uniform(program *p, const char *name, uint32_t len) {
+	uint32_t hash = uniform_name_hash(name, len);
+	int i;
+	for (i = 0; i < p->uniforms_num; i++) {
+		uniform *u = &p->uniforms[i];
+		if (u->hash == hash) {
+			const char *unif_name = sceGxmProgramParameterGetName(u->vert_ptr ? u->vert_ptr : u->frag_ptr);
+			if (!strncmp(unif_name, name, len) && unif_name[len] == 0)
+				return u;
+		}
+	}
+	return NULL;
+}
+
+static uniform_block *find_uniform_block(program *p, const char *name) {
+	int i;
+	for (i = 0; i < p->blocks_num; i++) {
+		uniform_block *b = &p->blocks[i];
+		if (!strcmp(sceGxmProgramParameterGetName(b->vert_ptr ? b->vert_ptr : b->frag_ptr), name))
+			return b;
+	}
+	return NULL;
+}
+
+static void build_uniform_blocks(program *p) {
+	// Uniform blocks declared in both shaders with the same name share a single block index
+	const SceGxmProgram *progs[2] = {p->vshader->prog, p->fshader->prog};
+	uint32_t i, j, cnt;
+	p->blocks_num = 0;
+	for (i = 0; i < 2; i++) {
+		cnt = sceGxmProgramGetParameterCount(progs[i]);
+		for (j = 0; j < cnt; j++) {
+			const SceGxmProgramParameter *param = sceGxmProgramGetParameter(progs[i], j);
+			if (sceGxmProgramParameterGetCategory(param) != SCE_GXM_PARAMETER_CATEGORY_UNIFORM_BUFFER)
+				continue;
+			uniform_block *b = find_uniform_block(p, sceGxmProgramParameterGetName(param));
+			if (!b) {
+				if (p->blocks_num == MAX_UNIFORM_BLOCKS)
+					continue;
+				b = &p->blocks[p->blocks_num++];
+				b->vert_ptr = b->frag_ptr = NULL;
+				
+				// Blocks are initially sourced from the binding point matching their sceGxm buffer index
+				b->binding = sceGxmProgramParameterGetResourceIndex(param);
+			}
+			if (i == 0)
+				b->vert_ptr = param;
+			else
+				b->frag_ptr = param;
+		}
+	}
+}
+
+static void build_attribs(program *p) {
+	// Attributes requested through glBindAttribLocation take their generic index, the others take the first free one
+	const SceGxmProgramParameter *params[MAX_SHADER_PARAMS];
+	uint32_t i, j, cnt, num = 0;
+	for (i = 0; i < MAX_SHADER_PARAMS; i++) {
+		p->attribs[i] = NULL;
+	}
+	cnt = sceGxmProgramGetParameterCount(p->vshader->prog);
+	for (i = 0; i < cnt; i++) {
+		const SceGxmProgramParameter *param = sceGxmProgramGetParameter(p->vshader->prog, i);
+		if (sceGxmProgramParameterGetCategory(param) != SCE_GXM_PARAMETER_CATEGORY_ATTRIBUTE || num == MAX_SHADER_PARAMS)
+			continue;
+		const char *name = sceGxmProgramParameterGetName(param);
+		for (j = 0; j < MAX_SHADER_PARAMS; j++) {
+			if (p->attr_binds[j] && !strcmp(p->attr_binds[j], name)) {
+				p->attribs[j] = param;
+				break;
+			}
+		}
+		if (j == MAX_SHADER_PARAMS)
+			params[num++] = param;
+	}
+	for (i = 0, j = 0; i < num; i++) {
+		while ((j < MAX_SHADER_PARAMS) && p->attribs[j])
+			j++;
+		
+		// Attributes left without a free generic index are dropped
+		if (j == MAX_SHADER_PARAMS)
+			break;
+		p->attribs[j] = params[i];
+	}
+	
+	// Streams are packed in generic attribute index order
+	p->attribs_num = 0;
+	for (i = 0; i < MAX_SHADER_PARAMS; i++) {
+		if (p->attribs[i]) {
+			p->attr_regs[p->attribs_num] = sceGxmProgramParameterGetResourceIndex(p->attribs[i]);
+			p->attr_idxs[p->attribs_num++] = i;
+		}
+	}
+}
+
+static void build_uniforms(program *p) {
+	// Counting uniforms available in both shaders, the ones shared between stages will take a single slot
+	const SceGxmProgram *progs[2] = {p->vshader->prog, p->fshader->prog};
+	uint32_t cnt[2], i, j, max_num = 0;
+	for (i = 0; i < 2; i++) {
+		cnt[i] = sceGxmProgramGetParameterCount(progs[i]);
+		max_num += cnt[i];
+	}
+	p->uniforms = (uniform *)malloc(max_num * sizeof(uniform));
+	
+	uint32_t data_size = 0;
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < cnt[i]; j++) {
+			const SceGxmProgramParameter *param = sceGxmProgramGetParameter(progs[i], j);
+			if (sceGxmProgramParameterGetCategory(param) != SCE_GXM_PARAMETER_CATEGORY_UNIFORM)
+				continue;
+			const char *name = sceGxmProgramParameterGetName(param);
+			uint32_t len = strlen(name);
+			uniform *u = find_uniform(p, name, len);
+			if (!u) {
+				u = &p->uniforms[p->uniforms_num++];
+				u->hash = uniform_name_hash(name, len);
+				u->vert_ptr = u->frag_ptr = NULL;
+				u->size = sceGxmProgramParameterGetComponentCount(param) * sceGxmProgramParameterGetArraySize(param);
+				u->is_set = GL_FALSE;
+				data_size += u->size;
+			}
+			if (i == 0)
+				u->vert_ptr = param;
+			else
+				u->frag_ptr = param;
+		}
+	}
+	
+	// Packing uniforms data in a single buffer
+	p->uniforms_data = (float *)calloc(data_size, sizeof(float));
+	p->set_unifs = (uint16_t *)malloc(p->uniforms_num * sizeof(uint16_t));
+	p->unifs_dirty = GL_TRUE;
+	data_size = 0;
+	for (i = 0; i < p->uniforms_num; i++) {
+		p->uniforms[i].data = &p->uniforms_data[data_size];
+		data_size += p->uniforms[i].size;
+	}
+}
+
+static uniform *get_uniform(GLint location) {
+#ifndef SKIP_ERROR_HANDLING
+	if (!cur_program) {
+		vgl_error = GL_INVALID_OPERATION;
+		return NULL;
+	}
+#endif
+	program *p = &progs[cur_program - 1];
+#ifndef SKIP_ERROR_HANDLING
+	if ((location < 0) || (location >= p->uniforms_num)) {
+		vgl_error = GL_INVALID_OPERATION;
+		return NULL;
+	}
+#endif
+	uniform *u = &p->uniforms[location];
+	
+	// Queuing uniform for upload on first set
+	p->unifs_dirty = GL_TRUE;
+	if (!u->is_set) {
+		u->is_set = GL_TRUE;
+		p->set_unifs[p->set_unifs_num++] = location;
+		if (u->vert_ptr)
+			p->has_vertex_unifs = GL_TRUE;
+		if (u->frag_ptr)
+			p->has_fragment_unifs = GL_TRUE;
+	}
+	return u;
+}
+
+static void resolve_shader(shader *s) {
+#ifdef HAVE_SHARK
+	// Waiting for the asynchronous compilation of the shader to complete, if any
+	if (s->job) {
+		uint32_t size;
+		char *log;
+		SceGxmProgram *prog = finish_shader_job(s->job, &size, &log);
+		s->job = NULL;
+		s->size = size;
+		s->log = log;
+		register_compiled_shader(s, prog);
+	}
+#endif
+}
+
 /*
  * ------------------------------
  * - IMPLEMENTATION STARTS HERE -
@@ -183,6 +546,13 @@ void vglEnableRuntimeShaderCompiler(GLboolean usage) {
 	use_shark = usage;
 }
 
+void vglGetUniformUploadStats(uint32_t *bytes, uint32_t *reused_draws) {
+	if (bytes)
+		*bytes = unifs_bytes_last;
+	if (reused_draws)
+		*reused_draws = unifs_reused_last;
+}
+
 GLuint glCreateShader(GLenum shaderType) {
 	// Looking for a free shader slot
 	GLuint i, res = 0;
@@ -224,9 +594,18 @@ void glGetShaderiv(GLuint handle, GLenum pname, GLint *params) {
 		*params = s->type;
 		break;
 	case GL_COMPILE_STATUS:
+		resolve_shader(s);
 		*params = s->prog ? GL_TRUE : GL_FALSE;
 		break;
+	case GL_COMPLETION_STATUS_KHR:
+#ifdef HAVE_SHARK
+		*params = (!s->job || is_shader_job_done(s->job)) ? GL_TRUE : GL_FALSE;
+#else
+		*params = GL_TRUE;
+#endif
+		break;
 	case GL_INFO_LOG_LENGTH:
+		resolve_shader(s);
 		*params = s->log ? strlen(s->log) : 0;
 		break;
 	default:
@@ -244,6 +623,7 @@ void glGetShaderInfoLog(GLuint handle, GLsizei maxLength, GLsizei *length, GLcha
 
 	// Grabbing passed shader
 	shader *s = &shaders[handle - 1];
+	resolve_shader(s);
 
 	if (s->log) {
 		*length = min(strlen(s->log), maxLength);
@@ -290,19 +670,17 @@ void glCompileShader(GLuint handle) {
 	// Grabbing passed shader
 	shader *s = &shaders[handle - 1];
 
-	// Compiling shader source
-	s->prog = shark_compile_shader_extended((const char *)s->prog, &s->size, s->type == GL_FRAGMENT_SHADER ? SHARK_FRAGMENT_SHADER : SHARK_VERTEX_SHADER, compiler_opts, compiler_fastmath, compiler_fastprecision, compiler_fastint);
-	if (s->prog) {
-		SceGxmProgram *res = (SceGxmProgram *)malloc(s->size);
-		memcpy_neon((void *)res, (void *)s->prog, s->size);
-		s->prog = res;
-		sceGxmShaderPatcherRegisterProgram(gxm_shader_patcher, s->prog, &s->id);
-		s->prog = sceGxmShaderPatcherGetProgramFromId(s->id);
+	// Queuing shader source compilation on the worker thread if asynchronous compilation is enabled
+	shark_type type = s->type == GL_FRAGMENT_SHADER ? SHARK_FRAGMENT_SHADER : SHARK_VERTEX_SHADER;
+	s->job = submit_shader_job((const char *)s->prog, s->size, type);
+	if (s->job) {
+		s->prog = NULL;
+		return;
 	}
-#ifdef HAVE_SHARK_LOG
-	s->log = shark_log;
-	shark_log = NULL;
-#endif
+
+	// Compiling shader source
+	register_compiled_shader(s, compile_shader_cached((const char *)s->prog, &s->size, type));
+	s->log = grab_shark_log();
 	shark_clear_output();
 #endif
 }
@@ -310,11 +688,12 @@ void glCompileShader(GLuint handle) {
 void glDeleteShader(GLuint shad) {
 	// Grabbing passed shader
 	shader *s = &shaders[shad - 1];
+	resolve_shader(s);
 
 	// Deallocating shader and unregistering it from sceGxmShaderPatcher
 	if (s->valid) {
-		sceGxmShaderPatcherForceUnregisterProgram(gxm_shader_patcher, s->id);
-		free((void *)s->prog);
+		release_program_variants(s->id);
+		queue_program_unregister(s->id, (void *)s->prog);
 		if (s->log)
 			free(s->log);
 	}
@@ -327,6 +706,7 @@ void glAttachShader(GLuint prog, GLuint shad) {
 	shader *s = &shaders[shad - 1];
 	program *p = &progs[prog - 1];
 	uint32_t i, cnt;
+	resolve_shader(s);
 
 	// Attaching shader to desired program
 	if (p->valid && s->valid) {
@@ -359,7 +739,7 @@ void glAttachShader(GLuint prog, GLuint shad) {
 
 GLuint glCreateProgram(void) {
 	// Looking for a free program slot
-	GLuint i, res = 0;
+	GLuint i, j, res = 0;
 	for (i = 1; i < (MAX_CUSTOM_SHADERS / 2); i++) {
 		// Program slot found, reserving and initializing it
 		if (!(progs[i - 1].valid)) {
@@ -367,9 +747,22 @@ GLuint glCreateProgram(void) {
 			progs[i - 1].valid = GL_TRUE;
 			progs[i - 1].attr_num = 0;
 			progs[i - 1].wvp = NULL;
+			progs[i - 1].fprog = NULL;
 			progs[i - 1].uniforms = NULL;
+			progs[i - 1].uniforms_data = NULL;
+			progs[i - 1].set_unifs = NULL;
+			progs[i - 1].uniforms_num = progs[i - 1].set_unifs_num = 0;
+			progs[i - 1].blocks_num = 0;
+			progs[i - 1].attribs_num = 0;
+			progs[i - 1].vprog = NULL;
+			for (j = 0; j < MAX_SHADER_PARAMS; j++) {
+				progs[i - 1].attr_binds[j] = NULL;
+				progs[i - 1].stream[j].indexSource = SCE_GXM_INDEX_SOURCE_INDEX_16BIT;
+			}
 			progs[i - 1].has_fragment_unifs = GL_FALSE;
 			progs[i - 1].has_vertex_unifs = GL_FALSE;
+			progs[i - 1].unifs_dirty = GL_TRUE;
+			progs[i - 1].vert_unifs = progs[i - 1].frag_unifs = NULL;
 			break;
 		}
 	}
@@ -382,17 +775,18 @@ void glDeleteProgram(GLuint prog) {
 
 	// Releasing both vertex and fragment programs from sceGxmShaderPatcher
 	if (p->valid) {
-		unsigned int count, i;
-		sceGxmShaderPatcherGetFragmentProgramRefCount(gxm_shader_patcher, p->fprog, &count);
-		for (i = 0; i < count; i++) {
-			sceGxmShaderPatcherReleaseFragmentProgram(gxm_shader_patcher, p->fprog);
-			sceGxmShaderPatcherReleaseVertexProgram(gxm_shader_patcher, p->vprog);
+		if (p->fprog) {
+			release_fragment_program_variant(p->fprog);
+			
+			// Vertex programs patched for generic vertex attributes are owned by the variants cache
+			if (p->attr_num && p->vprog)
+				queue_program_release(p->vprog, NULL);
 		}
-		while (p->uniforms != NULL) {
-			uniform *old = p->uniforms;
-			p->uniforms = (uniform *)p->uniforms->chain;
-			if (old->size) free(old->data);
-			free(old);
+		free_uniforms(p);
+		int i;
+		for (i = 0; i < MAX_SHADER_PARAMS; i++) {
+			free(p->attr_binds[i]);
+			p->attr_binds[i] = NULL;
 		}
 	}
 	p->valid = GL_FALSE;
@@ -403,16 +797,106 @@ void glLinkProgram(GLuint progr) {
 	program *p = &progs[progr - 1];
 
 	// Creating fragment and vertex program via sceGxmShaderPatcher
-	sceGxmShaderPatcherCreateVertexProgram(gxm_shader_patcher,
-		p->vshader->id, p->attr, p->attr_num,
-		p->stream, p->stream_num, &p->vprog);
-	sceGxmShaderPatcherCreateFragmentProgram(gxm_shader_patcher,
-		p->fshader->id, SCE_GXM_OUTPUT_REGISTER_FORMAT_UCHAR4,
-		msaa_mode, &blend_info.info, p->vshader->prog,
-		&p->fprog);
-		
+	if (p->attr_num) {
+		sceGxmShaderPatcherCreateVertexProgram(gxm_shader_patcher,
+			p->vshader->id, p->attr, p->attr_num,
+			p->stream, p->stream_num, &p->vprog);
+	} else {
+		// Without vglBindAttribLocation bindings, vertex program gets patched at draw time for generic vertex attributes layout
+		build_attribs(p);
+	}
+	rebuild_frag_shader(p->fshader->id, &p->fprog, p->vshader->prog);
+
 	// Populating current blend settings
 	p->blend_info.raw = blend_info.raw;
+	
+	// Resolving uniforms table and uniform blocks
+	free_uniforms(p);
+	build_uniforms(p);
+	build_uniform_blocks(p);
+}
+
+void glBindAttribLocation(GLuint prog, GLuint index, const GLchar *name) {
+#ifndef SKIP_ERROR_HANDLING
+	if (index >= MAX_SHADER_PARAMS) {
+		SET_GL_ERROR(GL_INVALID_VALUE)
+	}
+#endif
+
+	// Grabbing passed program
+	program *p = &progs[prog - 1];
+
+	// Binding takes effect at next glLinkProgram call
+	free(p->attr_binds[index]);
+	p->attr_binds[index] = strdup(name);
+}
+
+GLint glGetAttribLocation(GLuint prog, const GLchar *name) {
+	// Grabbing passed program
+	program *p = &progs[prog - 1];
+
+	// Looking for the attribute resolved at link time
+	int i;
+	for (i = 0; i < MAX_SHADER_PARAMS; i++) {
+		if (p->attribs[i] && !strcmp(sceGxmProgramParameterGetName(p->attribs[i]), name))
+			return i;
+	}
+	return -1;
+}
+
+void glEnableVertexAttribArray(GLuint index) {
+#ifndef SKIP_ERROR_HANDLING
+	if (index >= MAX_SHADER_PARAMS) {
+		SET_GL_ERROR(GL_INVALID_VALUE)
+	}
+#endif
+	vertex_attribs[index].enabled = GL_TRUE;
+}
+
+void glDisableVertexAttribArray(GLuint index) {
+#ifndef SKIP_ERROR_HANDLING
+	if (index >= MAX_SHADER_PARAMS) {
+		SET_GL_ERROR(GL_INVALID_VALUE)
+	}
+#endif
+	vertex_attribs[index].enabled = GL_FALSE;
+}
+
+void glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *pointer) {
+#ifndef SKIP_ERROR_HANDLING
+	// Error handling
+	if ((index >= MAX_SHADER_PARAMS) || (size < 1) || (size > 4) || (stride < 0)) {
+		SET_GL_ERROR(GL_INVALID_VALUE)
+	}
+#endif
+	vertex_attrib *a = &vertex_attribs[index];
+
+	// Detecting type size
+	switch (type) {
+	case GL_FLOAT:
+		a->array.size = sizeof(GLfloat);
+		break;
+	case GL_HALF_FLOAT:
+	case GL_SHORT:
+	case GL_UNSIGNED_SHORT:
+		a->array.size = sizeof(GLshort);
+		break;
+	case GL_BYTE:
+	case GL_UNSIGNED_BYTE:
+		a->array.size = sizeof(GLbyte);
+		break;
+	default:
+		SET_GL_ERROR(GL_INVALID_ENUM)
+		break;
+	}
+
+	// Without a bound buffer object, pointer must be an address mapped for sceGxm usage
+	a->array.type = type;
+	a->array.num = size;
+	a->array.stride = stride;
+	a->array.pointer = pointer;
+	a->normalized = normalized;
+	a->buffer = get_array_buffer_unit();
 }
 
 void glUseProgram(GLuint prog) {
@@ -424,29 +908,40 @@ GLint glGetUniformLocation(GLuint prog, const GLchar *name) {
 	// Grabbing passed program
 	program *p = &progs[prog - 1];
 
-	uniform *res = (uniform *)malloc(sizeof(uniform));
-	res->chain = p->uniforms;
-
-	// Checking if parameter is a vertex or fragment related one
-	res->ptr = sceGxmProgramFindParameterByName(p->vshader->prog, name);
-	res->isVertex = GL_TRUE;
-	if (res->ptr == NULL) {
-		res->ptr = sceGxmProgramFindParameterByName(p->fshader->prog, name);
-		res->isVertex = GL_FALSE;
-	}
+	// Array uniforms can be queried with their first element
+	uint32_t len = strlen(name);
+	if (len > 3 && !strcmp(&name[len - 3], "[0]"))
+		len -= 3;
 
-	if (res->ptr == NULL) {
-		free(res);
+	// Looking for the uniform in the table resolved at link time
+	uniform *res = find_uniform(p, name, len);
+	if (res == NULL)
 		return -1;
+	return res - p->uniforms;
+}
+
+GLuint glGetUniformBlockIndex(GLuint prog, const GLchar *name) {
+	// Grabbing passed program
+	program *p = &progs[prog - 1];
+
+	// Looking for the uniform block resolved at link time
+	uniform_block *b = find_uniform_block(p, name);
+	if (b == NULL)
+		return GL_INVALID_INDEX;
+	return b - p->blocks;
+}
+
+void glUniformBlockBinding(GLuint prog, GLuint blockIndex, GLuint blockBinding) {
+	// Grabbing passed program
+	program *p = &progs[prog - 1];
+
+#ifndef SKIP_ERROR_HANDLING
+	if ((blockIndex >= p->blocks_num) || (blockBinding >= UNIFORM_BUFFER_BINDINGS_NUM)) {
+		SET_GL_ERROR(GL_INVALID_VALUE)
 	}
-	
-	res->size = 0;
-	if (res->isVertex)
-		p->has_vertex_unifs = GL_TRUE;
-	else
-		p->has_fragment_unifs = GL_TRUE;
-	p->uniforms = res;
-	return (GLint)res;
+#endif
+
+	p->blocks[blockIndex].binding = blockBinding;
 }
 
 void glUniform1i(GLint location, GLint v0) {
@@ -455,13 +950,13 @@ void glUniform1i(GLint location, GLint v0) {
 		return;
 
 	// Grabbing passed uniform
-	uniform *u = (uniform *)location;
+	uniform *u = get_uniform(location);
+#ifndef SKIP_ERROR_HANDLING
+	if (!u)
+		return;
+#endif
 
 	// Setting passed value to desired uniform
-	if (u->size == 0) {
-		u->size = 1;
-		u->data = (float*)malloc(u->size * sizeof(float));
-	}
 	u->data[0] = (float)v0;
 }
 
@@ -471,15 +966,15 @@ void glUniform2i(GLint location, GLint v0, GLint v1) {
 		return;
 
 	// Grabbing passed uniform
-	uniform *u = (uniform *)location;
+	uniform *u = get_uniform(location);
+#ifndef SKIP_ERROR_HANDLING
+	if (!u)
+		return;
+#endif
 
 	// Setting passed value to desired uniform
-	if (u->size == 0) {
-		u->size = 2;
-		u->data = (float*)malloc(u->size * sizeof(float));
-	}
-	u->data[0] = (float)v0;
-	u->data[1] = (float)v1;
+	float v[2] = {(float)v0, (float)v1};
+	memcpy_neon(u->data, v, min(2, u->size) * sizeof(float));
 }
 
 void glUniform1f(GLint location, GLfloat v0) {
@@ -488,13 +983,13 @@ void glUniform1f(GLint location, GLfloat v0) {
 		return;
 
 	// Grabbing passed uniform
-	uniform *u = (uniform *)location;
+	uniform *u = get_uniform(location);
+#ifndef SKIP_ERROR_HANDLING
+	if (!u)
+		return;
+#endif
 
 	// Setting passed value to desired uniform
-	if (u->size == 0) {
-		u->size = 1;
-		u->data = (float*)malloc(u->size * sizeof(float));
-	}
 	u->data[0] = v0;
 }
 
@@ -504,15 +999,15 @@ void glUniform2f(GLint location, GLfloat v0, GLfloat v1) {
 		return;
 
 	// Grabbing passed uniform
-	uniform *u = (uniform *)location;
+	uniform *u = get_uniform(location);
+#ifndef SKIP_ERROR_HANDLING
+	if (!u)
+		return;
+#endif
 
 	// Setting passed value to desired uniform
-	if (u->size == 0) {
-		u->size = 2;
-		u->data = (float*)malloc(u->size * sizeof(float));
-	}
-	u->data[0] = v0;
-	u->data[1] = v1;
+	float v[2] = {v0, v1};
+	memcpy_neon(u->data, v, min(2, u->size) * sizeof(float));
 }
 
 void glUniform2fv(GLint location, GLsizei count, const GLfloat *value) {
@@ -521,14 +1016,14 @@ void glUniform2fv(GLint location, GLsizei count, const GLfloat *value) {
 		return;
 
 	// Grabbing passed uniform
-	uniform *u = (uniform *)location;
+	uniform *u = get_uniform(location);
+#ifndef SKIP_ERROR_HANDLING
+	if (!u)
+		return;
+#endif
 
 	// Setting passed value to desired uniform
-	if (u->size == 0) {
-		u->size = 2 * count;
-		u->data = (float*)malloc(u->size * sizeof(float));
-	}
-	memcpy_neon(u->data, value, u->size * sizeof(float));
+	memcpy_neon(u->data, value, min(2 * count, u->size) * sizeof(float));
 }
 
 void glUniform3fv(GLint location, GLsizei count, const GLfloat *value) {
@@ -537,14 +1032,14 @@ void glUniform3fv(GLint location, GLsizei count, const GLfloat *value) {
 		return;
 
 	// Grabbing passed uniform
-	uniform *u = (uniform *)location;
+	uniform *u = get_uniform(location);
+#ifndef SKIP_ERROR_HANDLING
+	if (!u)
+		return;
+#endif
 
 	// Setting passed value to desired uniform
-	if (u->size == 0) {
-		u->size = 3 * count;
-		u->data = (float*)malloc(u->size * sizeof(float));
-	}
-	memcpy_neon(u->data, value, u->size * sizeof(float));
+	memcpy_neon(u->data, value, min(3 * count, u->size) * sizeof(float));
 }
 
 void glUniform4f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3) {
@@ -553,17 +1048,15 @@ void glUniform4f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)
 		return;
 
 	// Grabbing passed uniform
-	uniform *u = (uniform *)location;
+	uniform *u = get_uniform(location);
+#ifndef SKIP_ERROR_HANDLING
+	if (!u)
+		return;
+#endif
 
 	// Setting passed value to desired uniform
-	if (u->size == 0) {
-		u->size = 4;
-		u->data = (float*)malloc(u->size * sizeof(float));
-	}
-	u->data[0] = v0;
-	u->data[1] = v1;
-	u->data[2] = v2;
-	u->data[3] = v3;
+	float v[4] = {v0, v1, v2, v3};
+	memcpy_neon(u->data, v, min(4, u->size) * sizeof(float));
 }
 
 void glUniform4fv(GLint location, GLsizei count, const GLfloat *value) {
@@ -572,14 +1065,14 @@ void glUniform4fv(GLint location, GLsizei count, const GLfloat *value) {
 		return;
 
 	// Grabbing passed uniform
-	uniform *u = (uniform *)location;
+	uniform *u = get_uniform(location);
+#ifndef SKIP_ERROR_HANDLING
+	if (!u)
+		return;
+#endif
 
 	// Setting passed value to desired uniform
-	if (u->size == 0) {
-		u->size = 4 * count;
-		u->data = (float*)malloc(u->size * sizeof(float));
-	}
-	memcpy_neon(u->data, value, u->size * sizeof(float));
+	memcpy_neon(u->data, value, min(4 * count, u->size) * sizeof(float));
 }
 
 void glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) {
@@ -588,14 +1081,14 @@ void glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, cons
 		return;
 
 	// Grabbing passed uniform
-	uniform *u = (uniform *)location;
+	uniform *u = get_uniform(location);
+#ifndef SKIP_ERROR_HANDLING
+	if (!u)
+		return;
+#endif
 
 	// Setting passed value to desired uniform
-	if (u->size == 0) {
-		u->size = 16 * count;
-		u->data = (float*)malloc(u->size * sizeof(float));
-	}
-	memcpy_neon(u->data, value, u->size * sizeof(float));
+	memcpy_neon(u->data, value, min(16 * count, u->size) * sizeof(float));
 }
 
 /*
@@ -644,7 +1137,6 @@ void vglBindAttribLocation(GLuint prog, GLuint index, const GLchar *name, const
 	attributes->componentCount = num;
 	attributes->regIndex = sceGxmProgramParameterGetResourceIndex(param);
 	streams->stride = bpe * num;
-	streams->indexSource = SCE_GXM_INDEX_SOURCE_INDEX_16BIT;
 	if (index >= p->attr_num) {
 		p->attr_num = index + 1;
 		p->stream_num = index + 1;
@@ -692,13 +1184,31 @@ GLint vglBindPackedAttribLocation(GLuint prog, const GLchar *name, const GLuint
 	attributes->componentCount = num;
 	attributes->regIndex = sceGxmProgramParameterGetResourceIndex(param);
 	streams->stride = stride ? stride : bpe * num;
-	streams->indexSource = SCE_GXM_INDEX_SOURCE_INDEX_16BIT;
 	p->stream_num = 1;
 	p->attr_num++;
 
 	return GL_TRUE;
 }
 
+// Equivalent of glVertexAttribDivisor but for sceGxm architecture (to be called before glLinkProgram)
+void vglVertexAttribDivisor(GLuint prog, GLuint index, GLuint divisor) {
+#ifndef SKIP_ERROR_HANDLING
+	// sceGxm can only fetch attributes per vertex or per instance
+	if ((index >= MAX_SHADER_PARAMS) || (divisor > 1)) {
+		SET_GL_ERROR(GL_INVALID_VALUE)
+	}
+	if (!prog || (prog > (MAX_CUSTOM_SHADERS / 2)) || !progs[prog - 1].valid) {
+		SET_GL_ERROR(GL_INVALID_VALUE)
+	}
+#endif
+
+	// Grabbing passed program
+	program *p = &progs[prog - 1];
+
+	// Setting stream fetching mode, kept by later attribute bindings
+	p->stream[index].indexSource = divisor ? SCE_GXM_INDEX_SOURCE_INSTANCE_16BIT : SCE_GXM_INDEX_SOURCE_INDEX_16BIT;
+}
+
 // Equivalent of glVertexAttribPointer but for sceGxm architecture
 void vglVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, GLuint count, const GLvoid *pointer) {
 #ifndef SKIP_ERROR_HANDLING
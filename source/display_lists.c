@@ -0,0 +1,351 @@
+/*
+ * This file is part of vitaGL
+ * Copyright 2017, 2018, 2019, 2020 Rinnegatamante
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * display_lists.c:
+ * Implementation for display lists related functions
+ */
+
+#include "shared.h"
+
+#define DISPLAY_LISTS_NUM 1024 // Available display lists
+#define DISPLAY_LISTS_NESTING 64 // Max nesting level for glCallList calls
+#define DISPLAY_LIST_CHUNK_SIZE 256 // Granularity in bytes for display lists command stream growth
+
+extern GLboolean use_vram;
+extern vector4f current_color;
+
+// Display list command header struct
+typedef struct dlist_cmd {
+	uint16_t type; // Command type
+	uint16_t size; // Payload size in bytes
+} dlist_cmd;
+
+// Display list draw command payload struct
+typedef struct dlist_draw {
+	SceGxmPrimitiveType prim; // Primitive to draw
+	uint32_t idx_count; // Number of indices
+	vector3f *vertices; // Vertices memblock
+	vector2f *uv_map; // Texcoords memblock (NULL if not specified)
+	vector4f *colors; // Colors memblock
+	uint16_t *indices; // Indices memblock
+} dlist_draw;
+
+// Display list struct
+typedef struct display_list {
+	GLboolean used; // Flag to check if the display list id is reserved
+	uint8_t *cmds; // Command stream
+	uint32_t size; // Size in bytes of the command stream
+	uint32_t capacity; // Capacity in bytes of the command stream
+} display_list;
+
+static display_list display_lists[DISPLAY_LISTS_NUM]; // Display lists array
+static display_list compiling_list; // Display list currently being compiled
+static GLuint compiling_list_id; // Id of the display list currently being compiled
+static vector4f compiling_color; // Current color at glNewList call
+static uint8_t call_depth = 0; // Current glCallList nesting level
+
+void *cur_display_list = NULL; // Display list being compiled (NULL if none)
+GLenum display_list_mode; // Compiling mode for current display list
+
+static void *append_display_list_cmd(display_list *l, uint16_t type, uint16_t size) {
+	// Growing command stream if required, payloads are kept 4 bytes aligned
+	uint32_t cmd_size = sizeof(dlist_cmd) + ((size + 3) & ~3);
+	if (l->size + cmd_size > l->capacity) {
+		uint32_t new_capacity = (l->size + cmd_size + DISPLAY_LIST_CHUNK_SIZE - 1) & ~(DISPLAY_LIST_CHUNK_SIZE - 1);
+		uint8_t *cmds = (uint8_t *)realloc(l->cmds, new_capacity);
+		if (!cmds)
+			return NULL;
+		l->cmds = cmds;
+		l->capacity = new_capacity;
+	}
+	dlist_cmd *cmd = (dlist_cmd *)&l->cmds[l->size];
+	cmd->type = type;
+	cmd->size = size;
+	l->size += cmd_size;
+	return &cmd[1];
+}
+
+static void free_display_list(display_list *l) {
+	// Freeing memblocks owned by draw commands
+	uint32_t offs = 0;
+	while (offs < l->size) {
+		dlist_cmd *cmd = (dlist_cmd *)&l->cmds[offs];
+		if (cmd->type == DLIST_CMD_DRAW) {
+			dlist_draw *draw = (dlist_draw *)&cmd[1];
+			vgl_mem_free(draw->colors);
+		}
+		offs += sizeof(dlist_cmd) + ((cmd->size + 3) & ~3);
+	}
+	free(l->cmds);
+	l->cmds = NULL;
+	l->size = l->capacity = 0;
+}
+
+static void execute_display_list(display_list *l) {
+	uint32_t offs = 0;
+	while (offs < l->size) {
+		dlist_cmd *cmd = (dlist_cmd *)&l->cmds[offs];
+		GLfloat *args = (GLfloat *)&cmd[1];
+		switch (cmd->type) {
+		case DLIST_CMD_DRAW: {
+			dlist_draw *draw = (dlist_draw *)&cmd[1];
+			draw_imm_vertices(draw->prim, draw->vertices, draw->uv_map, draw->colors, draw->indices, draw->idx_count);
+		} break;
+		case DLIST_CMD_COLOR:
+			memcpy_neon(&current_color, args, sizeof(vector4f));
+			break;
+		case DLIST_CMD_MATRIX_MODE:
+			glMatrixMode(*(GLenum *)args);
+			break;
+		case DLIST_CMD_LOAD_IDENTITY:
+			glLoadIdentity();
+			break;
+		case DLIST_CMD_LOAD_MATRIX:
+			glLoadMatrixf(args);
+			break;
+		case DLIST_CMD_MULT_MATRIX:
+			glMultMatrixf(args);
+			break;
+		case DLIST_CMD_TRANSLATE:
+			glTranslatef(args[0], args[1], args[2]);
+			break;
+		case DLIST_CMD_SCALE:
+			glScalef(args[0], args[1], args[2]);
+			break;
+		case DLIST_CMD_ROTATE:
+			glRotatef(args[0], args[1], args[2], args[3]);
+			break;
+		case DLIST_CMD_PUSH_MATRIX:
+			glPushMatrix();
+			break;
+		case DLIST_CMD_POP_MATRIX:
+			glPopMatrix();
+			break;
+		case DLIST_CMD_BIND_TEXTURE:
+			glBindTexture(((GLenum *)args)[0], ((GLuint *)args)[1]);
+			break;
+		case DLIST_CMD_CALL_LIST:
+			glCallList(*(GLuint *)args);
+			break;
+		case DLIST_CMD_ORTHO:
+			glOrtho(args[0], args[1], args[2], args[3], args[4], args[5]);
+			break;
+		case DLIST_CMD_FRUSTUM:
+			glFrustum(args[0], args[1], args[2], args[3], args[4], args[5]);
+			break;
+		case DLIST_CMD_PERSPECTIVE:
+			gluPerspective(args[0], args[1], args[2], args[3]);
+			break;
+		case DLIST_CMD_ENABLE:
+			glEnable(*(GLenum *)args);
+			break;
+		case DLIST_CMD_DISABLE:
+			glDisable(*(GLenum *)args);
+			break;
+		case DLIST_CMD_BLEND_FUNC:
+			glBlendFunc(((GLenum *)args)[0], ((GLenum *)args)[1]);
+			break;
+		case DLIST_CMD_TEX_ENVI:
+			glTexEnvi(((GLenum *)args)[0], ((GLenum *)args)[1], ((GLint *)args)[2]);
+			break;
+		case DLIST_CMD_TEX_ENVF:
+			glTexEnvf(((GLenum *)args)[0], ((GLenum *)args)[1], args[2]);
+			break;
+		case DLIST_CMD_TEX_ENV_COLOR:
+			glTexEnvfv(((GLenum *)args)[0], GL_TEXTURE_ENV_COLOR, &args[1]);
+			break;
+		case DLIST_CMD_ALPHA_FUNC:
+			glAlphaFunc(((GLenum *)args)[0], args[1]);
+			break;
+		case DLIST_CMD_DEPTH_FUNC:
+			glDepthFunc(*(GLenum *)args);
+			break;
+		case DLIST_CMD_DEPTH_MASK:
+			glDepthMask(*(GLboolean *)args);
+			break;
+		case DLIST_CMD_CULL_FACE:
+			glCullFace(*(GLenum *)args);
+			break;
+		default:
+			break;
+		}
+		offs += sizeof(dlist_cmd) + ((cmd->size + 3) & ~3);
+	}
+}
+
+GLboolean record_display_list_cmd(dlistCmdType type, const void *args, uint32_t size) {
+	void *payload = append_display_list_cmd((display_list *)cur_display_list, type, size);
+	if (payload) {
+		if (size)
+			memcpy(payload, args, size);
+	} else
+		vgl_error = GL_OUT_OF_MEMORY;
+
+	// With GL_COMPILE mode, commands must not be executed
+	return display_list_mode == GL_COMPILE;
+}
+
+GLboolean reserve_display_list_draw(SceGxmPrimitiveType prim, uint32_t vertex_count, uint32_t idx_count, GLboolean has_uv, vector3f **vertices, vector2f **uv_map, vector4f **colors, uint16_t **indices) {
+	// Allocating a single persistent memblock for all the attributes
+	uint32_t uv_size = has_uv ? vertex_count * sizeof(vector2f) : 0;
+	uint32_t size = vertex_count * (sizeof(vector4f) + sizeof(vector3f)) + uv_size + idx_count * sizeof(uint16_t);
+	vglMemType type = use_vram ? VGL_MEM_VRAM : VGL_MEM_RAM;
+	uint8_t *data = (uint8_t *)gpu_alloc_mapped(size, &type);
+	if (!data)
+		return GL_FALSE;
+	dlist_draw *draw = (dlist_draw *)append_display_list_cmd((display_list *)cur_display_list, DLIST_CMD_DRAW, sizeof(dlist_draw));
+	if (!draw) {
+		vgl_mem_free(data);
+		return GL_FALSE;
+	}
+
+	// Colors are placed first to keep memblock start as free address for the whole draw
+	draw->prim = prim;
+	draw->idx_count = idx_count;
+	draw->colors = (vector4f *)data;
+	draw->vertices = (vector3f *)&draw->colors[vertex_count];
+	draw->uv_map = has_uv ? (vector2f *)&draw->vertices[vertex_count] : NULL;
+	draw->indices = (uint16_t *)((uint8_t *)&draw->vertices[vertex_count] + uv_size);
+	*vertices = draw->vertices;
+	*uv_map = draw->uv_map;
+	*colors = draw->colors;
+	*indices = draw->indices;
+	return GL_TRUE;
+}
+
+/*
+ * ------------------------------
+ * - IMPLEMENTATION STARTS HERE -
+ * ------------------------------
+ */
+
+GLuint glGenLists(GLsizei range) {
+#ifndef SKIP_ERROR_HANDLING
+	// Error handling
+	if (range < 0) {
+		vgl_error = GL_INVALID_VALUE;
+		return 0;
+	}
+#endif
+	if (range == 0)
+		return 0;
+
+	// Searching for a contiguous range of free display lists
+	int i, j;
+	for (i = 0; i + range <= DISPLAY_LISTS_NUM; i++) {
+		for (j = 0; j < range; j++) {
+			if (display_lists[i + j].used)
+				break;
+		}
+		if (j == range) {
+			for (j = 0; j < range; j++) {
+				display_lists[i + j].used = GL_TRUE;
+			}
+			return i + 1;
+		}
+		i += j;
+	}
+	return 0;
+}
+
+GLboolean glIsList(GLuint list) {
+	return (list > 0) && (list <= DISPLAY_LISTS_NUM) && display_lists[list - 1].used;
+}
+
+void glDeleteLists(GLuint list, GLsizei range) {
+#ifndef SKIP_ERROR_HANDLING
+	// Error handling
+	if (range < 0) {
+		SET_GL_ERROR(GL_INVALID_VALUE)
+	}
+#endif
+
+	// Deleting display lists and freeing their memblocks
+	GLuint i;
+	for (i = list; i < list + range; i++) {
+		if ((i > 0) && (i <= DISPLAY_LISTS_NUM) && display_lists[i - 1].used) {
+			free_display_list(&display_lists[i - 1]);
+			display_lists[i - 1].used = GL_FALSE;
+		}
+	}
+}
+
+void glNewList(GLuint list, GLenum mode) {
+	flush_imm_batch();
+#ifndef SKIP_ERROR_HANDLING
+	// Error handling
+	if ((list == 0) || (list > DISPLAY_LISTS_NUM)) {
+		SET_GL_ERROR(GL_INVALID_VALUE)
+	} else if ((mode != GL_COMPILE) && (mode != GL_COMPILE_AND_EXECUTE)) {
+		SET_GL_ERROR(GL_INVALID_ENUM)
+	} else if (cur_display_list || (phase == MODEL_CREATION)) {
+		SET_GL_ERROR(GL_INVALID_OPERATION)
+	}
+#endif
+
+	// Display list content will be replaced only at glEndList call
+	memset(&compiling_list, 0, sizeof(display_list));
+	compiling_list_id = list;
+	compiling_color = current_color;
+	display_list_mode = mode;
+	cur_display_list = &compiling_list;
+}
+
+void glEndList(void) {
+#ifndef SKIP_ERROR_HANDLING
+	// Error handling
+	if (!cur_display_list || (phase == MODEL_CREATION)) {
+		SET_GL_ERROR(GL_INVALID_OPERATION)
+	}
+#endif
+
+	// Vertices colors are baked at compile time, so we only need to replay the resulting current color
+	if (memcmp(&compiling_color, &current_color, sizeof(vector4f))) {
+		record_display_list_cmd(DLIST_CMD_COLOR, &current_color, sizeof(vector4f));
+		if (display_list_mode == GL_COMPILE)
+			current_color = compiling_color;
+	}
+
+	// Replacing display list content
+	display_list *l = &display_lists[compiling_list_id - 1];
+	free_display_list(l);
+	*l = compiling_list;
+	l->used = GL_TRUE;
+	cur_display_list = NULL;
+}
+
+void glCallList(GLuint list) {
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		if (record_display_list_cmd(DLIST_CMD_CALL_LIST, &list, sizeof(GLuint)))
+			return;
+	}
+
+	if ((list == 0) || (list > DISPLAY_LISTS_NUM) || (call_depth >= DISPLAY_LISTS_NESTING))
+		return;
+
+	// Executing display list commands without recording them
+	flush_imm_batch();
+	void *compiling = cur_display_list;
+	cur_display_list = NULL;
+	call_depth++;
+	execute_display_list(&display_lists[list - 1]);
+	call_depth--;
+	cur_display_list = compiling;
+}
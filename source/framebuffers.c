@@ -85,6 +85,7 @@ void glGenFramebuffers(GLsizei n, GLuint *ids) {
 }
 
 void glDeleteFramebuffers(GLsizei n, GLuint *framebuffers) {
+	flush_imm_batch();
 #ifndef SKIP_ERROR_HANDLING
 	if (n < 0) {
 		SET_GL_ERROR(GL_INVALID_VALUE)
@@ -109,6 +110,7 @@ void glDeleteFramebuffers(GLsizei n, GLuint *framebuffers) {
 }
 
 void glBindFramebuffer(GLenum target, GLuint fb) {
+	flush_imm_batch();
 	switch (target) {
 	case GL_DRAW_FRAMEBUFFER:
 		active_write_fb = (framebuffer *)fb;
@@ -126,6 +128,7 @@ void glBindFramebuffer(GLenum target, GLuint fb) {
 }
 
 void glFramebufferTexture(GLenum target, GLenum attachment, GLuint tex_id, GLint level) {
+	flush_imm_batch();
 	// Detecting requested framebuffer
 	framebuffer *fb = NULL;
 	switch (target) {
@@ -186,6 +189,7 @@ void glFramebufferTexture(GLenum target, GLenum attachment, GLuint tex_id, GLint
 }
 
 void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid *data) {
+	flush_imm_batch();
 	/*
 	 * Callbacks are actually used to just perform down/up-sampling
 	 * between U8 texture formats. Reads are expected to give as result
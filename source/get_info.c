@@ -155,6 +155,15 @@ void glGetIntegerv(GLenum pname, GLint *data) {
 	case GL_MAX_TEXTURE_SIZE:
 		*data = 1024;
 		break;
+	case GL_MAX_LIGHTS:
+		*data = MAX_LIGHTS_NUM;
+		break;
+	case GL_MAX_UNIFORM_BUFFER_BINDINGS:
+		*data = UNIFORM_BUFFER_BINDINGS_NUM;
+		break;
+	case GL_VERTEX_ARRAY_BINDING:
+		*data = get_vertex_array_binding();
+		break;
 	case GL_VIEWPORT:
 		data[0] = gl_viewport.x;
 		data[1] = gl_viewport.y;
@@ -214,6 +223,12 @@ GLboolean glIsEnabled(GLenum cap) {
 	case GL_POLYGON_OFFSET_POINT:
 		ret = pol_offset_point;
 		break;
+	case GL_LIGHTING:
+		ret = lighting_state;
+		break;
+	case GL_COLOR_MATERIAL:
+		ret = color_material_state;
+		break;
 	default:
 		vgl_error = GL_INVALID_ENUM;
 		break;
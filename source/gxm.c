@@ -37,6 +37,8 @@ static SceGxmSyncObject *gxm_sync_objects[DISPLAY_BUFFER_COUNT]; // Display sync
 unsigned int gxm_front_buffer_index; // Display front buffer id
 unsigned int gxm_back_buffer_index; // Display back buffer id
 static unsigned int gxm_scene_flags = 0; // Current gxm scene flags
+static volatile unsigned int *gxm_frame_notification; // Notification written by the GPU once a frame is completed
+static uint32_t gxm_frames_submitted = 0; // Number of frames submitted to the GPU
 
 static void *gxm_shader_patcher_buffer_addr; // Shader PAtcher buffer memblock starting address
 static void *gxm_shader_patcher_vertex_usse_addr; // Shader Patcher vertex USSE memblock starting address
@@ -140,6 +142,10 @@ void initGxm(void) {
 	else
 		sceGxmInitialize(&gxm_init_params);
 	gxm_initialized = GL_TRUE;
+
+	// Setting up frames completion notification
+	gxm_frame_notification = sceGxmGetNotificationRegion();
+	*gxm_frame_notification = gxm_frames_submitted;
 }
 
 void initGxmContext(void) {
@@ -375,6 +381,15 @@ void waitRenderingDone(void) {
 	sceGxmFinish(gxm_context);
 }
 
+uint32_t get_current_frame(void) {
+	// Current frame gets the next id once submitted
+	return gxm_frames_submitted + 1;
+}
+
+GLboolean is_frame_completed(uint32_t frame) {
+	return (int32_t)(*gxm_frame_notification - frame) >= 0;
+}
+
 /*
  * ------------------------------
  * - IMPLEMENTATION STARTS HERE -
@@ -419,8 +434,12 @@ void vglStartRendering(void) {
 }
 
 void vglStopRenderingInit(void) {
-	// Ending drawing scene
-	sceGxmEndScene(gxm_context, NULL, NULL);
+	flush_imm_batch();
+	// Ending drawing scene, GPU will notify us once done with it
+	SceGxmNotification frame_notification;
+	frame_notification.address = gxm_frame_notification;
+	frame_notification.value = ++gxm_frames_submitted;
+	sceGxmEndScene(gxm_context, NULL, &frame_notification);
 	if (system_app_mode && vblank)
 		sceDisplayWaitVblankStart();
 }
@@ -442,6 +461,8 @@ void vglStopRenderingTerm(void) {
 
 	// Resetting vitaGL mempool
 	gpu_pool_reset();
+	custom_shaders_new_frame();
+	release_pending_programs(GL_FALSE);
 }
 
 void vglStopRendering() {
@@ -470,6 +491,7 @@ void vglUpdateCommonDialog() {
 }
 
 void glFinish(void) {
+	flush_imm_batch();
 	// Waiting for GPU to finish drawing jobs
 	sceGxmFinish(gxm_context);
 }
@@ -23,58 +23,245 @@
 
 #include "shared.h"
 
-// Vertex list struct
-typedef struct vertexList {
-	vector3f v;
-	void *next;
-} vertexList;
-
-// Color vertex list struct
-typedef struct rgbaList {
-	vector4f v;
-	void *next;
-} rgbaList;
-
-// Texture coord list struct
-typedef struct uvList {
-	vector2f v;
-	void *next;
-} uvList;
-
-static vertexList *model_vertices = NULL; // Pointer to vertex list
-static vertexList *last_vert = NULL; // Pointer to last element in vertex list
-static rgbaList *model_color = NULL; // Pointer to color vertex list
-static rgbaList *last_clr = NULL; // Pointer to last element in color vertex list
-static uvList *model_uv = NULL; // Pointer to texcoord list
-static uvList *last_uv = NULL; // Pointer to last element in texcoord list
-static uint64_t vertex_count = 0; // Vertex counter for vertex list
+#define IMM_ARENA_SIZE 1024 // Starting capacity in vertices for immediate mode arena
+
+// Immediate mode arena, attributes are stored as separate arrays so that they can be uploaded with a single copy each
+static vector3f *imm_vertices = NULL; // Vertices array
+static vector4f *imm_colors = NULL; // Colors array
+static vector2f *imm_uvs = NULL; // Texcoords array
+static uint32_t imm_size = 0; // Capacity in vertices of immediate mode arena
+static GLboolean imm_has_uv = GL_FALSE; // Flag to check if texcoords have been specified for current primitive
+static uint32_t vertex_count = 0; // Vertex counter for immediate mode arena
+static uint32_t imm_base = 0; // First vertex of current primitive in immediate mode arena (previous ones belong to pending batch)
+static uint16_t *imm_indices = NULL; // Indices array for pending batch
+static uint32_t imm_indices_size = 0; // Capacity of indices array for pending batch
+static uint32_t batch_idx_count = 0; // Number of indices of pending batch
+static SceGxmPrimitiveType batch_prim; // Primitive of pending batch
+static GLboolean batch_textured; // Flag to check if pending batch is textured
+static matrix4x4 batch_mvp; // ModelViewProjection matrix of pending batch
+static matrix4x4 batch_modelview; // ModelView matrix of pending batch
+static GLboolean imm_batching = GL_FALSE; // Current state for immediate mode batching
+static GLint run_start; // First element of current glArrayElement sequential run
+static uint32_t run_count = 0; // Number of elements in current glArrayElement sequential run
 static SceGxmPrimitiveType prim; // Current in use primitive for rendering
 static SceGxmPrimitiveTypeExtra prim_extra = SCE_GXM_PRIMITIVE_NONE; // Current in use non native primitive for rendering
 static uint8_t np = 0xFF; // Number of expected vertices per element for current in use primitive
 
 vector4f current_color = { 1.0f, 1.0f, 1.0f, 1.0f }; // Current in use color
+static vector2f current_uv = { 0.0f, 0.0f }; // Current in use texcoord
+static const stream_layout imm_tex2d_layouts[2] = { // Streams layout for immediate mode textured draws
+	{ { SCE_GXM_ATTRIBUTE_FORMAT_F32, 3, SCE_GXM_INDEX_SOURCE_INDEX_16BIT, sizeof(vector3f) } },
+	{ { SCE_GXM_ATTRIBUTE_FORMAT_F32, 2, SCE_GXM_INDEX_SOURCE_INDEX_16BIT, sizeof(vector2f) } }
+};
+
+static GLboolean reserve_imm_vertex(void) {
+	if (vertex_count < imm_size)
+		return GL_TRUE;
+
+	// Growing immediate mode arena
+	uint32_t new_size = imm_size ? imm_size * 2 : IMM_ARENA_SIZE;
+	vector3f *verts = (vector3f *)realloc(imm_vertices, new_size * sizeof(vector3f));
+	if (!verts)
+		return GL_FALSE;
+	imm_vertices = verts;
+	vector4f *clrs = (vector4f *)realloc(imm_colors, new_size * sizeof(vector4f));
+	if (!clrs)
+		return GL_FALSE;
+	imm_colors = clrs;
+	vector2f *uvs = (vector2f *)realloc(imm_uvs, new_size * sizeof(vector2f));
+	if (!uvs)
+		return GL_FALSE;
+	imm_uvs = uvs;
+	imm_size = new_size;
+	return GL_TRUE;
+}
+
+static void materialize_imm_run(void);
+
+static void add_imm_vertex(GLfloat x, GLfloat y, GLfloat z) {
+	if (run_count)
+		materialize_imm_run();
+	if (!reserve_imm_vertex()) {
+		SET_GL_ERROR(GL_OUT_OF_MEMORY)
+	}
+
+	// Populating the new vertex with current color and texcoord
+	imm_vertices[vertex_count].x = x;
+	imm_vertices[vertex_count].y = y;
+	imm_vertices[vertex_count].z = z;
+	imm_colors[vertex_count] = current_color;
+	imm_uvs[vertex_count] = current_uv;
+	vertex_count++;
+}
+
+static uint32_t get_imm_indices_count(uint32_t n) {
+	return prim_extra == SCE_GXM_PRIMITIVE_QUADS ? (n >> 2) * 6 : n;
+}
+
+static void setup_imm_indices(uint16_t *indices, uint16_t base, uint32_t n) {
+	int i;
+	if (prim_extra == SCE_GXM_PRIMITIVE_QUADS) {
+		uint32_t quad_n = n >> 2;
+		for (i = 0; i < quad_n; i++) {
+			uint16_t v = base + i * 4;
+			indices[i * 6] = v;
+			indices[i * 6 + 1] = v + 1;
+			indices[i * 6 + 2] = v + 3;
+			indices[i * 6 + 3] = v + 1;
+			indices[i * 6 + 4] = v + 2;
+			indices[i * 6 + 5] = v + 3;
+		}
+	} else {
+		for (i = 0; i < n; i++) {
+			indices[i] = base + i;
+		}
+	}
+}
+
+static GLboolean is_imm_textured(void) {
+	texture_unit *tex_unit = &texture_units[server_texture_unit];
+	return (server_texture_unit >= 0) && (tex_unit->enabled) && imm_has_uv && (texture_slots[tex_unit->tex_id].valid);
+}
+
+void draw_imm_vertices(SceGxmPrimitiveType type, vector3f *vertices, vector2f *uv_map, vector4f *colors, uint16_t *indices, uint32_t idx_count) {
+	// Checking if we can totally skip drawing cause of culling mode
+	if (no_polygons_mode && ((type == SCE_GXM_PRIMITIVE_TRIANGLES) || (type >= SCE_GXM_PRIMITIVE_TRIANGLE_STRIP)))
+		return;
+
+	// Aliasing server texture unit and texture id for better code readability
+	texture_unit *tex_unit = &texture_units[server_texture_unit];
+	int texture2d_idx = tex_unit->tex_id;
+
+	// Calculating mvp matrix
+	if (mvp_modified) {
+		matrix4x4_multiply(mvp_matrix, projection_matrix, modelview_matrix);
+		mvp_modified = GL_FALSE;
+	}
+
+	// Checking if we have to write a texture
+	if ((server_texture_unit >= 0) && (tex_unit->enabled) && uv_map && (texture_slots[texture2d_idx].valid)) {
+		// Setting proper vertex and fragment programs and uniforms
+		setup_tex2d_programs(GL_FALSE, imm_tex2d_layouts);
+		
+		// Setting in use texture
+		sceGxmSetFragmentTexture(gxm_context, 0, &texture_slots[texture2d_idx].gxm_tex);
+
+		// Performing the requested draw call
+		sceGxmSetVertexStream(gxm_context, 0, vertices);
+		sceGxmSetVertexStream(gxm_context, 1, uv_map);
+		sceGxmDraw(gxm_context, type, SCE_GXM_INDEX_FORMAT_U16, indices, idx_count);
+	} else {
+		// Setting proper vertex and fragment programs
+		sceGxmSetVertexProgram(gxm_context, rgba_vertex_program_patched);
+		sceGxmSetFragmentProgram(gxm_context, rgba_fragment_program_patched);
+		
+		// Reserving default vertex uniform buffer for wvp
+		void *vbuffer;
+		sceGxmReserveVertexDefaultUniformBuffer(gxm_context, &vbuffer);
+		
+		// Uploading wvp matrix
+		sceGxmSetUniformDataF(vbuffer, rgba_wvp, 0, 16, (const float *)mvp_matrix);
+
+		// Performing the requested draw call
+		sceGxmSetVertexStream(gxm_context, 0, vertices);
+		sceGxmSetVertexStream(gxm_context, 1, colors);
+		sceGxmDraw(gxm_context, type, SCE_GXM_INDEX_FORMAT_U16, indices, idx_count);
+	}
+}
+
+void flush_imm_batch(void) {
+	if (!imm_base)
+		return;
+
+	// Uploading batched vertices and indices
+	vector3f *vertices = (vector3f *)gpu_pool_memalign(imm_base * sizeof(vector3f), sizeof(vector3f));
+	memcpy_neon(vertices, imm_vertices, imm_base * sizeof(vector3f));
+	uint16_t *indices = (uint16_t *)gpu_pool_memalign(batch_idx_count * sizeof(uint16_t), sizeof(uint16_t));
+	memcpy_neon(indices, imm_indices, batch_idx_count * sizeof(uint16_t));
+	vector2f *uv_map = NULL;
+	vector4f *colors = NULL;
+	if (batch_textured) {
+		uv_map = (vector2f *)gpu_pool_memalign(imm_base * sizeof(vector2f), sizeof(vector2f));
+		memcpy_neon(uv_map, imm_uvs, imm_base * sizeof(vector2f));
+	} else {
+		colors = (vector4f *)gpu_pool_memalign(imm_base * sizeof(vector4f), sizeof(vector4f));
+		memcpy_neon(colors, imm_colors, imm_base * sizeof(vector4f));
+	}
+
+	// Drawing the batch with the matrices it has been recorded with
+	matrix4x4 mvp, modelview;
+	GLboolean modified = mvp_modified;
+	matrix4x4_copy(mvp, mvp_matrix);
+	matrix4x4_copy(modelview, modelview_matrix);
+	matrix4x4_copy(mvp_matrix, batch_mvp);
+	matrix4x4_copy(modelview_matrix, batch_modelview);
+	mvp_modified = GL_FALSE;
+	draw_imm_vertices(batch_prim, vertices, uv_map, colors, indices, batch_idx_count);
+	matrix4x4_copy(mvp_matrix, mvp);
+	matrix4x4_copy(modelview_matrix, modelview);
+	mvp_modified = modified;
+
+	// Moving primitive being built, if any, at arena start
+	uint32_t n = vertex_count - imm_base;
+	if (n) {
+		memmove(imm_vertices, &imm_vertices[imm_base], n * sizeof(vector3f));
+		memmove(imm_colors, &imm_colors[imm_base], n * sizeof(vector4f));
+		memmove(imm_uvs, &imm_uvs[imm_base], n * sizeof(vector2f));
+	}
+	vertex_count = n;
+	imm_base = 0;
+	batch_idx_count = 0;
+}
+
+static void draw_imm_run(GLint first, uint32_t n) {
+	// Checking if we can totally skip drawing cause of culling mode
+	if (no_polygons_mode && ((prim == SCE_GXM_PRIMITIVE_TRIANGLES) || (prim >= SCE_GXM_PRIMITIVE_TRIANGLE_STRIP)))
+		return;
+
+	// Aliasing client and server texture units for better code readability
+	texture_unit *arrays = &texture_units[client_texture_unit];
+	texture_unit *tex_unit = &texture_units[server_texture_unit];
+	int texture2d_idx = tex_unit->tex_id;
 
-static void purge_vertex_list() {
-	vertexList *old;
-	rgbaList *old2;
-	uvList *old3;
-
-	// Purging color and vertex lists
-	while (model_vertices != NULL) {
-		old = model_vertices;
-		old2 = model_color;
-		model_vertices = model_vertices->next;
-		model_color = model_color->next;
-		free(old);
-		free(old2);
+	// Calculating mvp matrix
+	if (mvp_modified) {
+		matrix4x4_multiply(mvp_matrix, projection_matrix, modelview_matrix);
+		mvp_modified = GL_FALSE;
 	}
 
-	// Purging texcoord list
-	while (model_uv != NULL) {
-		old3 = model_uv;
-		model_uv = model_uv->next;
-		free(old3);
+	// Generating indices
+	uint32_t idx_count = get_imm_indices_count(n);
+	uint16_t *indices = (uint16_t *)gpu_pool_memalign(idx_count * sizeof(uint16_t), sizeof(uint16_t));
+	setup_imm_indices(indices, 0, n);
+
+	// Programs and texture are chosen as draw_imm_vertices does, vertices are read from the bound arrays
+	stream_layout layouts[2];
+	layouts[0] = get_array_layout(&arrays->vertex_array, GL_FALSE, _glDraw_IsVertexArrayMapped(&arrays->vertex_array));
+	sceGxmSetVertexStream(gxm_context, 0, _glDraw_GetVertexArray(&arrays->vertex_array, first, n));
+	if ((server_texture_unit >= 0) && (tex_unit->enabled) && arrays->texture_array_state && (texture_slots[texture2d_idx].valid)) {
+		layouts[1] = get_array_layout(&arrays->texture_array, GL_TRUE, _glDraw_IsVertexArrayMapped(&arrays->texture_array));
+		setup_tex2d_programs(GL_FALSE, layouts);
+		sceGxmSetFragmentTexture(gxm_context, 0, &texture_slots[texture2d_idx].gxm_tex);
+		sceGxmSetVertexStream(gxm_context, 1, _glDraw_GetVertexArray(&arrays->texture_array, first, n));
+	} else {
+		if (arrays->color_array_state) {
+			layouts[1] = get_array_layout(&arrays->color_array, GL_TRUE, _glDraw_IsVertexArrayMapped(&arrays->color_array));
+			sceGxmSetVertexStream(gxm_context, 1, _glDraw_GetVertexArray(&arrays->color_array, first, n));
+		} else {
+			layouts[1].raw = 0;
+			layouts[1].format = SCE_GXM_ATTRIBUTE_FORMAT_F32;
+			layouts[1].num = 4;
+			layouts[1].index_source = SCE_GXM_INDEX_SOURCE_INSTANCE_16BIT;
+			layouts[1].stride = sizeof(vector4f);
+			sceGxmSetVertexStream(gxm_context, 1, upload_const_color());
+		}
+		sceGxmSetVertexProgram(gxm_context, get_vertex_program_variant(rgba_vertex_id, rgba_attr_regs, layouts, 2));
+		sceGxmSetFragmentProgram(gxm_context, rgba_fragment_program_patched);
+		void *vbuffer;
+		sceGxmReserveVertexDefaultUniformBuffer(gxm_context, &vbuffer);
+		sceGxmSetUniformDataF(vbuffer, rgba_wvp, 0, 16, (const float *)mvp_matrix);
 	}
+	sceGxmDraw(gxm_context, prim, SCE_GXM_INDEX_FORMAT_U16, indices, idx_count);
 }
 
 /*
@@ -91,26 +278,8 @@ void glVertex3f(GLfloat x, GLfloat y, GLfloat z) {
 	}
 #endif
 
-	// Adding a new element to color and vertex lists
-	if (model_vertices == NULL) {
-		model_vertices = last_vert = (vertexList *)malloc(sizeof(vertexList));
-		model_color = last_clr = (rgbaList *)malloc(sizeof(rgbaList));
-	} else {
-		last_vert->next = (vertexList *)malloc(sizeof(vertexList));
-		last_clr->next = (rgbaList *)malloc(sizeof(rgbaList));
-		last_vert = last_vert->next;
-		last_clr = last_clr->next;
-	}
-
-	// Properly populating the new element
-	last_vert->v.x = x;
-	last_vert->v.y = y;
-	last_vert->v.z = z;
-	memcpy_neon(&last_clr->v, &current_color.r, sizeof(vector4f));
-	last_clr->next = last_vert->next = NULL;
-
-	// Increasing vertex counter
-	vertex_count++;
+	// Adding a new vertex to immediate mode arena
+	add_imm_vertex(x, y, z);
 }
 
 void glVertex3fv(const GLfloat *v) {
@@ -121,24 +290,8 @@ void glVertex3fv(const GLfloat *v) {
 	}
 #endif
 
-	// Adding a new element to color and vertex lists
-	if (model_vertices == NULL) {
-		model_vertices = last_vert = (vertexList *)malloc(sizeof(vertexList));
-		model_color = last_clr = (rgbaList *)malloc(sizeof(rgbaList));
-	} else {
-		last_vert->next = (vertexList *)malloc(sizeof(vertexList));
-		last_clr->next = (rgbaList *)malloc(sizeof(rgbaList));
-		last_vert = last_vert->next;
-		last_clr = last_clr->next;
-	}
-
-	// Properly populating the new element
-	memcpy_neon(&last_vert->v, v, sizeof(vector3f));
-	memcpy_neon(&last_clr->v, &current_color.r, sizeof(vector4f));
-	last_clr->next = last_vert->next = NULL;
-
-	// Increasing vertex counter
-	vertex_count++;
+	// Adding a new vertex to immediate mode arena
+	add_imm_vertex(v[0], v[1], v[2]);
 }
 
 void glVertex2f(GLfloat x, GLfloat y) {
@@ -146,6 +299,10 @@ void glVertex2f(GLfloat x, GLfloat y) {
 }
 
 void glColor3f(GLfloat red, GLfloat green, GLfloat blue) {
+	// Pending glArrayElement run must be copied with the previous color
+	if (run_count)
+		materialize_imm_run();
+
 	// Setting current color value
 	current_color.r = red;
 	current_color.g = green;
@@ -154,12 +311,20 @@ void glColor3f(GLfloat red, GLfloat green, GLfloat blue) {
 }
 
 void glColor3fv(const GLfloat *v) {
+	// Pending glArrayElement run must be copied with the previous color
+	if (run_count)
+		materialize_imm_run();
+
 	// Setting current color value
 	memcpy_neon(&current_color.r, v, sizeof(vector3f));
 	current_color.a = 1.0f;
 }
 
 void glColor3ub(GLubyte red, GLubyte green, GLubyte blue) {
+	// Pending glArrayElement run must be copied with the previous color
+	if (run_count)
+		materialize_imm_run();
+
 	// Setting current color value
 	current_color.r = (1.0f * red) / 255.0f;
 	current_color.g = (1.0f * green) / 255.0f;
@@ -168,6 +333,10 @@ void glColor3ub(GLubyte red, GLubyte green, GLubyte blue) {
 }
 
 void glColor3ubv(const GLubyte *c) {
+	// Pending glArrayElement run must be copied with the previous color
+	if (run_count)
+		materialize_imm_run();
+
 	// Setting current color value
 	current_color.r = (1.0f * c[0]) / 255.0f;
 	current_color.g = (1.0f * c[1]) / 255.0f;
@@ -176,6 +345,10 @@ void glColor3ubv(const GLubyte *c) {
 }
 
 void glColor4f(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
+	// Pending glArrayElement run must be copied with the previous color
+	if (run_count)
+		materialize_imm_run();
+
 	// Setting current color value
 	current_color.r = red;
 	current_color.g = green;
@@ -184,11 +357,19 @@ void glColor4f(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
 }
 
 void glColor4fv(const GLfloat *v) {
+	// Pending glArrayElement run must be copied with the previous color
+	if (run_count)
+		materialize_imm_run();
+
 	// Setting current color value
 	memcpy_neon(&current_color.r, v, sizeof(vector4f));
 }
 
 void glColor4ub(GLubyte red, GLubyte green, GLubyte blue, GLubyte alpha) {
+	// Pending glArrayElement run must be copied with the previous color
+	if (run_count)
+		materialize_imm_run();
+
 	current_color.r = (1.0f * red) / 255.0f;
 	current_color.g = (1.0f * green) / 255.0f;
 	current_color.b = (1.0f * blue) / 255.0f;
@@ -196,6 +377,10 @@ void glColor4ub(GLubyte red, GLubyte green, GLubyte blue, GLubyte alpha) {
 }
 
 void glColor4ubv(const GLubyte *c) {
+	// Pending glArrayElement run must be copied with the previous color
+	if (run_count)
+		materialize_imm_run();
+
 	// Setting current color value
 	current_color.r = (1.0f * c[0]) / 255.0f;
 	current_color.g = (1.0f * c[1]) / 255.0f;
@@ -211,18 +396,14 @@ void glTexCoord2fv(GLfloat *f) {
 	}
 #endif
 
-	// Adding a new element to texcoord list
-	if (model_uv == NULL) {
-		model_uv = last_uv = (uvList *)malloc(sizeof(uvList));
-	} else {
-		last_uv->next = (uvList *)malloc(sizeof(uvList));
-		last_uv = last_uv->next;
-	}
+	// Pending glArrayElement run must be copied with the previous texcoord
+	if (run_count)
+		materialize_imm_run();
 
-	// Properly populating the new element
-	last_uv->v.x = f[0];
-	last_uv->v.y = f[1];
-	last_uv->next = NULL;
+	// Setting current texcoord value
+	current_uv.x = f[0];
+	current_uv.y = f[1];
+	imm_has_uv = GL_TRUE;
 }
 
 void glTexCoord2f(GLfloat s, GLfloat t) {
@@ -233,18 +414,14 @@ void glTexCoord2f(GLfloat s, GLfloat t) {
 	}
 #endif
 
-	// Adding a new element to texcoord list
-	if (model_uv == NULL) {
-		model_uv = last_uv = (uvList *)malloc(sizeof(uvList));
-	} else {
-		last_uv->next = (uvList *)malloc(sizeof(uvList));
-		last_uv = last_uv->next;
-	}
+	// Pending glArrayElement run must be copied with the previous texcoord
+	if (run_count)
+		materialize_imm_run();
 
-	// Properly populating the new element
-	last_uv->v.x = s;
-	last_uv->v.y = t;
-	last_uv->next = NULL;
+	// Setting current texcoord value
+	current_uv.x = s;
+	current_uv.y = t;
+	imm_has_uv = GL_TRUE;
 }
 
 void glTexCoord2i(GLint s, GLint t) {
@@ -255,33 +432,26 @@ void glTexCoord2i(GLint s, GLint t) {
 	}
 #endif
 
-	// Adding a new element to texcoord list
-	if (model_uv == NULL) {
-		model_uv = last_uv = (uvList *)malloc(sizeof(uvList));
-	} else {
-		last_uv->next = (uvList *)malloc(sizeof(uvList));
-		last_uv = last_uv->next;
-	}
+	// Pending glArrayElement run must be copied with the previous texcoord
+	if (run_count)
+		materialize_imm_run();
 
-	// Properly populating the new element
-	last_uv->v.x = s;
-	last_uv->v.y = t;
-	last_uv->next = NULL;
+	// Setting current texcoord value
+	current_uv.x = s;
+	current_uv.y = t;
+	imm_has_uv = GL_TRUE;
 }
 
-void glArrayElement(GLint i) {
-#ifndef SKIP_ERROR_HANDLING
-	// Error handling
-	if (i < 0) {
-		SET_GL_ERROR(GL_INVALID_VALUE)
-	}
-#endif
-
+static void add_imm_array_element(GLint i) {
 	// Aliasing client texture unit for better code readability
 	texture_unit *tex_unit = &texture_units[client_texture_unit];
 
 	// Checking if current texture unit has GL_VERTEX_ARRAY enabled
 	if (tex_unit->vertex_array_state) {
+		if (!reserve_imm_vertex()) {
+			SET_GL_ERROR(GL_OUT_OF_MEMORY)
+		}
+
 		// Calculating offset of requested element
 		uint8_t *ptr;
 		if (tex_unit->vertex_array.stride == 0)
@@ -289,21 +459,8 @@ void glArrayElement(GLint i) {
 		else
 			ptr = ((uint8_t *)tex_unit->vertex_array.pointer) + (i * tex_unit->vertex_array.stride);
 
-		// Adding a new element to vertex and color lists
-		if (model_vertices == NULL) {
-			model_vertices = last_vert = (vertexList *)malloc(sizeof(vertexList));
-			model_color = last_clr = (rgbaList *)malloc(sizeof(rgbaList));
-		} else {
-			last_vert->next = (vertexList *)malloc(sizeof(vertexList));
-			last_clr->next = (rgbaList *)malloc(sizeof(rgbaList));
-			last_vert = last_vert->next;
-			last_clr = last_clr->next;
-		}
-		last_vert->next = NULL;
-		last_clr->next = NULL;
-
 		// Populating new vertex element
-		memcpy_neon(&last_vert->v, ptr, tex_unit->vertex_array.size * tex_unit->vertex_array.num);
+		memcpy_neon(&imm_vertices[vertex_count], ptr, tex_unit->vertex_array.size * tex_unit->vertex_array.num);
 
 		// Checking if current texture unit has GL_COLOR_ARRAY enabled
 		if (tex_unit->color_array_state) {
@@ -315,12 +472,11 @@ void glArrayElement(GLint i) {
 				ptr_clr = ((uint8_t *)tex_unit->color_array.pointer) + (i * tex_unit->color_array.stride);
 
 			// Populating new color element
-			last_clr->v.a = 1.0f;
-			memcpy_neon(&last_clr->v, ptr_clr, tex_unit->color_array.size * tex_unit->color_array.num);
-
+			imm_colors[vertex_count].a = 1.0f;
+			memcpy_neon(&imm_colors[vertex_count], ptr_clr, tex_unit->color_array.size * tex_unit->color_array.num);
 		} else {
 			// Populating new color element with current color
-			memcpy_neon(&last_clr->v, &current_color.r, sizeof(vector4f));
+			imm_colors[vertex_count] = current_color;
 		}
 
 		// Checking if current texture unit has GL_TEXTURE_COORD_ARRAY enabled
@@ -332,19 +488,49 @@ void glArrayElement(GLint i) {
 			else
 				ptr_tex = ((uint8_t *)tex_unit->texture_array.pointer) + (i * tex_unit->texture_array.stride);
 
-			// Adding a new element to texcoord list
-			if (model_uv == NULL) {
-				model_uv = last_uv = (uvList *)malloc(sizeof(uvList));
-			} else {
-				last_uv->next = (uvList *)malloc(sizeof(uvList));
-				last_uv = last_uv->next;
-			}
-
 			// Populating new texcoord element
-			memcpy_neon(&last_uv->v, ptr_tex, tex_unit->vertex_array.size * 2);
-			last_uv->next = NULL;
+			memcpy_neon(&imm_uvs[vertex_count], ptr_tex, tex_unit->texture_array.size * 2);
+			imm_has_uv = GL_TRUE;
+		} else
+			imm_uvs[vertex_count] = current_uv;
+
+		vertex_count++;
+	}
+}
+
+static void materialize_imm_run(void) {
+	// Copying elements of current sequential run into immediate mode arena
+	uint32_t n = run_count;
+	run_count = 0;
+	uint32_t j;
+	for (j = 0; j < n; j++) {
+		add_imm_array_element(run_start + j);
+	}
+}
+
+void glArrayElement(GLint i) {
+#ifndef SKIP_ERROR_HANDLING
+	// Error handling
+	if (i < 0) {
+		SET_GL_ERROR(GL_INVALID_VALUE)
+	}
+#endif
+
+	// Sequential elements are not copied and get drawn straight from client arrays at glEnd
+	if (phase == MODEL_CREATION) {
+		if (run_count) {
+			if (i == run_start + run_count) {
+				run_count++;
+				return;
+			}
+			materialize_imm_run();
+		} else if (vertex_count == imm_base) {
+			run_start = i;
+			run_count = 1;
+			return;
 		}
 	}
+	add_imm_array_element(i);
 }
 
 void glBegin(GLenum mode) {
@@ -357,6 +543,7 @@ void glBegin(GLenum mode) {
 
 	// Changing current openGL machine state
 	phase = MODEL_CREATION;
+	run_count = 0;
 
 	// Translating primitive to sceGxm one
 	prim_extra = SCE_GXM_PRIMITIVE_NONE;
@@ -391,14 +578,34 @@ void glBegin(GLenum mode) {
 		break;
 	}
 
-	// Resetting vertex count
-	vertex_count = 0;
+	// Resetting current primitive in immediate mode arena
+	vertex_count = imm_base;
+	imm_has_uv = GL_FALSE;
 }
 
 void glEnd(void) {
+	// Primitives built with a sequential run of glArrayElement calls are drawn straight from the bound arrays
+	if (run_count) {
+		if (cur_display_list || (phase != MODEL_CREATION) || !texture_units[client_texture_unit].vertex_array_state)
+			materialize_imm_run();
+		else {
+			uint32_t n = run_count;
+			run_count = 0;
+			phase = NONE;
+#ifndef SKIP_ERROR_HANDLING
+			// Integrity checks
+			if (n % np)
+				return;
+#endif
+			flush_imm_batch();
+			draw_imm_run(run_start, n);
+			return;
+		}
+	}
+
 #ifndef SKIP_ERROR_HANDLING
 	// Integrity checks
-	if (vertex_count == 0 || ((vertex_count % np) != 0))
+	if (vertex_count == imm_base || (((vertex_count - imm_base) % np) != 0))
 		return;
 
 	// Error handling
@@ -410,155 +617,92 @@ void glEnd(void) {
 
 	// Changing current openGL machine state
 	phase = NONE;
-	int i, j;
+	uint32_t idx_count = get_imm_indices_count(vertex_count - imm_base);
+	vector3f *vertices;
+	vector2f *uv_map = NULL;
+	vector4f *colors = NULL;
+	uint16_t *indices;
+
+	// Compiling vertices into the display list in use if required
+	if (cur_display_list) {
+		uint32_t n = vertex_count - imm_base;
+		if (!reserve_display_list_draw(prim, n, idx_count, imm_has_uv, &vertices, &uv_map, &colors, &indices)) {
+			vertex_count = imm_base;
+			SET_GL_ERROR(GL_OUT_OF_MEMORY)
+		}
+		memcpy_neon(vertices, &imm_vertices[imm_base], n * sizeof(vector3f));
+		if (uv_map)
+			memcpy_neon(uv_map, &imm_uvs[imm_base], n * sizeof(vector2f));
+		memcpy_neon(colors, &imm_colors[imm_base], n * sizeof(vector4f));
+		setup_imm_indices(indices, 0, n);
+		vertex_count = imm_base;
+		if (display_list_mode == GL_COMPILE_AND_EXECUTE) {
+			flush_imm_batch();
+			draw_imm_vertices(prim, vertices, uv_map, colors, indices, idx_count);
+		}
+		return;
+	}
 
 	// Checking if we can totally skip drawing cause of culling mode
 	if (no_polygons_mode && ((prim == SCE_GXM_PRIMITIVE_TRIANGLES) || (prim >= SCE_GXM_PRIMITIVE_TRIANGLE_STRIP))) {
-		purge_vertex_list();
-		vertex_count = 0;
+		vertex_count = imm_base;
 		return;
 	}
 
-	// Aliasing server texture unit and texture id for better code readability
-	texture_unit *tex_unit = &texture_units[server_texture_unit];
-	int texture2d_idx = tex_unit->tex_id;
-
 	// Calculating mvp matrix
 	if (mvp_modified) {
 		matrix4x4_multiply(mvp_matrix, projection_matrix, modelview_matrix);
 		mvp_modified = GL_FALSE;
 	}
-
-	// Checking if we have to write a texture
-	if ((server_texture_unit >= 0) && (tex_unit->enabled) && (model_uv != NULL) && (texture_slots[texture2d_idx].valid)) {
-		// Setting proper vertex and fragment programs
-		sceGxmSetVertexProgram(gxm_context, texture2d_vertex_program_patched);
-		update_precompiled_ffp_frag_shader(texture2d_fragment_id, &texture2d_fragment_program_patched, &texture2d_blend_cfg);
-
-		// Setting uniforms
-		upload_tex2d_uniforms(texture2d_generic_unifs);
-		
-		// Setting in use texture
-		sceGxmSetFragmentTexture(gxm_context, 0, &texture_slots[texture2d_idx].gxm_tex);
-		
-		// Properly generating vertices, uv map and indices buffers
-		vector3f *vertices;
-		vector2f *uv_map;
-		uint16_t *indices;
-		int n = 0, quad_n = 0;
-		vertexList *object = model_vertices;
-		uvList *object_uv = model_uv;
-		uint64_t idx_count = vertex_count;
-		switch (prim_extra) {
-		case SCE_GXM_PRIMITIVE_NONE:
-			vertices = (vector3f *)gpu_pool_memalign(vertex_count * sizeof(vector3f), sizeof(vector3f));
-			uv_map = (vector2f *)gpu_pool_memalign(vertex_count * sizeof(vector2f), sizeof(vector2f));
-			memset(vertices, 0, (vertex_count * sizeof(vector3f)));
-			indices = (uint16_t *)gpu_pool_memalign(idx_count * sizeof(uint16_t), sizeof(uint16_t));
-			for (i = 0; i < vertex_count; i++) {
-				memcpy_neon(&vertices[n], &object->v, sizeof(vector3f));
-				memcpy_neon(&uv_map[n], &object_uv->v, sizeof(vector2f));
-				indices[n] = n;
-				object = object->next;
-				object_uv = object_uv->next;
-				n++;
+	GLboolean textured = is_imm_textured();
+
+	// Appending primitives with no strip or fan topology to pending batch if batching is enabled
+	if (imm_batching && ((prim == SCE_GXM_PRIMITIVE_TRIANGLES) || (prim == SCE_GXM_PRIMITIVE_LINES) || (prim == SCE_GXM_PRIMITIVE_POINTS))) {
+		if (imm_base && ((prim != batch_prim) || (textured != batch_textured) || (vertex_count > 0x10000) || memcmp(mvp_matrix, batch_mvp, sizeof(matrix4x4)) || memcmp(modelview_matrix, batch_modelview, sizeof(matrix4x4))))
+			flush_imm_batch();
+		if (batch_idx_count + idx_count > imm_indices_size) {
+			uint32_t new_size = max(imm_indices_size * 2, batch_idx_count + idx_count);
+			uint16_t *idxs = (uint16_t *)realloc(imm_indices, new_size * sizeof(uint16_t));
+			if (!idxs) {
+				vertex_count = imm_base;
+				SET_GL_ERROR(GL_OUT_OF_MEMORY)
 			}
-			break;
-		case SCE_GXM_PRIMITIVE_QUADS:
-			quad_n = vertex_count >> 2;
-			idx_count = quad_n * 6;
-			vertices = (vector3f *)gpu_pool_memalign(vertex_count * sizeof(vector3f), sizeof(vector3f));
-			uv_map = (vector2f *)gpu_pool_memalign(vertex_count * sizeof(vector2f), sizeof(vector2f));
-			memset(vertices, 0, (vertex_count * sizeof(vector3f)));
-			indices = (uint16_t *)gpu_pool_memalign(idx_count * sizeof(uint16_t), sizeof(uint16_t));
-			for (i = 0; i < quad_n; i++) {
-				indices[i * 6] = i * 4;
-				indices[i * 6 + 1] = i * 4 + 1;
-				indices[i * 6 + 2] = i * 4 + 3;
-				indices[i * 6 + 3] = i * 4 + 1;
-				indices[i * 6 + 4] = i * 4 + 2;
-				indices[i * 6 + 5] = i * 4 + 3;
-			}
-			for (j = 0; j < vertex_count; j++) {
-				memcpy_neon(&vertices[j], &object->v, sizeof(vector3f));
-				memcpy_neon(&uv_map[j], &object_uv->v, sizeof(vector2f));
-				object = object->next;
-				object_uv = object_uv->next;
-			}
-			break;
+			imm_indices = idxs;
+			imm_indices_size = new_size;
 		}
-
-		// Performing the requested draw call
-		sceGxmSetVertexStream(gxm_context, 0, vertices);
-		sceGxmSetVertexStream(gxm_context, 1, uv_map);
-		sceGxmDraw(gxm_context, prim, SCE_GXM_INDEX_FORMAT_U16, indices, idx_count);
+		setup_imm_indices(&imm_indices[batch_idx_count], imm_base, vertex_count - imm_base);
+		batch_idx_count += idx_count;
+		batch_prim = prim;
+		batch_textured = textured;
+		matrix4x4_copy(batch_mvp, mvp_matrix);
+		matrix4x4_copy(batch_modelview, modelview_matrix);
+		imm_base = vertex_count;
+		return;
+	}
+	flush_imm_batch();
+
+	// Uploading vertices and generating indices
+	vertices = (vector3f *)gpu_pool_memalign(vertex_count * sizeof(vector3f), sizeof(vector3f));
+	memcpy_neon(vertices, imm_vertices, vertex_count * sizeof(vector3f));
+	indices = (uint16_t *)gpu_pool_memalign(idx_count * sizeof(uint16_t), sizeof(uint16_t));
+	setup_imm_indices(indices, 0, vertex_count);
+
+	// Uploading only the attributes required by the shader in use
+	if (textured) {
+		uv_map = (vector2f *)gpu_pool_memalign(vertex_count * sizeof(vector2f), sizeof(vector2f));
+		memcpy_neon(uv_map, imm_uvs, vertex_count * sizeof(vector2f));
 	} else {
-		// Setting proper vertex and fragment programs
-		sceGxmSetVertexProgram(gxm_context, rgba_vertex_program_patched);
-		sceGxmSetFragmentProgram(gxm_context, rgba_fragment_program_patched);
-		
-		// Reserving default vertex uniform buffer for wvp
-		void *vbuffer;
-		sceGxmReserveVertexDefaultUniformBuffer(gxm_context, &vbuffer);
-		
-		// Uploading wvp matrix
-		sceGxmSetUniformDataF(vbuffer, rgba_wvp, 0, 16, (const float *)mvp_matrix);
-		
-		// Properly generating vertices, colors and indices buffers
-		vector3f *vertices;
-		vector4f *colors;
-		uint16_t *indices;
-		int n = 0, quad_n = 0;
-		vertexList *object = model_vertices;
-		rgbaList *object_clr = model_color;
-		uint64_t idx_count = vertex_count;
-		switch (prim_extra) {
-		case SCE_GXM_PRIMITIVE_NONE:
-			vertices = (vector3f *)gpu_pool_memalign(vertex_count * sizeof(vector3f), sizeof(vector3f));
-			colors = (vector4f *)gpu_pool_memalign(vertex_count * sizeof(vector4f), sizeof(vector4f));
-			memset(vertices, 0, (vertex_count * sizeof(vector3f)));
-			indices = (uint16_t *)gpu_pool_memalign(idx_count * sizeof(uint16_t), sizeof(uint16_t));
-			for (i = 0; i < vertex_count; i++) {
-				memcpy_neon(&vertices[n], &object->v, sizeof(vector3f));
-				memcpy_neon(&colors[n], &object_clr->v, sizeof(vector4f));
-				indices[n] = n;
-				object = object->next;
-				object_clr = object_clr->next;
-				n++;
-			}
-			break;
-		case SCE_GXM_PRIMITIVE_QUADS:
-			quad_n = vertex_count >> 2;
-			idx_count = quad_n * 6;
-			vertices = (vector3f *)gpu_pool_memalign(vertex_count * sizeof(vector3f), sizeof(vector3f));
-			colors = (vector4f *)gpu_pool_memalign(vertex_count * sizeof(vector4f), sizeof(vector4f));
-			memset(vertices, 0, (vertex_count * sizeof(vector3f)));
-			indices = (uint16_t *)gpu_pool_memalign(idx_count * sizeof(uint16_t), sizeof(uint16_t));
-			int i, j;
-			for (i = 0; i < quad_n; i++) {
-				indices[i * 6] = i * 4;
-				indices[i * 6 + 1] = i * 4 + 1;
-				indices[i * 6 + 2] = i * 4 + 3;
-				indices[i * 6 + 3] = i * 4 + 1;
-				indices[i * 6 + 4] = i * 4 + 2;
-				indices[i * 6 + 5] = i * 4 + 3;
-			}
-			for (j = 0; j < vertex_count; j++) {
-				memcpy_neon(&vertices[j], &object->v, sizeof(vector3f));
-				memcpy_neon(&colors[j], &object_clr->v, sizeof(vector4f));
-				object = object->next;
-				object_clr = object_clr->next;
-			}
-			break;
-		}
-
-		// Performing the requested draw call
-		sceGxmSetVertexStream(gxm_context, 0, vertices);
-		sceGxmSetVertexStream(gxm_context, 1, colors);
-		sceGxmDraw(gxm_context, prim, SCE_GXM_INDEX_FORMAT_U16, indices, idx_count);
+		colors = (vector4f *)gpu_pool_memalign(vertex_count * sizeof(vector4f), sizeof(vector4f));
+		memcpy_neon(colors, imm_colors, vertex_count * sizeof(vector4f));
 	}
+	draw_imm_vertices(prim, vertices, uv_map, colors, indices, idx_count);
 
-	// Purging vertex, colors and texcoord lists
-	purge_vertex_list();
+	// Resetting immediate mode arena
 	vertex_count = 0;
 }
+
+void vglEnableImmediateBatching(GLboolean usage) {
+	if (!usage)
+		flush_imm_batch();
+	imm_batching = usage;
+}
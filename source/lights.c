@@ -0,0 +1,176 @@
+/*
+ * This file is part of vitaGL
+ * Copyright 2017, 2018, 2019, 2020 Rinnegatamante
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * lights.c:
+ * Implementation for lighting related functions
+ */
+
+#include "shared.h"
+
+/*
+ * ------------------------------
+ * - IMPLEMENTATION STARTS HERE -
+ * ------------------------------
+ */
+
+void glLightfv(GLenum light, GLenum pname, const GLfloat *params) {
+#ifndef SKIP_ERROR_HANDLING
+	if ((light < GL_LIGHT0) || (light >= GL_LIGHT0 + MAX_LIGHTS_NUM)) {
+		SET_GL_ERROR(GL_INVALID_ENUM)
+	}
+#endif
+	flush_imm_batch();
+	light_source *l = &lights[light - GL_LIGHT0];
+	switch (pname) {
+	case GL_AMBIENT:
+		memcpy_neon(&l->ambient.r, params, sizeof(vector4f));
+		break;
+	case GL_DIFFUSE:
+		memcpy_neon(&l->diffuse.r, params, sizeof(vector4f));
+		break;
+	case GL_SPECULAR:
+		memcpy_neon(&l->specular.r, params, sizeof(vector4f));
+		break;
+	case GL_POSITION:
+		// Light positions are stored in eye space as per openGL specs
+		vector4f_matrix4x4_mult(&l->position, modelview_matrix, (const vector4f *)params);
+		break;
+	case GL_CONSTANT_ATTENUATION:
+		l->attenuation.x = params[0];
+		break;
+	case GL_LINEAR_ATTENUATION:
+		l->attenuation.y = params[0];
+		break;
+	case GL_QUADRATIC_ATTENUATION:
+		l->attenuation.z = params[0];
+		break;
+	default:
+		SET_GL_ERROR(GL_INVALID_ENUM)
+		break;
+	}
+}
+
+void glLightf(GLenum light, GLenum pname, GLfloat param) {
+#ifndef SKIP_ERROR_HANDLING
+	if ((pname != GL_CONSTANT_ATTENUATION) && (pname != GL_LINEAR_ATTENUATION) && (pname != GL_QUADRATIC_ATTENUATION)) {
+		SET_GL_ERROR(GL_INVALID_ENUM)
+	} else if (param < 0.0f) {
+		SET_GL_ERROR(GL_INVALID_VALUE)
+	}
+#endif
+	glLightfv(light, pname, &param);
+}
+
+void glLightModelfv(GLenum pname, const GLfloat *params) {
+	flush_imm_batch();
+	switch (pname) {
+	case GL_LIGHT_MODEL_AMBIENT:
+		memcpy_neon(&light_model_ambient.r, params, sizeof(vector4f));
+		break;
+	default:
+		SET_GL_ERROR(GL_INVALID_ENUM)
+		break;
+	}
+}
+
+void glMaterialfv(GLenum face, GLenum pname, const GLfloat *params) {
+#ifndef SKIP_ERROR_HANDLING
+	if ((face != GL_FRONT) && (face != GL_BACK) && (face != GL_FRONT_AND_BACK)) {
+		SET_GL_ERROR(GL_INVALID_ENUM)
+	}
+#endif
+	// Two sided lighting is not supported, so back material is never used
+	if (face == GL_BACK)
+		return;
+	flush_imm_batch();
+	switch (pname) {
+	case GL_AMBIENT:
+		memcpy_neon(&material_colors[0].r, params, sizeof(vector4f));
+		break;
+	case GL_DIFFUSE:
+		memcpy_neon(&material_colors[1].r, params, sizeof(vector4f));
+		break;
+	case GL_AMBIENT_AND_DIFFUSE:
+		memcpy_neon(&material_colors[0].r, params, sizeof(vector4f));
+		memcpy_neon(&material_colors[1].r, params, sizeof(vector4f));
+		break;
+	case GL_SPECULAR:
+		memcpy_neon(&material_colors[2].r, params, sizeof(vector4f));
+		break;
+	case GL_EMISSION:
+		memcpy_neon(&material_colors[3].r, params, sizeof(vector4f));
+		break;
+	case GL_SHININESS:
+#ifndef SKIP_ERROR_HANDLING
+		if ((params[0] < 0.0f) || (params[0] > 128.0f)) {
+			SET_GL_ERROR(GL_INVALID_VALUE)
+		}
+#endif
+		material_shininess = params[0];
+		break;
+	default:
+		SET_GL_ERROR(GL_INVALID_ENUM)
+		break;
+	}
+}
+
+void glMaterialf(GLenum face, GLenum pname, GLfloat param) {
+#ifndef SKIP_ERROR_HANDLING
+	if (pname != GL_SHININESS) {
+		SET_GL_ERROR(GL_INVALID_ENUM)
+	}
+#endif
+	glMaterialfv(face, pname, &param);
+}
+
+void glColorMaterial(GLenum face, GLenum mode) {
+#ifndef SKIP_ERROR_HANDLING
+	if ((face != GL_FRONT) && (face != GL_BACK) && (face != GL_FRONT_AND_BACK)) {
+		SET_GL_ERROR(GL_INVALID_ENUM)
+	}
+#endif
+	flush_imm_batch();
+	switch (mode) {
+	case GL_AMBIENT:
+	case GL_DIFFUSE:
+	case GL_AMBIENT_AND_DIFFUSE:
+	case GL_SPECULAR:
+	case GL_EMISSION:
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+		ffp_dirty_vert = GL_TRUE;
+#endif
+		color_material_mode = mode;
+		break;
+	default:
+		SET_GL_ERROR(GL_INVALID_ENUM)
+		break;
+	}
+}
+
+void glNormal3f(GLfloat nx, GLfloat ny, GLfloat nz) {
+	// Setting current normal value
+	current_normal.x = nx;
+	current_normal.y = ny;
+	current_normal.z = nz;
+}
+
+void glNormal3fv(const GLfloat *v) {
+	// Setting current normal value
+	memcpy_neon(&current_normal.x, v, sizeof(vector3f));
+}
@@ -37,6 +37,12 @@ GLboolean mvp_modified = GL_TRUE; // Check if ModelViewProjection matrix needs t
  */
 
 void glMatrixMode(GLenum mode) {
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		if (record_display_list_cmd(DLIST_CMD_MATRIX_MODE, &mode, sizeof(GLenum)))
+			return;
+	}
+
 	// Changing current in use matrix
 	switch (mode) {
 	case GL_MODELVIEW: // Modelview matrix
@@ -61,6 +67,13 @@ void glOrtho(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdou
 	}
 #endif
 
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		GLfloat args[6] = { left, right, bottom, top, nearVal, farVal };
+		if (record_display_list_cmd(DLIST_CMD_ORTHO, args, sizeof(args)))
+			return;
+	}
+
 	// Initializing ortho matrix with requested parameters
 	matrix4x4_init_orthographic(*matrix, left, right, bottom, top, nearVal, farVal);
 	mvp_modified = GL_TRUE;
@@ -76,18 +89,37 @@ void glFrustum(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLd
 	}
 #endif
 
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		GLfloat args[6] = { left, right, bottom, top, nearVal, farVal };
+		if (record_display_list_cmd(DLIST_CMD_FRUSTUM, args, sizeof(args)))
+			return;
+	}
+
 	// Initializing frustum matrix with requested parameters
 	matrix4x4_init_frustum(*matrix, left, right, bottom, top, nearVal, farVal);
 	mvp_modified = GL_TRUE;
 }
 
 void glLoadIdentity(void) {
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		if (record_display_list_cmd(DLIST_CMD_LOAD_IDENTITY, NULL, 0))
+			return;
+	}
+
 	// Set current in use matrix to identity one
 	matrix4x4_identity(*matrix);
 	mvp_modified = GL_TRUE;
 }
 
 void glMultMatrixf(const GLfloat *m) {
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		if (record_display_list_cmd(DLIST_CMD_MULT_MATRIX, m, sizeof(matrix4x4)))
+			return;
+	}
+
 	matrix4x4 res;
 
 	// Properly ordering matrix to perform multiplication
@@ -108,6 +140,12 @@ void glMultMatrixf(const GLfloat *m) {
 }
 
 void glLoadMatrixf(const GLfloat *m) {
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		if (record_display_list_cmd(DLIST_CMD_LOAD_MATRIX, m, sizeof(matrix4x4)))
+			return;
+	}
+
 	// Properly ordering matrix
 	int i, j;
 	for (i = 0; i < 4; i++) {
@@ -120,12 +158,26 @@ void glLoadMatrixf(const GLfloat *m) {
 }
 
 void glTranslatef(GLfloat x, GLfloat y, GLfloat z) {
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		GLfloat args[3] = { x, y, z };
+		if (record_display_list_cmd(DLIST_CMD_TRANSLATE, args, sizeof(args)))
+			return;
+	}
+
 	// Translating in use matrix
 	matrix4x4_translate(*matrix, x, y, z);
 	mvp_modified = GL_TRUE;
 }
 
 void glScalef(GLfloat x, GLfloat y, GLfloat z) {
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		GLfloat args[3] = { x, y, z };
+		if (record_display_list_cmd(DLIST_CMD_SCALE, args, sizeof(args)))
+			return;
+	}
+
 	// Scaling in use matrix
 	matrix4x4_scale(*matrix, x, y, z);
 	mvp_modified = GL_TRUE;
@@ -139,6 +191,13 @@ void glRotatef(GLfloat angle, GLfloat x, GLfloat y, GLfloat z) {
 	}
 #endif
 
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		GLfloat args[4] = { angle, x, y, z };
+		if (record_display_list_cmd(DLIST_CMD_ROTATE, args, sizeof(args)))
+			return;
+	}
+
 	// Performing rotation on in use matrix depending on user call
 	float rad = DEG_TO_RAD(angle);
 	if (x == 1.0f) {
@@ -161,6 +220,12 @@ void glPushMatrix(void) {
 	}
 #endif
 
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		if (record_display_list_cmd(DLIST_CMD_PUSH_MATRIX, NULL, 0))
+			return;
+	}
+
 	if (matrix == &modelview_matrix) {
 #ifndef SKIP_ERROR_HANDLING
 		// Error handling
@@ -191,6 +256,12 @@ void glPopMatrix(void) {
 	}
 #endif
 
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		if (record_display_list_cmd(DLIST_CMD_POP_MATRIX, NULL, 0))
+			return;
+	}
+
 	if (matrix == &modelview_matrix) {
 #ifndef SKIP_ERROR_HANDLING
 		// Error handling
@@ -222,6 +293,13 @@ void gluPerspective(GLdouble fovy, GLdouble aspect, GLdouble zNear, GLdouble zFa
 	}
 #endif
 
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		GLfloat args[4] = { fovy, aspect, zNear, zFar };
+		if (record_display_list_cmd(DLIST_CMD_PERSPECTIVE, args, sizeof(args)))
+			return;
+	}
+
 	// Initializing perspective matrix with requested parameters
 	matrix4x4_init_perspective(*matrix, fovy, aspect, zNear, zFar);
 	mvp_modified = GL_TRUE;
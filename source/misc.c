@@ -23,6 +23,7 @@
 
 #include "shared.h"
 GLboolean fast_texture_compression = GL_FALSE; // Hints for texture compression
+GLboolean optimize_indices = GL_FALSE; // Hints for index buffers optimization
 
 static void update_fogging_state() {
 #if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
@@ -111,6 +112,7 @@ static void change_cull_mode() {
  */
 
 void glPolygonMode(GLenum face, GLenum mode) {
+	flush_imm_batch();
 	SceGxmPolygonMode new_mode;
 	switch (mode) {
 	case GL_POINT:
@@ -151,24 +153,34 @@ void glPolygonMode(GLenum face, GLenum mode) {
 }
 
 void glPolygonOffset(GLfloat factor, GLfloat units) {
+	flush_imm_batch();
 	pol_factor = factor;
 	pol_units = units;
 	update_polygon_offset();
 }
 
 void glCullFace(GLenum mode) {
+	flush_imm_batch();
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		if (record_display_list_cmd(DLIST_CMD_CULL_FACE, &mode, sizeof(GLenum)))
+			return;
+	}
+
 	gl_cull_mode = mode;
 	if (cull_face_state)
 		change_cull_mode();
 }
 
 void glFrontFace(GLenum mode) {
+	flush_imm_batch();
 	gl_front_face = mode;
 	if (cull_face_state)
 		change_cull_mode();
 }
 
 void glViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+	flush_imm_batch();
 #ifndef SKIP_ERROR_HANDLING
 	if ((width < 0) || (height < 0)) {
 		SET_GL_ERROR(GL_INVALID_VALUE)
@@ -186,23 +198,32 @@ void glViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
 }
 
 void glDepthRange(GLdouble nearVal, GLdouble farVal) {
+	flush_imm_batch();
 	z_port = (farVal + nearVal) / 2.0f;
 	z_scale = (farVal - nearVal) / 2.0f;
 	sceGxmSetViewport(gxm_context, x_port, x_scale, y_port, y_scale, z_port, z_scale);
 }
 
 void glDepthRangef(GLfloat nearVal, GLfloat farVal) {
+	flush_imm_batch();
 	z_port = (farVal + nearVal) / 2.0f;
 	z_scale = (farVal - nearVal) / 2.0f;
 	sceGxmSetViewport(gxm_context, x_port, x_scale, y_port, y_scale, z_port, z_scale);
 }
 
 void glEnable(GLenum cap) {
+	flush_imm_batch();
 #ifndef SKIP_ERROR_HANDLING
 	if (phase == MODEL_CREATION) {
 		SET_GL_ERROR(GL_INVALID_OPERATION)
 	}
 #endif
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		if (record_display_list_cmd(DLIST_CMD_ENABLE, &cap, sizeof(GLenum)))
+			return;
+	}
+
 	switch (cap) {
 	case GL_DEPTH_TEST:
 		depth_test_state = GL_TRUE;
@@ -254,6 +275,28 @@ void glEnable(GLenum cap) {
 #endif
 		clip_plane0 = GL_TRUE;
 		break;
+	case GL_LIGHTING:
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+		ffp_dirty_frag = GL_TRUE;
+		ffp_dirty_vert = GL_TRUE;
+#endif
+		lighting_state = GL_TRUE;
+		break;
+	case GL_LIGHT0:
+	case GL_LIGHT1:
+	case GL_LIGHT2:
+	case GL_LIGHT3:
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+		ffp_dirty_vert = GL_TRUE;
+#endif
+		lights_mask |= (1 << (cap - GL_LIGHT0));
+		break;
+	case GL_COLOR_MATERIAL:
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+		ffp_dirty_vert = GL_TRUE;
+#endif
+		color_material_state = GL_TRUE;
+		break;
 	default:
 		SET_GL_ERROR(GL_INVALID_ENUM)
 		break;
@@ -261,11 +304,18 @@ void glEnable(GLenum cap) {
 }
 
 void glDisable(GLenum cap) {
+	flush_imm_batch();
 #ifndef SKIP_ERROR_HANDLING
 	if (phase == MODEL_CREATION) {
 		SET_GL_ERROR(GL_INVALID_OPERATION)
 	}
 #endif
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		if (record_display_list_cmd(DLIST_CMD_DISABLE, &cap, sizeof(GLenum)))
+			return;
+	}
+
 	switch (cap) {
 	case GL_DEPTH_TEST:
 		depth_test_state = GL_FALSE;
@@ -317,6 +367,28 @@ void glDisable(GLenum cap) {
 #endif
 		clip_plane0 = GL_FALSE;
 		break;
+	case GL_LIGHTING:
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+		ffp_dirty_frag = GL_TRUE;
+		ffp_dirty_vert = GL_TRUE;
+#endif
+		lighting_state = GL_FALSE;
+		break;
+	case GL_LIGHT0:
+	case GL_LIGHT1:
+	case GL_LIGHT2:
+	case GL_LIGHT3:
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+		ffp_dirty_vert = GL_TRUE;
+#endif
+		lights_mask &= ~(1 << (cap - GL_LIGHT0));
+		break;
+	case GL_COLOR_MATERIAL:
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+		ffp_dirty_vert = GL_TRUE;
+#endif
+		color_material_state = GL_FALSE;
+		break;
 	default:
 		SET_GL_ERROR(GL_INVALID_ENUM)
 		break;
@@ -324,6 +396,7 @@ void glDisable(GLenum cap) {
 }
 
 void glClear(GLbitfield mask) {
+	flush_imm_batch();
 	GLenum orig_depth_test = depth_test_state;
 	if ((mask & GL_COLOR_BUFFER_BIT) == GL_COLOR_BUFFER_BIT) {
 		invalidate_depth_test();
@@ -396,6 +469,7 @@ void glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
 }
 
 void glLineWidth(GLfloat width) {
+	flush_imm_batch();
 #ifndef SKIP_ERROR_HANDLING
 	// Error handling
 	if (width <= 0) {
@@ -409,6 +483,7 @@ void glLineWidth(GLfloat width) {
 }
 
 void glPointSize(GLfloat size) {
+	flush_imm_batch();
 #ifndef SKIP_ERROR_HANDLING
 	// Error handling
 	if (size <= 0) {
@@ -422,6 +497,7 @@ void glPointSize(GLfloat size) {
 }
 
 void glFogf(GLenum pname, GLfloat param) {
+	flush_imm_batch();
 	switch (pname) {
 	case GL_FOG_MODE:
 		fog_mode = param;
@@ -443,6 +519,7 @@ void glFogf(GLenum pname, GLfloat param) {
 }
 
 void glFogfv(GLenum pname, const GLfloat *params) {
+	flush_imm_batch();
 	switch (pname) {
 	case GL_FOG_MODE:
 		fog_mode = params[0];
@@ -467,6 +544,7 @@ void glFogfv(GLenum pname, const GLfloat *params) {
 }
 
 void glFogi(GLenum pname, const GLint param) {
+	flush_imm_batch();
 	switch (pname) {
 	case GL_FOG_MODE:
 		fog_mode = param;
@@ -488,6 +566,7 @@ void glFogi(GLenum pname, const GLint param) {
 }
 
 void glClipPlane(GLenum plane, const GLdouble *equation) {
+	flush_imm_batch();
 	switch (plane) {
 	case GL_CLIP_PLANE0:
 		clip_plane0_eq.x = equation[0];
@@ -519,6 +598,9 @@ void glHint(GLenum target, GLenum mode) {
 			break;
 		}
 		break;
+	case GL_INDICES_OPTIMIZATION_HINT_VGL:
+		optimize_indices = mode == GL_NICEST ? GL_TRUE : GL_FALSE;
+		break;
 	default:
 		SET_GL_ERROR(GL_INVALID_ENUM)
 		break;
@@ -0,0 +1,371 @@
+/*
+ * This file is part of vitaGL
+ * Copyright 2017, 2018, 2019, 2020 Rinnegatamante
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * shader_cache.c:
+ * Implementation for runtime compiled shaders on-disk cache and asynchronous compilation
+ */
+
+#include "shared.h"
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define SHADER_CACHE_MAGIC 0x43534756 // 'VGSC'
+#define SHADER_CACHE_VERSION 1 // Cached binaries version, bump it whenever the file layout or the compiler output changes
+#define SHADER_CACHE_DEFAULT_SIZE (8 * 1024 * 1024) // Default max size in bytes for the on-disk shaders cache
+#define SHADER_CACHE_EXT ".gxp" // Extension for cached binaries
+#define SHADER_WORKER_STACK_SIZE (256 * 1024) // Stack size for the shaders compiler worker thread
+#define SHADER_WORKER_PRIORITY 0x10000100 // Priority for the shaders compiler worker thread
+
+#ifdef HAVE_SHARK
+extern int32_t compiler_fastmath;
+extern int32_t compiler_fastprecision;
+extern int32_t compiler_fastint;
+extern shark_opt compiler_opts;
+
+// Cached binary header struct
+typedef struct disk_cache_header {
+	uint32_t magic; // Must be SHADER_CACHE_MAGIC
+	uint32_t version; // Must be SHADER_CACHE_VERSION
+	uint64_t key; // Hash of source and compiler settings
+	uint32_t src_size; // Size in bytes of the shader source
+	uint32_t size; // Size in bytes of the compiled program
+} disk_cache_header;
+
+// Asynchronous compilation job struct
+struct shader_job {
+	char *src; // Shader source (owned by the job)
+	uint32_t size; // Size in bytes of the source, then of the compiled program
+	shark_type type; // Shader type
+	SceGxmProgram *prog; // Compiled program (NULL on failure)
+	char *log; // Compiler log (NULL if not available)
+	volatile GLboolean done; // Flag set by the worker once the job is completed
+	struct shader_job *next; // Next job in the queue
+};
+
+static SceUID shader_worker_thid = -1; // Shaders compiler worker thread
+static SceUID shader_jobs_sema; // Semaphore signaled for every queued job and on worker termination
+static SceKernelLwMutexWork shader_jobs_mutex; // Mutex guarding the jobs queue
+static shader_job *shader_jobs_head = NULL; // First queued job
+static shader_job *shader_jobs_tail = NULL; // Last queued job
+static volatile GLboolean shader_worker_quit = GL_FALSE; // Flag to request worker termination
+
+static char *disk_cache_dir = NULL; // Directory for the on-disk shaders cache (NULL if disabled)
+static uint32_t disk_cache_budget = SHADER_CACHE_DEFAULT_SIZE; // Max size in bytes for the on-disk shaders cache
+static int64_t disk_cache_used = -1; // Current size in bytes of the on-disk shaders cache (-1 if not calculated yet)
+
+static uint64_t fnv1a64(uint64_t h, const void *data, uint32_t len) {
+	const uint8_t *p = (const uint8_t *)data;
+	uint32_t i;
+	for (i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 0x100000001B3ULL;
+	}
+	return h;
+}
+
+static uint64_t disk_cache_key(const char *src, uint32_t len, shark_type type) {
+	// Compiler settings are part of the key since they affect the resulting binary
+	int32_t settings[5] = { type, compiler_opts, compiler_fastmath, compiler_fastprecision, compiler_fastint };
+	uint64_t h = fnv1a64(0xCBF29CE484222325ULL, src, len);
+	return fnv1a64(h, settings, sizeof(settings));
+}
+
+static GLboolean disk_cache_path(char *path, size_t size, uint64_t key) {
+	// Paths not fitting the buffer are rejected instead of being truncated
+	int len = snprintf(path, size, "%s/%08X%08X%s", disk_cache_dir, (uint32_t)(key >> 32), (uint32_t)key, SHADER_CACHE_EXT);
+	return len > 0 && len < size;
+}
+
+static GLboolean is_cached_binary(const char *name) {
+	size_t len = strlen(name);
+	return len > strlen(SHADER_CACHE_EXT) && !strcmp(&name[len - strlen(SHADER_CACHE_EXT)], SHADER_CACHE_EXT);
+}
+
+static void disk_cache_scan(char *oldest, time_t *oldest_time) {
+	// Calculating current cache size and looking for the oldest cached binary
+	char path[512];
+	struct stat st;
+	disk_cache_used = 0;
+	if (oldest)
+		oldest[0] = 0;
+	DIR *d = opendir(disk_cache_dir);
+	if (!d)
+		return;
+	struct dirent *entry;
+	while ((entry = readdir(d))) {
+		if (!is_cached_binary(entry->d_name))
+			continue;
+		int len = snprintf(path, sizeof(path), "%s/%s", disk_cache_dir, entry->d_name);
+		if (len <= 0 || len >= sizeof(path) || stat(path, &st) < 0)
+			continue;
+		disk_cache_used += st.st_size;
+		if (oldest && (!oldest[0] || st.st_mtime < *oldest_time)) {
+			strcpy(oldest, path);
+			*oldest_time = st.st_mtime;
+		}
+	}
+	closedir(d);
+}
+
+static GLboolean disk_cache_make_room(uint32_t size) {
+	if (size > disk_cache_budget)
+		return GL_FALSE;
+	if (disk_cache_used < 0)
+		disk_cache_scan(NULL, NULL);
+
+	// Evicting oldest cached binaries until the new one fits
+	char oldest[512];
+	time_t oldest_time;
+	while (disk_cache_used + size > disk_cache_budget) {
+		disk_cache_scan(oldest, &oldest_time);
+		if (!oldest[0] || (disk_cache_used + size <= disk_cache_budget))
+			break;
+		remove(oldest);
+	}
+	return disk_cache_used + size <= disk_cache_budget;
+}
+
+static SceGxmProgram *disk_cache_load(uint64_t key, uint32_t src_size, uint32_t *size) {
+	char path[512];
+	if (!disk_cache_path(path, sizeof(path), key))
+		return NULL;
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+
+	// Validating cached binary before using it, stale or corrupted binaries are discarded
+	disk_cache_header hdr;
+	SceGxmProgram *res = NULL;
+	GLboolean valid = fread(&hdr, 1, sizeof(disk_cache_header), f) == sizeof(disk_cache_header) && hdr.magic == SHADER_CACHE_MAGIC && hdr.version == SHADER_CACHE_VERSION && hdr.key == key && hdr.src_size == src_size && hdr.size;
+	if (valid) {
+		res = (SceGxmProgram *)malloc(hdr.size);
+		if (res && (fread(res, 1, hdr.size, f) != hdr.size || sceGxmProgramCheck(res) < 0)) {
+			free(res);
+			res = NULL;
+			valid = GL_FALSE;
+		}
+	}
+	fclose(f);
+	if (res)
+		*size = hdr.size;
+	else if (!valid) {
+		remove(path);
+		disk_cache_used = -1;
+	}
+	return res;
+}
+
+static void disk_cache_store(uint64_t key, uint32_t src_size, const SceGxmProgram *prog, uint32_t size) {
+	if (!disk_cache_make_room(sizeof(disk_cache_header) + size))
+		return;
+
+	// Writing to a temporary file first so that interrupted writes never leave a valid looking binary
+	char path[512], tmp_path[512];
+	if (!disk_cache_path(path, sizeof(path), key))
+		return;
+	int len = snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+	if (len <= 0 || len >= sizeof(tmp_path))
+		return;
+	FILE *f = fopen(tmp_path, "wb");
+	if (!f)
+		return;
+	disk_cache_header hdr;
+	hdr.magic = SHADER_CACHE_MAGIC;
+	hdr.version = SHADER_CACHE_VERSION;
+	hdr.key = key;
+	hdr.src_size = src_size;
+	hdr.size = size;
+	GLboolean ok = fwrite(&hdr, 1, sizeof(disk_cache_header), f) == sizeof(disk_cache_header) && fwrite(prog, 1, size, f) == size;
+	fclose(f);
+	if (ok && !rename(tmp_path, path))
+		disk_cache_used += sizeof(disk_cache_header) + size;
+	else
+		remove(tmp_path);
+}
+
+SceGxmProgram *compile_shader_cached(const char *src, uint32_t *size, shark_type type) {
+	uint32_t src_size = *size;
+	uint64_t key = 0;
+
+	// Looking for an already compiled binary
+	if (disk_cache_dir) {
+		key = disk_cache_key(src, src_size, type);
+		SceGxmProgram *res = disk_cache_load(key, src_size, size);
+		if (res)
+			return res;
+	}
+
+	// Compiling shader source and storing the result in the on-disk cache
+	const SceGxmProgram *t = shark_compile_shader_extended(src, size, type, compiler_opts, compiler_fastmath, compiler_fastprecision, compiler_fastint);
+	if (!t)
+		return NULL;
+	SceGxmProgram *res = (SceGxmProgram *)malloc(*size);
+	if (!res)
+		return NULL;
+	memcpy_neon((void *)res, (void *)t, *size);
+	if (disk_cache_dir)
+		disk_cache_store(key, src_size, res, *size);
+	return res;
+}
+
+static int shader_worker(SceSize args, void *argp) {
+	for (;;) {
+		sceKernelWaitSema(shader_jobs_sema, 1, NULL);
+		sceKernelLockLwMutex(&shader_jobs_mutex, 1, NULL);
+		shader_job *j = shader_jobs_head;
+		if (j) {
+			shader_jobs_head = j->next;
+			if (!shader_jobs_head)
+				shader_jobs_tail = NULL;
+		}
+		sceKernelUnlockLwMutex(&shader_jobs_mutex, 1);
+
+		// Queue is drained before honoring a termination request
+		if (!j) {
+			if (shader_worker_quit)
+				break;
+			continue;
+		}
+
+		j->prog = compile_shader_cached(j->src, &j->size, j->type);
+		j->log = grab_shark_log();
+		shark_clear_output();
+		free(j->src);
+		j->src = NULL;
+		__sync_synchronize();
+		j->done = GL_TRUE;
+	}
+	return sceKernelExitDeleteThread(0);
+}
+
+shader_job *submit_shader_job(const char *src, uint32_t size, shark_type type) {
+	if (shader_worker_thid < 0)
+		return NULL;
+
+	// Source is copied since the caller may release it right after the submission
+	shader_job *j = (shader_job *)malloc(sizeof(shader_job));
+	if (!j)
+		return NULL;
+	j->src = (char *)malloc(size + 1);
+	if (!j->src) {
+		free(j);
+		return NULL;
+	}
+	memcpy(j->src, src, size);
+	j->src[size] = 0;
+	j->size = size;
+	j->type = type;
+	j->prog = NULL;
+	j->log = NULL;
+	j->done = GL_FALSE;
+	j->next = NULL;
+
+	sceKernelLockLwMutex(&shader_jobs_mutex, 1, NULL);
+	if (shader_jobs_tail)
+		shader_jobs_tail->next = j;
+	else
+		shader_jobs_head = j;
+	shader_jobs_tail = j;
+	sceKernelUnlockLwMutex(&shader_jobs_mutex, 1);
+	sceKernelSignalSema(shader_jobs_sema, 1);
+	return j;
+}
+
+GLboolean is_shader_job_done(shader_job *j) {
+	return j->done;
+}
+
+SceGxmProgram *finish_shader_job(shader_job *j, uint32_t *size, char **log) {
+	while (!j->done) {
+		sceKernelDelayThread(100);
+	}
+	__sync_synchronize();
+	SceGxmProgram *res = j->prog;
+	*size = j->size;
+	if (log)
+		*log = j->log;
+	else if (j->log)
+		free(j->log);
+	free(j);
+	return res;
+}
+
+static void stop_shader_worker(void) {
+	if (shader_worker_thid < 0)
+		return;
+	shader_worker_quit = GL_TRUE;
+	sceKernelSignalSema(shader_jobs_sema, 1);
+	sceKernelWaitThreadEnd(shader_worker_thid, NULL, NULL);
+	sceKernelDeleteSema(shader_jobs_sema);
+	sceKernelDeleteLwMutex(&shader_jobs_mutex);
+	shader_worker_thid = -1;
+}
+#endif
+
+/*
+ * ------------------------------
+ * - IMPLEMENTATION STARTS HERE -
+ * ------------------------------
+ */
+
+void vglSetShaderCacheDir(const char *path) {
+#ifdef HAVE_SHARK
+	if (disk_cache_dir) {
+		free(disk_cache_dir);
+		disk_cache_dir = NULL;
+	}
+	disk_cache_used = -1;
+	if (path) {
+		disk_cache_dir = strdup(path);
+		mkdir(path, 0777);
+	}
+#endif
+}
+
+void vglSetShaderCacheSize(uint32_t size) {
+#ifdef HAVE_SHARK
+	disk_cache_budget = size;
+	if (disk_cache_dir)
+		disk_cache_make_room(0);
+#endif
+}
+
+void vglEnableAsyncShaderCompiler(GLboolean usage) {
+#ifdef HAVE_SHARK
+	if (!usage) {
+		stop_shader_worker();
+		return;
+	}
+	if (shader_worker_thid >= 0)
+		return;
+
+	// Running the compiler on a different core than the one used by the rendering thread
+	shader_worker_quit = GL_FALSE;
+	shader_jobs_sema = sceKernelCreateSema("vitaGL shaders queue", 0, 0, 0x7FFFFFFF, NULL);
+	sceKernelCreateLwMutex(&shader_jobs_mutex, "vitaGL shaders mutex", 0, 0, NULL);
+	shader_worker_thid = sceKernelCreateThread("vitaGL shaders compiler", shader_worker, SHADER_WORKER_PRIORITY, SHADER_WORKER_STACK_SIZE, 0, SCE_KERNEL_CPU_MASK_USER_2, NULL);
+	if (shader_worker_thid < 0 || sceKernelStartThread(shader_worker_thid, 0, NULL) < 0) {
+		if (shader_worker_thid >= 0)
+			sceKernelDeleteThread(shader_worker_thid);
+		sceKernelDeleteSema(shader_jobs_sema);
+		sceKernelDeleteLwMutex(&shader_jobs_mutex);
+		shader_worker_thid = -1;
+	}
+#endif
+}
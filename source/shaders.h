@@ -27,6 +27,8 @@
 #define TEX2D_UNIFS_NUM 13
 
 void upload_tex2d_uniforms(const SceGxmProgramParameter *unifs[]); // Function to upload uniform values for textured draws
+vector4f *upload_const_color(void); // Function to upload current color for constant color draws
+void setup_tex2d_programs(GLboolean has_colors, const stream_layout *layouts); // Function to set programs and uniforms for textured draws
 
 // Disable color buffer shader
 extern SceGxmShaderPatcherId disable_color_buffer_fragment_id;
@@ -46,8 +48,10 @@ extern SceGxmFragmentProgram *clear_fragment_program_patched;
 extern SceGxmShaderPatcherId rgba_vertex_id;
 extern SceGxmShaderPatcherId rgba_fragment_id;
 extern const SceGxmProgramParameter *rgba_wvp;
+extern uint16_t rgba_attr_regs[2];
 extern SceGxmVertexProgram *rgba_vertex_program_patched;
 extern SceGxmVertexProgram *rgba_u8n_vertex_program_patched;
+extern SceGxmVertexProgram *rgba_const_vertex_program_patched;
 extern SceGxmVertexProgram *rgb_vertex_program_patched;
 extern SceGxmVertexProgram *rgb_u8n_vertex_program_patched;
 extern SceGxmFragmentProgram *rgba_fragment_program_patched;
@@ -4,18 +4,89 @@ R"(#define alpha_test_mode %d
 #define has_colors %d
 #define fog_mode %d
 #define tex_env_mode %d
+#define combine_rgb %d
+#define combine_alpha %d
+#define has_texture1 %d
+#define tex_env_mode1 %d
+#define combine_rgb1 %d
+#define combine_alpha1 %d
+
+float4 tex_env(int mode, float4 texColor, float4 envColor, float4 prevColor)
+{
+	float4 res = texColor; // GL_REPLACE
+	if (mode == 0) { // GL_MODULATE
+		res = texColor * prevColor;
+	} else if (mode == 1) { // GL_DECAL
+		res.rgb = lerp(prevColor.rgb, texColor.rgb, texColor.a);
+		res.a = prevColor.a;
+	} else if (mode == 2) { // GL_BLEND
+		res.rgb = lerp(prevColor.rgb, envColor.rgb, texColor.rgb);
+		res.a = texColor.a * prevColor.a;
+	} else if (mode == 3) { // GL_ADD
+		res.rgb = clamp(texColor.rgb + prevColor.rgb, 0.0, 1.0);
+		res.a = texColor.a * prevColor.a;
+	}
+	return res;
+}
+
+float4 combine_op(int func, float4 arg0, float4 arg1, float4 arg2)
+{
+	if (func == 0) // GL_REPLACE
+		return arg0;
+	if (func == 1) // GL_MODULATE
+		return arg0 * arg1;
+	if (func == 2) // GL_ADD
+		return arg0 + arg1;
+	if (func == 3) // GL_ADD_SIGNED
+		return arg0 + arg1 - 0.5;
+	if (func == 4) // GL_INTERPOLATE
+		return lerp(arg1, arg0, arg2);
+	return arg0 - arg1; // GL_SUBTRACT
+}
+
+float4 tex_combine(int func_rgb, int func_alpha, float4 cfg[9], float4 texColor, float4 envColor, float4 primColor, float4 prevColor)
+{
+	// cfg[0-2]: RGB sources weights, cfg[3-5]: alpha sources weights (texture, constant, primary color, previous)
+	// cfg[6].xyz: RGB operands use source alpha, cfg[7].xyz: RGB operands are inverted, cfg[8].xyz: alpha operands are inverted
+	// cfg[6].w: RGB scale, cfg[7].w: alpha scale
+	float4 args[3];
+	for (int i = 0; i < 3; i++) {
+		float4 src_rgb = texColor * cfg[i].x + envColor * cfg[i].y + primColor * cfg[i].z + prevColor * cfg[i].w;
+		float4 src_a = texColor * cfg[i + 3].x + envColor * cfg[i + 3].y + primColor * cfg[i + 3].z + prevColor * cfg[i + 3].w;
+		args[i].rgb = lerp(src_rgb.rgb, src_rgb.aaa, cfg[6][i]);
+		args[i].rgb = lerp(args[i].rgb, 1.0 - args[i].rgb, cfg[7][i]);
+		args[i].a = lerp(src_a.a, 1.0 - src_a.a, cfg[8][i]);
+	}
+	float4 res;
+	res.rgb = combine_op(func_rgb, args[0], args[1], args[2]).rgb * cfg[6].w;
+	res.a = combine_op(func_alpha, args[0], args[1], args[2]).a * cfg[7].w;
+	return clamp(res, 0.0, 1.0);
+}
 
 float4 main(
 #if has_texture == 1
 	float2 vTexcoord : TEXCOORD0,
 #endif
+#if has_texture1 == 1
+	float2 vTexcoord1 : TEXCOORD1,
+#endif
 #if has_colors == 1
 	float4 vColor : COLOR,
 #endif
 #if fog_mode < 3
 	float4 coords: WPOS,
 #endif
-	uniform sampler2D tex,
+	uniform sampler2D tex : TEXUNIT0,
+#if has_texture1 == 1
+	uniform sampler2D tex1 : TEXUNIT1,
+	uniform float4 texEnvColor1,
+#endif
+#if tex_env_mode == 5
+	uniform float4 combineCfg[9],
+#endif
+#if has_texture1 == 1 && tex_env_mode1 == 5
+	uniform float4 combineCfg1[9],
+#endif
 	uniform float alphaCut,
 	uniform float4 fogColor,
 	uniform float4 texEnvColor,
@@ -37,20 +108,20 @@ float4 main(
 	float4 texColor = tex2D(tex, vTexcoord);
 
 	// Texture Environment
-#if tex_env_mode == 0 // GL_MODULATE
-	texColor = texColor * vColor;
-#endif
-#if tex_env_mode == 1 // GL_DECAL
-	texColor.rgb = lerp(vColor.rgb, texColor.rgb, texColor.a);
-	texColor.a = vColor.a;
+#if tex_env_mode == 5 // GL_COMBINE
+	texColor = tex_combine(combine_rgb, combine_alpha, combineCfg, texColor, texEnvColor, vColor, vColor);
+#else
+	texColor = tex_env(tex_env_mode, texColor, texEnvColor, vColor);
 #endif
-#if tex_env_mode == 2 // GL_BLEND
-	texColor.rgb = lerp(vColor.rgb, texEnvColor.rgb, texColor.rgb);
-	texColor.a = texColor.a * vColor.a;
+
+	// Second texture unit, previous color is first unit output
+#if has_texture1 == 1
+	float4 tex1Color = tex2D(tex1, vTexcoord1);
+#if tex_env_mode1 == 5 // GL_COMBINE
+	texColor = tex_combine(combine_rgb1, combine_alpha1, combineCfg1, tex1Color, texEnvColor1, vColor, texColor);
+#else
+	texColor = tex_env(tex_env_mode1, tex1Color, texEnvColor1, texColor);
 #endif
-#if tex_env_mode == 3 // GL_ADD
-	texColor.rgb = clamp(texColor.rgb + vColor.rgb, 0.0, 1.0);
-	texColor.a = texColor.a * vColor.a;
 #endif
 #endif
 	
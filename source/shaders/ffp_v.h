@@ -2,6 +2,10 @@ const char *ffp_vert_src =
 R"(#define has_clip_plane %d
 #define has_texture %d
 #define has_colors %d
+#define has_texture1 %d
+#define lights_num %d
+#define color_material %d
+#define has_normals %d
 
 void main(
 	float3 position,
@@ -11,15 +15,37 @@ void main(
 #if has_colors == 1
 	float4 color,
 #endif
+#if has_texture1 == 1
+	float2 texcoord1,
+#endif
+#if has_normals == 1
+	float3 normal,
+#endif
 #if has_texture == 1
 	float2 out vTexcoord : TEXCOORD0,
+#endif
+#if has_texture1 == 1
+	float2 out vTexcoord1 : TEXCOORD1,
 #endif
 	float4 out vPosition : POSITION,
-#if has_colors == 1
+#if has_colors == 1 || lights_num > 0
 	float4 out vColor : COLOR,
 #endif
 #if has_clip_plane == 1
 	float out vClip : CLP0,
+#endif
+#if lights_num > 0
+	uniform float4x4 normal_mat,
+	uniform float4 lights[lights_num * 5],
+	uniform float4 lightModelAmbient,
+	uniform float4 material[4],
+	uniform float shininess,
+#if has_normals == 0
+	uniform float3 curNormal,
+#endif
+#if color_material > 0 && has_colors == 0
+	uniform float4 curColor,
+#endif
 #endif
 	uniform float4 clip_plane0_eq,
 	uniform float4x4 modelview,
@@ -37,8 +63,59 @@ void main(
 #if has_texture == 1
 	vTexcoord = texcoord;
 #endif
+#if lights_num > 0
+	// Per vertex lighting, evaluated in eye space with an infinite viewer
+#if has_normals == 1
+	float3 N = normalize(mul(normal_mat, float4(normal, 0.f)).xyz);
+#else
+	float3 N = normalize(mul(normal_mat, float4(curNormal, 0.f)).xyz);
+#endif
+	float3 eyePos = mul(modelview, pos4).xyz;
+#if color_material > 0
 #if has_colors == 1
+	float4 matColor = color;
+#else
+	float4 matColor = curColor;
+#endif
+#endif
+#if color_material == 1 || color_material == 2
+	float4 matAmbient = matColor;
+#else
+	float4 matAmbient = material[0];
+#endif
+#if color_material == 1 || color_material == 3
+	float4 matDiffuse = matColor;
+#else
+	float4 matDiffuse = material[1];
+#endif
+#if color_material == 4
+	float4 matSpecular = matColor;
+#else
+	float4 matSpecular = material[2];
+#endif
+#if color_material == 5
+	float4 matEmission = matColor;
+#else
+	float4 matEmission = material[3];
+#endif
+	float3 lit = matEmission.rgb + lightModelAmbient.rgb * matAmbient.rgb;
+	for (int i = 0; i < lights_num; i++) {
+		float4 lightPos = lights[i * 5 + 3];
+		float3 L = lightPos.xyz - eyePos * lightPos.w;
+		float d = length(L);
+		L = L / d;
+		float att = lerp(1.f, 1.f / dot(lights[i * 5 + 4].xyz, float3(1.f, d, d * d)), lightPos.w);
+		float NdotL = max(dot(N, L), 0.f);
+		float3 H = normalize(L + float3(0.f, 0.f, 1.f));
+		float spec = NdotL > 0.f ? pow(max(dot(N, H), 0.f), shininess) : 0.f;
+		lit += att * (lights[i * 5].rgb * matAmbient.rgb + NdotL * lights[i * 5 + 1].rgb * matDiffuse.rgb + spec * lights[i * 5 + 2].rgb * matSpecular.rgb);
+	}
+	vColor = float4(clamp(lit, 0.f, 1.f), matDiffuse.a);
+#elif has_colors == 1
 	vColor = color;
 #endif
+#if has_texture1 == 1
+	vTexcoord1 = texcoord1;
+#endif
 }
 )";
@@ -36,6 +36,12 @@
 #define GXM_TEX_MAX_SIZE 4096 // Maximum width/height in pixels per texture
 #define BUFFERS_ADDR 0xA000 // Starting address for buffers indexing
 #define BUFFERS_NUM 128 // Maximum number of allocatable buffers
+#define VERTEX_ARRAYS_NUM 128 // Maximum number of allocatable vertex array objects
+#define VERTEX_ATTRIBS_NUM 8 // Available generic vertex attributes
+#define MAX_QUADS_NUM 16384 // Maximum number of quads drawable with a single glDrawArrays call
+#define COMPACTION_RATIO 4 // Min ratio between referenced vertices range and indices count for glDrawElements vertices compaction
+#define MAX_LIGHTS_NUM 4 // Maximum number of light sources usable by fixed function pipeline lighting
+#define UNIFORM_BUFFER_BINDINGS_NUM 14 // Available uniform buffer binding points (one per sceGxm uniform buffer slot)
 
 // Internal constants set in bootup phase
 extern int DISPLAY_WIDTH; // Display width in pixels
@@ -51,6 +57,7 @@ extern float DISPLAY_HEIGHT_FLOAT; // Display height in pixels (float)
 #include "vitaGL.h"
 
 #include "utils/gpu_utils.h"
+#include "utils/index_utils.h"
 #include "utils/math_utils.h"
 #include "utils/mem_utils.h"
 
@@ -67,9 +74,20 @@ typedef enum texEnvMode {
 	DECAL = 1,
 	BLEND = 2,
 	ADD = 3,
-	REPLACE = 4
+	REPLACE = 4,
+	COMBINE = 5
 } texEnvMode;
 
+// Texture combiner function (GL_COMBINE texture environment mode)
+typedef enum combineFunc {
+	COMBINE_REPLACE = 0,
+	COMBINE_MODULATE = 1,
+	COMBINE_ADD = 2,
+	COMBINE_ADD_SIGNED = 3,
+	COMBINE_INTERPOLATE = 4,
+	COMBINE_SUBTRACT = 5
+} combineFunc;
+
 // 3D vertex for position + 4D vertex for RGBA color struct
 typedef struct rgba_vertex {
 	vector3f position;
@@ -88,6 +106,36 @@ typedef struct texture2d_vertex {
 	vector2f texcoord;
 } texture2d_vertex;
 
+// Display list commands
+typedef enum dlistCmdType {
+	DLIST_CMD_DRAW,
+	DLIST_CMD_COLOR,
+	DLIST_CMD_MATRIX_MODE,
+	DLIST_CMD_LOAD_IDENTITY,
+	DLIST_CMD_LOAD_MATRIX,
+	DLIST_CMD_MULT_MATRIX,
+	DLIST_CMD_TRANSLATE,
+	DLIST_CMD_SCALE,
+	DLIST_CMD_ROTATE,
+	DLIST_CMD_PUSH_MATRIX,
+	DLIST_CMD_POP_MATRIX,
+	DLIST_CMD_BIND_TEXTURE,
+	DLIST_CMD_CALL_LIST,
+	DLIST_CMD_ORTHO,
+	DLIST_CMD_FRUSTUM,
+	DLIST_CMD_PERSPECTIVE,
+	DLIST_CMD_ENABLE,
+	DLIST_CMD_DISABLE,
+	DLIST_CMD_BLEND_FUNC,
+	DLIST_CMD_TEX_ENVI,
+	DLIST_CMD_TEX_ENVF,
+	DLIST_CMD_TEX_ENV_COLOR,
+	DLIST_CMD_ALPHA_FUNC,
+	DLIST_CMD_DEPTH_FUNC,
+	DLIST_CMD_DEPTH_MASK,
+	DLIST_CMD_CULL_FACE
+} dlistCmdType;
+
 // Non native primitives implemented
 typedef enum SceGxmPrimitiveTypeExtra {
 	SCE_GXM_PRIMITIVE_NONE = 0,
@@ -100,6 +148,17 @@ typedef union {
 	uint32_t raw;
 } blend_config;
 
+// Vertex stream layout internal struct
+typedef union stream_layout {
+	struct {
+		uint32_t format : 8;
+		uint32_t num : 4;
+		uint32_t index_source : 4;
+		uint32_t stride : 16;
+	};
+	uint32_t raw;
+} stream_layout;
+
 #include "shaders.h"
 
 // Internal stuffs
@@ -187,6 +246,7 @@ extern SceGxmVertexProgram *clear_vertex_program_patched; // Patched vertex prog
 extern vector4f *clear_vertices; // Memblock starting address for clear screen vertices
 
 extern GLboolean fast_texture_compression; // Hints for texture compression
+extern GLboolean optimize_indices; // Hints for index buffers optimization
 
 /* gxm.c */
 void initGxm(void); // Inits sceGxm
@@ -202,6 +262,8 @@ void termDepthStencilSurfaces(void); // Destroys depth and stencil surfaces for
 void startShaderPatcher(void); // Creates a shader patcher instance
 void stopShaderPatcher(void); // Destroys a shader patcher instance
 void waitRenderingDone(void); // Waits for rendering to be finished
+uint32_t get_current_frame(void); // Gets the id the frame currently being recorded will have once submitted
+GLboolean is_frame_completed(uint32_t frame); // Checks if the GPU is done with a submitted frame
 
 /* tests.c */
 void change_depth_write(SceGxmDepthWriteMode mode); // Changes current in use depth write mode
@@ -215,15 +277,66 @@ void update_alpha_test_settings(void); // Changes current in use alpha test oper
 void update_scissor_test(void); // Changes current in use scissor test region
 void resetScissorTestRegion(void); // Resets scissor test region to default values
 
+/* textures.c */
+void reset_texture_env(texture_unit *tex_unit); // Resets texture environment settings of a texture unit to default values
+
 /* blending.c (TODO) */
 void change_blend_factor(void); // Changes current blending settings for all used shaders
 void change_blend_mask(void); // Changes color mask when blending is disabled for all used shaders
-void rebuild_frag_shader(SceGxmShaderPatcherId pid, SceGxmFragmentProgram **prog, const SceGxmProgram *vert); // Creates a new patched fragment program with proper blend settings
+void rebuild_frag_shader(SceGxmShaderPatcherId pid, SceGxmFragmentProgram **prog, const SceGxmProgram *vert); // Swaps a patched fragment program with the cached variant for current blend settings
+void release_fragment_program_variant(SceGxmFragmentProgram *prog); // Releases a patched fragment program obtained through rebuild_frag_shader
+void release_program_variants(SceGxmShaderPatcherId id); // Releases every cached patched program created from a shader program
+void queue_program_release(SceGxmVertexProgram *vprog, SceGxmFragmentProgram *fprog); // Releases a patched program once the GPU is done with the current frame
+void queue_program_unregister(SceGxmShaderPatcherId id, void *bin); // Unregisters a shader program and frees its binary once the GPU is done with the current frame
+void queue_mem_free(void *mem); // Frees a vitaGL mempool memblock once the GPU is done with the current frame
+void release_pending_programs(GLboolean all); // Releases queued patched programs the GPU is done with (every one if all is set)
 void update_precompiled_ffp_frag_shader(SceGxmShaderPatcherId pid, SceGxmFragmentProgram **prog, blend_config *cfg); // Updated current in use fragment program for precompiled ffp implementation
 
+/* vitaGL.c */
+void *get_uniform_buffer_binding(GLuint index); // Returns the memblock of the buffer bound to a uniform buffer binding point (NULL if none)
+int get_array_buffer_unit(void); // Returns the buffer unit currently bound to GL_ARRAY_BUFFER (negative if none)
+void *get_buffer_memblock(int unit); // Returns the memblock of a buffer unit
+GLuint get_vertex_array_binding(void); // Returns the currently bound vertex array object (0 if none)
+uint8_t *_glDraw_CopyVertexArray(vertexArray *array, GLint first, uint32_t count); // Copies a vertex array range on vitaGL mempool
+GLboolean _glDraw_IsVertexArrayMapped(vertexArray *array); // Checks if a vertex array can be read directly by sceGxm
+uint8_t *_glDraw_GetVertexArray(vertexArray *array, GLint first, uint32_t count); // Gets a sceGxm readable copy of a vertex array range
+uint64_t _glDrawElements_CountVertices(GLsizei count, uint16_t *ptr_idx); // Gets the number of vertices referenced by an indices array
+
 /* custom_shaders.c */
 void resetCustomShaders(void); // Resets custom shaders
-void _vglDrawObjects_CustomShadersIMPL(GLenum mode, GLsizei count, GLboolean implicit_wvp); // vglDrawObjects implementation for rendering with custom shaders
+void _vglDrawObjects_CustomShadersIMPL(GLenum mode, GLsizei count, GLsizei instances, GLboolean implicit_wvp); // vglDrawObjects implementation for rendering with custom shaders
+void custom_shaders_new_frame(void); // Signals custom shaders that a new frame started
+#ifdef HAVE_SHARK
+char *grab_shark_log(void); // Takes ownership of current vitaShaRK log (NULL if not available)
+#endif
+
+/* shader_cache.c */
+typedef struct shader_job shader_job; // Queued asynchronous shader compilation
+#ifdef HAVE_SHARK
+SceGxmProgram *compile_shader_cached(const char *src, uint32_t *size, shark_type type); // Compiles a shader going through the on-disk shaders cache, returned program must be freed by the caller
+shader_job *submit_shader_job(const char *src, uint32_t size, shark_type type); // Queues a shader compilation on the worker thread, returns NULL if asynchronous compilation is disabled
+GLboolean is_shader_job_done(shader_job *j); // Checks if a queued shader compilation completed
+SceGxmProgram *finish_shader_job(shader_job *j, uint32_t *size, char **log); // Waits for a queued shader compilation and releases the job, returned program must be freed by the caller
+#endif
+
+/* legacy.c */
+void flush_imm_batch(void); // Draws pending immediate mode batch, if any
+void draw_imm_vertices(SceGxmPrimitiveType type, vector3f *vertices, vector2f *uv_map, vector4f *colors, uint16_t *indices, uint32_t idx_count); // Draws immediate mode vertices with legacy shaders
+
+/* display_lists.c */
+extern void *cur_display_list; // Display list being compiled (NULL if none)
+extern GLenum display_list_mode; // Compiling mode for current display list
+GLboolean record_display_list_cmd(dlistCmdType type, const void *args, uint32_t size); // Records a command in current display list, returns GL_TRUE if the command must not be executed
+GLboolean reserve_display_list_draw(SceGxmPrimitiveType prim, uint32_t vertex_count, uint32_t idx_count, GLboolean has_uv, vector3f **vertices, vector2f **uv_map, vector4f **colors, uint16_t **indices); // Allocates persistent memblocks for a draw in current display list
+
+/* array_cache.c */
+void *array_cache_get(const void *pointer, uint32_t stride, uint32_t size, uint32_t count); // Gets a persistent GPU copy for a client array range (NULL if not cached)
+void array_cache_reset(void); // Frees all the client arrays cache entries
+
+/* vertex program variants */
+uint8_t gl_type_to_gxm_attrib_format(GLenum type, GLboolean normalized); // Converts a GL data type to the matching sceGxm attribute format
+stream_layout get_array_layout(vertexArray *array, GLboolean normalized, GLboolean is_mapped); // Gets the sceGxm stream layout for a vertex array
+SceGxmVertexProgram *get_vertex_program_variant(SceGxmShaderPatcherId id, const uint16_t *regs, const stream_layout *layouts, int num); // Gets a patched vertex program for the given streams layout
 
 /* misc functions */
 void vector4f_convert_to_local_space(vector4f *out, int x, int y, int width, int height); // Converts screen coords to local space
@@ -54,6 +54,27 @@ vector4f fog_color = { 0.0f, 0.0f, 0.0f, 0.0f }; // Current fogging color
 GLint clip_plane0 = GL_FALSE; // Current status of clip plane 0
 vector4f clip_plane0_eq = { 0.0f, 0.0f, 0.0f, 0.0f }; // Current equation of clip plane 0
 
+// Lighting
+GLboolean lighting_state = GL_FALSE; // Current state for GL_LIGHTING
+uint8_t lights_mask = 0; // Current enabled light sources bitmask
+light_source lights[MAX_LIGHTS_NUM] = {
+	{{0.0f, 0.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 1.0f, 0.0f}, {1.0f, 0.0f, 0.0f, 0.0f}},
+	{{0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 1.0f, 0.0f}, {1.0f, 0.0f, 0.0f, 0.0f}},
+	{{0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 1.0f, 0.0f}, {1.0f, 0.0f, 0.0f, 0.0f}},
+	{{0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 1.0f, 0.0f}, {1.0f, 0.0f, 0.0f, 0.0f}}
+}; // Current light sources settings
+vector4f light_model_ambient = { 0.2f, 0.2f, 0.2f, 1.0f }; // Current scene ambient color
+vector4f material_colors[4] = {
+	{0.2f, 0.2f, 0.2f, 1.0f},
+	{0.8f, 0.8f, 0.8f, 1.0f},
+	{0.0f, 0.0f, 0.0f, 1.0f},
+	{0.0f, 0.0f, 0.0f, 1.0f}
+}; // Current material ambient, diffuse, specular and emission colors
+GLfloat material_shininess = 0.0f; // Current material specular exponent
+GLboolean color_material_state = GL_FALSE; // Current state for GL_COLOR_MATERIAL
+GLenum color_material_mode = GL_AMBIENT_AND_DIFFUSE; // Current material colors tracking current color
+vector3f current_normal = { 0.0f, 0.0f, 1.0f }; // Current in use normal
+
 // Cullling
 GLboolean cull_face_state = GL_FALSE; // Current state for GL_CULL_FACE
 GLenum gl_cull_mode = GL_BACK; // Current in use openGL cull mode
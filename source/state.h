@@ -35,6 +35,7 @@ typedef struct vertexArray {
 	GLint size;
 	GLint num;
 	GLsizei stride;
+	GLenum type;
 	const GLvoid *pointer;
 } vertexArray;
 
@@ -80,10 +81,12 @@ typedef struct texture_unit {
 	GLboolean vertex_array_state;
 	GLboolean color_array_state;
 	GLboolean texture_array_state;
+	GLboolean normal_array_state;
 	matrix4x4 stack[GENERIC_STACK_DEPTH];
 	vertexArray vertex_array;
 	vertexArray color_array;
 	vertexArray texture_array;
+	vertexArray normal_array;
 	GLenum color_object_type;
 	void *vertex_object;
 	void *color_object;
@@ -91,8 +94,29 @@ typedef struct texture_unit {
 	void *index_object;
 	int env_mode;
 	int tex_id;
+	vector4f env_color;
+	int combine_rgb;
+	int combine_alpha;
+	vector4f combine_cfg[9]; // Combiner arguments sources (RGB/A), operands and scales as fed to fixed function pipeline shaders
 } texture_unit;
 
+// Generic vertex attribute struct
+typedef struct vertex_attrib {
+	GLboolean enabled; // Current state for glEnableVertexAttribArray
+	GLboolean normalized; // Flag to check if fixed point data must be normalized
+	int buffer; // Buffer unit bound to GL_ARRAY_BUFFER at glVertexAttribPointer call (negative if none)
+	vertexArray array; // Attribute data layout, pointer is an offset into the buffer if one is bound
+} vertex_attrib;
+
+// Light source struct, laid out as fed to fixed function pipeline shaders
+typedef struct light_source {
+	vector4f ambient;
+	vector4f diffuse;
+	vector4f specular;
+	vector4f position; // Eye space position (w = 0 for directional lights)
+	vector4f attenuation; // Constant, linear and quadratic attenuation factors
+} light_source;
+
 // Framebuffer struct
 typedef struct framebuffer {
 	uint8_t active;
@@ -159,6 +183,9 @@ extern texture_unit texture_units[GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS]; // Avail
 extern texture texture_slots[TEXTURES_NUM]; // Available texture slots
 extern int8_t server_texture_unit; // Current in use server side texture unit
 extern int8_t client_texture_unit; // Current in use client side texture unit
+
+// Generic vertex attributes
+extern vertex_attrib vertex_attribs[VERTEX_ATTRIBS_NUM]; // Current generic vertex attributes arrays
 extern palette *color_table; // Current in-use color table
 
 // Matrices
@@ -186,7 +213,6 @@ extern GLenum gl_polygon_mode_front; // Current in use polygon mode for front
 extern GLenum gl_polygon_mode_back; // Current in use polygon mode for back
 
 // Texture Environment
-extern vector4f texenv_color; // Current in use texture environment color
 
 // Fogging
 extern GLboolean fogging; // Current fogging processor state
@@ -201,6 +227,17 @@ extern vector4f fog_color; // Current fogging color
 extern GLint clip_plane0; // Current status of clip plane 0
 extern vector4f clip_plane0_eq; // Current equation of clip plane 0
 
+// Lighting
+extern GLboolean lighting_state; // Current state for GL_LIGHTING
+extern uint8_t lights_mask; // Current enabled light sources bitmask
+extern light_source lights[MAX_LIGHTS_NUM]; // Current light sources settings
+extern vector4f light_model_ambient; // Current scene ambient color
+extern vector4f material_colors[4]; // Current material ambient, diffuse, specular and emission colors
+extern GLfloat material_shininess; // Current material specular exponent
+extern GLboolean color_material_state; // Current state for GL_COLOR_MATERIAL
+extern GLenum color_material_mode; // Current material colors tracking current color
+extern vector3f current_normal; // Current in use normal
+
 // Framebuffers
 extern framebuffer *active_read_fb; // Current readback framebuffer in use
 extern framebuffer *active_write_fb; // Current write framebuffer in use
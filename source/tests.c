@@ -327,6 +327,7 @@ void resetScissorTestRegion(void) {
  */
 
 void glScissor(GLint x, GLint y, GLsizei width, GLsizei height) {
+	flush_imm_batch();
 #ifndef SKIP_ERROR_HANDLING
 	// Error handling
 	if ((width < 0) || (height < 0)) {
@@ -346,6 +347,13 @@ void glScissor(GLint x, GLint y, GLsizei width, GLsizei height) {
 }
 
 void glDepthFunc(GLenum func) {
+	flush_imm_batch();
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		if (record_display_list_cmd(DLIST_CMD_DEPTH_FUNC, &func, sizeof(GLenum)))
+			return;
+	}
+
 	// Properly translating openGL function to sceGxm one
 	switch (func) {
 	case GL_NEVER:
@@ -384,6 +392,7 @@ void glClearDepth(GLdouble depth) {
 }
 
 void glDepthMask(GLboolean flag) {
+	flush_imm_batch();
 #ifndef SKIP_ERROR_HANDLING
 	// Error handling
 	if (phase == MODEL_CREATION) {
@@ -391,12 +400,26 @@ void glDepthMask(GLboolean flag) {
 	}
 #endif
 
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		if (record_display_list_cmd(DLIST_CMD_DEPTH_MASK, &flag, sizeof(GLboolean)))
+			return;
+	}
+
 	// Set current in use depth mask and invoking a depth write mode update
 	depth_mask_state = flag;
 	change_depth_write(depth_mask_state ? SCE_GXM_DEPTH_WRITE_ENABLED : SCE_GXM_DEPTH_WRITE_DISABLED);
 }
 
 void glAlphaFunc(GLenum func, GLfloat ref) {
+	flush_imm_batch();
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		struct { GLenum func; GLfloat ref; } args = { func, ref };
+		if (record_display_list_cmd(DLIST_CMD_ALPHA_FUNC, &args, sizeof(args)))
+			return;
+	}
+
 	// Updating in use alpha test parameters
 	alpha_func = func;
 	alpha_ref = ref;
@@ -404,6 +427,7 @@ void glAlphaFunc(GLenum func, GLfloat ref) {
 }
 
 void glStencilOpSeparate(GLenum face, GLenum sfail, GLenum dpfail, GLenum dppass) {
+	flush_imm_batch();
 	// Properly updating stencil operation settings
 	switch (face) {
 	case GL_FRONT:
@@ -448,6 +472,7 @@ void glStencilOp(GLenum sfail, GLenum dpfail, GLenum dppass) {
 }
 
 void glStencilFuncSeparate(GLenum face, GLenum func, GLint ref, GLuint mask) {
+	flush_imm_batch();
 	// Properly updating stencil test function settings
 	switch (face) {
 	case GL_FRONT:
@@ -486,6 +511,7 @@ void glStencilFunc(GLenum func, GLint ref, GLuint mask) {
 }
 
 void glStencilMaskSeparate(GLenum face, GLuint mask) {
+	flush_imm_batch();
 	// Properly updating stencil test mask settings
 	switch (face) {
 	case GL_FRONT:
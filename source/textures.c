@@ -28,6 +28,97 @@ texture texture_slots[TEXTURES_NUM]; // Available texture slots
 palette *color_table = NULL; // Current in-use color table
 int8_t server_texture_unit = 0; // Current in use server side texture unit
 
+static GLboolean set_combine_func(int *func, GLint mode) {
+	switch (mode) {
+	case GL_REPLACE:
+		*func = COMBINE_REPLACE;
+		break;
+	case GL_MODULATE:
+		*func = COMBINE_MODULATE;
+		break;
+	case GL_ADD:
+		*func = COMBINE_ADD;
+		break;
+	case GL_ADD_SIGNED:
+		*func = COMBINE_ADD_SIGNED;
+		break;
+	case GL_INTERPOLATE:
+		*func = COMBINE_INTERPOLATE;
+		break;
+	case GL_SUBTRACT:
+		*func = COMBINE_SUBTRACT;
+		break;
+	default:
+		return GL_FALSE;
+	}
+	return GL_TRUE;
+}
+
+static GLboolean set_combine_source(texture_unit *tex_unit, int arg, GLint src) {
+	// Shaders pick combiner arguments as a weighted sum of (texture, constant, primary color, previous)
+	vector4f sel = {};
+	switch (src) {
+	case GL_TEXTURE:
+		sel.x = 1.0f;
+		break;
+	case GL_CONSTANT:
+		sel.y = 1.0f;
+		break;
+	case GL_PRIMARY_COLOR:
+		sel.z = 1.0f;
+		break;
+	case GL_PREVIOUS:
+		sel.w = 1.0f;
+		break;
+	default:
+		return GL_FALSE;
+	}
+	tex_unit->combine_cfg[arg] = sel;
+	return GL_TRUE;
+}
+
+static GLboolean set_combine_operand(texture_unit *tex_unit, int arg, GLboolean is_alpha, GLint op) {
+	// RGB operands flags are stored in 7th (use alpha) and 8th (one minus) vectors, alpha ones in 9th (one minus)
+	float *use_alpha = &tex_unit->combine_cfg[6].x;
+	float *invert = is_alpha ? &tex_unit->combine_cfg[8].x : &tex_unit->combine_cfg[7].x;
+	switch (op) {
+	case GL_SRC_COLOR:
+	case GL_ONE_MINUS_SRC_COLOR:
+		if (is_alpha)
+			return GL_FALSE;
+		use_alpha[arg] = 0.0f;
+		break;
+	case GL_SRC_ALPHA:
+	case GL_ONE_MINUS_SRC_ALPHA:
+		if (!is_alpha)
+			use_alpha[arg] = 1.0f;
+		break;
+	default:
+		return GL_FALSE;
+	}
+	invert[arg] = (op == GL_ONE_MINUS_SRC_COLOR || op == GL_ONE_MINUS_SRC_ALPHA) ? 1.0f : 0.0f;
+	return GL_TRUE;
+}
+
+void reset_texture_env(texture_unit *tex_unit) {
+	tex_unit->env_mode = MODULATE;
+	memset(&tex_unit->env_color, 0, sizeof(vector4f));
+	
+	// Default combiner setup: Arg0 = texture, Arg1 = previous, Arg2 = constant (alpha for RGB)
+	memset(tex_unit->combine_cfg, 0, sizeof(tex_unit->combine_cfg));
+	tex_unit->combine_rgb = COMBINE_MODULATE;
+	tex_unit->combine_alpha = COMBINE_MODULATE;
+	set_combine_source(tex_unit, 0, GL_TEXTURE);
+	set_combine_source(tex_unit, 1, GL_PREVIOUS);
+	set_combine_source(tex_unit, 2, GL_CONSTANT);
+	set_combine_source(tex_unit, 3, GL_TEXTURE);
+	set_combine_source(tex_unit, 4, GL_PREVIOUS);
+	set_combine_source(tex_unit, 5, GL_CONSTANT);
+	set_combine_operand(tex_unit, 2, GL_FALSE, GL_SRC_ALPHA);
+	tex_unit->combine_cfg[6].w = 1.0f;
+	tex_unit->combine_cfg[7].w = 1.0f;
+}
+
 /*
  * ------------------------------
  * - IMPLEMENTATION STARTS HERE -
@@ -66,6 +157,14 @@ void glGenTextures(GLsizei n, GLuint *res) {
 }
 
 void glBindTexture(GLenum target, GLuint texture) {
+	flush_imm_batch();
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		GLuint args[2] = { target, texture };
+		if (record_display_list_cmd(DLIST_CMD_BIND_TEXTURE, args, sizeof(args)))
+			return;
+	}
+
 	// Aliasing to make code more readable
 	texture_unit *tex_unit = &texture_units[server_texture_unit];
 
@@ -81,6 +180,7 @@ void glBindTexture(GLenum target, GLuint texture) {
 }
 
 void glDeleteTextures(GLsizei n, const GLuint *gl_textures) {
+	flush_imm_batch();
 #ifndef SKIP_ERROR_HANDLING
 	// Error handling
 	if (n < 0) {
@@ -114,6 +214,7 @@ void glDeleteTextures(GLsizei n, const GLuint *gl_textures) {
 }
 
 void glTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *data) {
+	flush_imm_batch();
 	// Setting some aliases to make code more readable
 	texture_unit *tex_unit = &texture_units[server_texture_unit];
 	int texture2d_idx = tex_unit->tex_id;
@@ -349,6 +450,7 @@ void glTexImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei widt
 }
 
 void glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const GLvoid *pixels) {
+	flush_imm_batch();
 	// Setting some aliases to make code more readable
 	texture_unit *tex_unit = &texture_units[server_texture_unit];
 	int texture2d_idx = tex_unit->tex_id;
@@ -531,6 +633,7 @@ void glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, G
 }
 
 void glCompressedTexImage2D(GLenum target, GLint level, GLenum internalFormat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const void *data) {
+	flush_imm_batch();
 	// Setting some aliases to make code more readable
 	texture_unit *tex_unit = &texture_units[server_texture_unit];
 	int texture2d_idx = tex_unit->tex_id;
@@ -609,6 +712,7 @@ void glCompressedTexImage2D(GLenum target, GLint level, GLenum internalFormat, G
 }
 
 void glColorTable(GLenum target, GLenum internalformat, GLsizei width, GLenum format, GLenum type, const GLvoid *data) {
+	flush_imm_batch();
 	// Checking if a color table is already enabled, if so, deallocating it
 	if (color_table != NULL) {
 		gpu_free_palette(color_table);
@@ -638,6 +742,7 @@ void glColorTable(GLenum target, GLenum internalformat, GLsizei width, GLenum fo
 }
 
 void glTexParameteri(GLenum target, GLenum pname, GLint param) {
+	flush_imm_batch();
 	// Setting some aliases to make code more readable
 	texture_unit *tex_unit = &texture_units[server_texture_unit];
 	int texture2d_idx = tex_unit->tex_id;
@@ -748,6 +853,7 @@ void glTexParameteri(GLenum target, GLenum pname, GLint param) {
 }
 
 void glTexParameterf(GLenum target, GLenum pname, GLfloat param) {
+	flush_imm_batch();
 	// Setting some aliases to make code more readable
 	texture_unit *tex_unit = &texture_units[server_texture_unit];
 	int texture2d_idx = tex_unit->tex_id;
@@ -829,6 +935,7 @@ void glTexParameterf(GLenum target, GLenum pname, GLfloat param) {
 }
 
 void glActiveTexture(GLenum texture) {
+	flush_imm_batch();
 	// Changing current in use server texture unit
 #ifndef SKIP_ERROR_HANDLING
 	if ((texture < GL_TEXTURE0) && (texture > GL_TEXTURE31)) {
@@ -839,6 +946,7 @@ void glActiveTexture(GLenum texture) {
 }
 
 void glGenerateMipmap(GLenum target) {
+	flush_imm_batch();
 	// Setting some aliases to make code more readable
 	texture_unit *tex_unit = &texture_units[server_texture_unit];
 	int texture2d_idx = tex_unit->tex_id;
@@ -872,46 +980,45 @@ void glGenerateMipmap(GLenum target) {
 }
 
 void glTexEnvf(GLenum target, GLenum pname, GLfloat param) {
-	// Aliasing texture unit for cleaner code
-	texture_unit *tex_unit = &texture_units[server_texture_unit];
-
-	// Properly changing texture environment settings as per request
-	switch (target) {
-	case GL_TEXTURE_ENV:
-		switch (pname) {
-		case GL_TEXTURE_ENV_MODE:
-#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
-			ffp_dirty_frag = GL_TRUE;
-#endif
-			if (param == GL_MODULATE)
-				tex_unit->env_mode = MODULATE;
-			else if (param == GL_DECAL)
-				tex_unit->env_mode = DECAL;
-			else if (param == GL_REPLACE)
-				tex_unit->env_mode = REPLACE;
-			else if (param == GL_BLEND)
-				tex_unit->env_mode = BLEND;
-			else if (param == GL_ADD)
-				tex_unit->env_mode = ADD;
-			break;
-		default:
+	// Scales are the only float parameters, everything else is an enum
+	if ((pname == GL_RGB_SCALE) || (pname == GL_ALPHA_SCALE)) {
+		flush_imm_batch();
+		// Recording command if a display list is being compiled
+		if (cur_display_list) {
+			struct { GLenum target; GLenum pname; GLfloat param; } args = { target, pname, param };
+			if (record_display_list_cmd(DLIST_CMD_TEX_ENVF, &args, sizeof(args)))
+				return;
+		}
+		texture_unit *tex_unit = &texture_units[server_texture_unit];
+#ifndef SKIP_ERROR_HANDLING
+		if (target != GL_TEXTURE_ENV) {
 			SET_GL_ERROR(GL_INVALID_ENUM)
-			break;
+		} else if ((param != 1.0f) && (param != 2.0f) && (param != 4.0f)) {
+			SET_GL_ERROR(GL_INVALID_VALUE)
 		}
-		break;
-	default:
-		SET_GL_ERROR(GL_INVALID_ENUM)
-		break;
-	}
+#endif
+		if (pname == GL_RGB_SCALE)
+			tex_unit->combine_cfg[6].w = param;
+		else
+			tex_unit->combine_cfg[7].w = param;
+	} else
+		glTexEnvi(target, pname, (GLint)param);
 }
 
 void glTexEnvfv(GLenum target, GLenum pname, GLfloat *param) {
+	flush_imm_batch();
+	// Recording command if a display list is being compiled
+	if (cur_display_list && (pname == GL_TEXTURE_ENV_COLOR)) {
+		struct { GLenum target; GLfloat color[4]; } args = { target, { param[0], param[1], param[2], param[3] } };
+		if (record_display_list_cmd(DLIST_CMD_TEX_ENV_COLOR, &args, sizeof(args)))
+			return;
+	}
 	// Properly changing texture environment settings as per request
 	switch (target) {
 	case GL_TEXTURE_ENV:
 		switch (pname) {
 		case GL_TEXTURE_ENV_COLOR:
-			memcpy_neon(&texenv_color.r, param, sizeof(GLfloat) * 4);
+			memcpy_neon(&texture_units[server_texture_unit].env_color.r, param, sizeof(GLfloat) * 4);
 			break;
 		default:
 			SET_GL_ERROR(GL_INVALID_ENUM)
@@ -925,6 +1032,14 @@ void glTexEnvfv(GLenum target, GLenum pname, GLfloat *param) {
 }
 
 void glTexEnvi(GLenum target, GLenum pname, GLint param) {
+	flush_imm_batch();
+	// Recording command if a display list is being compiled, scales get recorded by glTexEnvf
+	if (cur_display_list && (pname != GL_RGB_SCALE) && (pname != GL_ALPHA_SCALE)) {
+		GLint args[3] = { target, pname, param };
+		if (record_display_list_cmd(DLIST_CMD_TEX_ENVI, args, sizeof(args)))
+			return;
+	}
+
 	// Aliasing texture unit for cleaner code
 	texture_unit *tex_unit = &texture_units[server_texture_unit];
 
@@ -952,8 +1067,59 @@ void glTexEnvi(GLenum target, GLenum pname, GLint param) {
 			case GL_ADD:
 				tex_unit->env_mode = ADD;
 				break;
+			case GL_COMBINE:
+				tex_unit->env_mode = COMBINE;
+				break;
 			}
 			break;
+		case GL_COMBINE_RGB:
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+			ffp_dirty_frag = GL_TRUE;
+#endif
+			if (!set_combine_func(&tex_unit->combine_rgb, param)) {
+				SET_GL_ERROR(GL_INVALID_ENUM)
+			}
+			break;
+		case GL_COMBINE_ALPHA:
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+			ffp_dirty_frag = GL_TRUE;
+#endif
+			if (!set_combine_func(&tex_unit->combine_alpha, param)) {
+				SET_GL_ERROR(GL_INVALID_ENUM)
+			}
+			break;
+		case GL_SRC0_RGB:
+		case GL_SRC1_RGB:
+		case GL_SRC2_RGB:
+			if (!set_combine_source(tex_unit, pname - GL_SRC0_RGB, param)) {
+				SET_GL_ERROR(GL_INVALID_ENUM)
+			}
+			break;
+		case GL_SRC0_ALPHA:
+		case GL_SRC1_ALPHA:
+		case GL_SRC2_ALPHA:
+			if (!set_combine_source(tex_unit, 3 + pname - GL_SRC0_ALPHA, param)) {
+				SET_GL_ERROR(GL_INVALID_ENUM)
+			}
+			break;
+		case GL_OPERAND0_RGB:
+		case GL_OPERAND1_RGB:
+		case GL_OPERAND2_RGB:
+			if (!set_combine_operand(tex_unit, pname - GL_OPERAND0_RGB, GL_FALSE, param)) {
+				SET_GL_ERROR(GL_INVALID_ENUM)
+			}
+			break;
+		case GL_OPERAND0_ALPHA:
+		case GL_OPERAND1_ALPHA:
+		case GL_OPERAND2_ALPHA:
+			if (!set_combine_operand(tex_unit, pname - GL_OPERAND0_ALPHA, GL_TRUE, param)) {
+				SET_GL_ERROR(GL_INVALID_ENUM)
+			}
+			break;
+		case GL_RGB_SCALE:
+		case GL_ALPHA_SCALE:
+			glTexEnvf(target, pname, (GLfloat)param);
+			break;
 		default:
 			SET_GL_ERROR(GL_INVALID_ENUM)
 			break;
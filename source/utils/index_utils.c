@@ -0,0 +1,194 @@
+/*
+ * This file is part of vitaGL
+ * Copyright 2017, 2018, 2019, 2020 Rinnegatamante
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * index_utils.c:
+ * Utilities for index buffers operations
+ */
+
+#include "../shared.h"
+#include <math.h>
+
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_TRI_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+// Vertex data used during indices optimization
+typedef struct {
+	int32_t cache_pos; // Position in simulated LRU cache (-1 if not in cache)
+	uint32_t tris_start; // First adjacent triangle in adjacency list
+	uint32_t tris_left; // Number of adjacent triangles not emitted yet
+	float score; // Current vertex score
+} opt_vertex;
+
+static float vertex_score(opt_vertex *v) {
+	if (!v->tris_left)
+		return -1.0f;
+
+	float score = 0.0f;
+	if (v->cache_pos >= 0) {
+		if (v->cache_pos < 3) // Vertices of last emitted triangle get a fixed score
+			score = LAST_TRI_SCORE;
+		else {
+			float scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
+			score = powf(1.0f - (v->cache_pos - 3) * scaler, CACHE_DECAY_POWER);
+		}
+	}
+
+	// Boosting vertices with few triangles left to get rid of lone triangles sooner
+	return score + VALENCE_BOOST_SCALE * powf((float)v->tris_left, -VALENCE_BOOST_POWER);
+}
+
+int optimize_triangle_indices(uint16_t *indices, uint32_t count) {
+	uint32_t tris_num = count / 3;
+	uint32_t i, j;
+	if (tris_num < 2)
+		return 1;
+
+	uint32_t verts_num = 0;
+	for (i = 0; i < tris_num * 3; i++) {
+		if (indices[i] >= verts_num)
+			verts_num = indices[i] + 1;
+	}
+
+	// Allocating all the scratch memory with a single request
+	size_t scratch_size = verts_num * sizeof(opt_vertex) + tris_num * 3 * sizeof(uint32_t) + tris_num + tris_num * 3 * sizeof(uint16_t);
+	uint8_t *scratch = (uint8_t *)malloc(scratch_size);
+	if (!scratch)
+		return 0;
+	opt_vertex *verts = (opt_vertex *)scratch;
+	uint32_t *adjacency = (uint32_t *)&verts[verts_num];
+	uint16_t *out = (uint16_t *)&adjacency[tris_num * 3];
+	uint8_t *tri_added = (uint8_t *)&out[tris_num * 3];
+
+	// Building vertex to triangles adjacency
+	memset(verts, 0, verts_num * sizeof(opt_vertex));
+	for (i = 0; i < tris_num * 3; i++) {
+		verts[indices[i]].tris_left++;
+	}
+	uint32_t offs = 0;
+	for (i = 0; i < verts_num; i++) {
+		verts[i].tris_start = offs;
+		offs += verts[i].tris_left;
+		verts[i].tris_left = 0;
+		verts[i].cache_pos = -1;
+	}
+	for (i = 0; i < tris_num * 3; i++) {
+		opt_vertex *v = &verts[indices[i]];
+		adjacency[v->tris_start + v->tris_left++] = i / 3;
+	}
+	for (i = 0; i < verts_num; i++) {
+		verts[i].score = vertex_score(&verts[i]);
+	}
+	memset(tri_added, 0, tris_num);
+
+	int32_t cache[VERTEX_CACHE_SIZE + 3];
+	int32_t cache_num = 0;
+	int32_t best_tri = -1;
+	uint32_t scan_pos = 0;
+	uint32_t emitted;
+	for (emitted = 0; emitted < tris_num; emitted++) {
+		// If no candidate comes from the cache, falling back to the first triangle not emitted yet
+		if (best_tri < 0) {
+			while (tri_added[scan_pos])
+				scan_pos++;
+			best_tri = scan_pos;
+		}
+
+		// Emitting best triangle and removing it from its vertices adjacency
+		tri_added[best_tri] = 1;
+		int32_t new_cache[VERTEX_CACHE_SIZE + 3];
+		int32_t new_cache_num = 0;
+		for (i = 0; i < 3; i++) {
+			uint16_t idx = indices[best_tri * 3 + i];
+			opt_vertex *v = &verts[idx];
+			out[emitted * 3 + i] = idx;
+			uint32_t *adj = &adjacency[v->tris_start];
+			for (j = 0; j < v->tris_left; j++) {
+				if (adj[j] == best_tri) {
+					adj[j] = adj[v->tris_left - 1];
+					break;
+				}
+			}
+			v->tris_left--;
+			new_cache[new_cache_num++] = idx;
+		}
+
+		// Updating simulated LRU cache with emitted vertices on top
+		for (i = 0; i < cache_num; i++) {
+			int32_t idx = cache[i];
+			if (idx != new_cache[0] && idx != new_cache[1] && idx != new_cache[2])
+				new_cache[new_cache_num++] = idx;
+		}
+		for (i = 0; i < new_cache_num; i++) {
+			opt_vertex *v = &verts[new_cache[i]];
+			v->cache_pos = i < VERTEX_CACHE_SIZE ? i : -1;
+			v->score = vertex_score(v);
+		}
+		cache_num = min(new_cache_num, VERTEX_CACHE_SIZE);
+		memcpy(cache, new_cache, cache_num * sizeof(int32_t));
+
+		// Scoring triangles adjacent to cached vertices and picking the best one
+		float best_score = -1.0f;
+		best_tri = -1;
+		for (i = 0; i < new_cache_num; i++) {
+			opt_vertex *v = &verts[new_cache[i]];
+			uint32_t *adj = &adjacency[v->tris_start];
+			for (j = 0; j < v->tris_left; j++) {
+				uint32_t t = adj[j];
+				float score = verts[indices[t * 3]].score + verts[indices[t * 3 + 1]].score + verts[indices[t * 3 + 2]].score;
+				if (score > best_score) {
+					best_score = score;
+					best_tri = t;
+				}
+			}
+		}
+	}
+
+	memcpy(indices, out, tris_num * 3 * sizeof(uint16_t));
+	free(scratch);
+	return 1;
+}
+
+float calc_triangle_indices_acmr(const uint16_t *indices, uint32_t count) {
+	uint32_t tris_num = count / 3;
+	if (!tris_num)
+		return 0.0f;
+
+	// Simulating a FIFO post-transform cache
+	int32_t cache[VERTEX_CACHE_SIZE];
+	uint32_t cache_head = 0;
+	uint32_t misses = 0;
+	uint32_t i, j;
+	for (i = 0; i < VERTEX_CACHE_SIZE; i++) {
+		cache[i] = -1;
+	}
+	for (i = 0; i < tris_num * 3; i++) {
+		for (j = 0; j < VERTEX_CACHE_SIZE; j++) {
+			if (cache[j] == indices[i])
+				break;
+		}
+		if (j == VERTEX_CACHE_SIZE) {
+			misses++;
+			cache[cache_head] = indices[i];
+			cache_head = (cache_head + 1) % VERTEX_CACHE_SIZE;
+		}
+	}
+	return (float)misses / (float)tris_num;
+}
@@ -0,0 +1,35 @@
+/*
+ * This file is part of vitaGL
+ * Copyright 2017, 2018, 2019, 2020 Rinnegatamante
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * index_utils.h:
+ * Header file for the index buffers utilities exposed by index_utils.c
+ */
+
+#ifndef _INDEX_UTILS_H_
+#define _INDEX_UTILS_H_
+
+#define VERTEX_CACHE_SIZE 32 // Simulated post-transform vertex cache size
+
+// Reorders a triangle list for post-transform vertex cache efficiency (Forsyth algorithm)
+int optimize_triangle_indices(uint16_t *indices, uint32_t count);
+
+// Calculates average cache miss ratio (transformed vertices per triangle) for a triangle list
+float calc_triangle_indices_acmr(const uint16_t *indices, uint32_t count);
+
+#endif
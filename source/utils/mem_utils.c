@@ -314,3 +314,13 @@ void *vgl_mem_alloc(size_t size, vglMemType type) {
 size_t vgl_mem_get_free_space(vglMemType type) {
 	return tm_free[type];
 }
+
+// Checks if an address belongs to a mempool and so is accessible by sceGxm
+int vgl_mem_is_mapped(const void *ptr) {
+	uintptr_t addr = (uintptr_t)ptr;
+	for (int i = 0; i < VGL_MEM_TYPE_COUNT - 2; i++) {
+		if (mempool_size[i] && (addr >= (uintptr_t)mempool_addr[i]) && (addr < (uintptr_t)mempool_addr[i] + mempool_size[i]))
+			return 1;
+	}
+	return 0;
+}
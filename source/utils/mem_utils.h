@@ -29,5 +29,6 @@ void vgl_mem_term(void); // Terminate internal mempools
 size_t vgl_mem_get_free_space(vglMemType type); // Return free space in bytes for a mempool
 void *vgl_mem_alloc(size_t size, vglMemType type); // Allocate a memory block on a mempool
 void vgl_mem_free(void *ptr); // Free a memory block on a mempool
+int vgl_mem_is_mapped(const void *ptr); // Check if an address belongs to a mempool
 
 #endif
\ No newline at end of file
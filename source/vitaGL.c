@@ -19,6 +19,7 @@
 /*
  *
  */
+#include <arm_neon.h>
 #include "vitaGL.h"
 #include "shared.h"
 #include "texture_callbacks.h"
@@ -33,6 +34,11 @@
 #include "shaders/texture2d_rgba_f.h"
 #include "shaders/texture2d_rgba_v.h"
 #include "shaders/texture2d_v.h"
+#ifdef HAVE_FFP_PERMUTATIONS
+#define FFP_FRAG_PERMS_NUM 128 // Number of slots for texture2d fragment program permutations
+#define FFP_VERT_PERMS_NUM 4 // Number of slots for texture2d vertex program permutations
+#include "shaders/ffp/texture2d_perm.h"
+#endif
 #if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
 #include "shaders/ffp_v.h"
 #include "shaders/ffp_f.h"
@@ -74,6 +80,7 @@ SceGxmShaderPatcherId rgba_fragment_id;
 const SceGxmProgramParameter *rgba_wvp;
 SceGxmVertexProgram *rgba_vertex_program_patched;
 SceGxmVertexProgram *rgba_u8n_vertex_program_patched;
+SceGxmVertexProgram *rgba_const_vertex_program_patched;
 SceGxmVertexProgram *rgb_vertex_program_patched;
 SceGxmVertexProgram *rgb_u8n_vertex_program_patched;
 SceGxmFragmentProgram *rgba_fragment_program_patched;
@@ -144,6 +151,87 @@ SceGxmVertexProgram *clear_vertex_program_patched; // Patched vertex program for
 vector4f *clear_vertices = NULL; // Memblock starting address for clear screen vertices
 vector3f *depth_vertices = NULL; // Memblock starting address for depth clear screen vertices
 
+// Quads emulation
+static uint16_t *quad_indices = NULL; // Memblock starting address for GL_QUADS indices used by glDrawArrays
+static uint32_t *remap_table = NULL; // Generation-stamped indices remap table used for sparse glDrawElements compaction
+static uint16_t remap_gen = 0; // Current generation for indices remap table
+
+// Vertex program variants for non default vertex layouts
+#define VERTEX_VARIANTS_NUM 32 // Maximum number of cached vertex program variants
+#define VERTEX_VARIANT_STREAMS_NUM 8 // Maximum number of streams per vertex program variant (fixed function pipeline and custom programs)
+typedef struct vertex_variant {
+	SceGxmShaderPatcherId id;
+	stream_layout layouts[VERTEX_VARIANT_STREAMS_NUM];
+	int num;
+	SceGxmVertexProgram *prog;
+	uint32_t refs; // Number of holders currently using the variant
+	uint32_t last_use; // Usage stamp for least recently used eviction
+} vertex_variant;
+static vertex_variant vertex_variants[VERTEX_VARIANTS_NUM];
+static int vertex_variants_num = 0;
+static uint32_t vertex_variants_stamp = 0;
+static uint32_t vertex_variants_gen = 0; // Bumped whenever a vertex variant gets released
+
+// Fragment program variants for non default blend settings
+#define FRAGMENT_VARIANTS_NUM 64 // Maximum number of cached fragment program variants
+typedef struct fragment_variant {
+	SceGxmShaderPatcherId id;
+	blend_config blend;
+	SceGxmMultisampleMode msaa;
+	const SceGxmProgram *vert;
+	SceGxmFragmentProgram *prog;
+	uint32_t refs; // Number of holders currently using the variant
+	uint32_t last_use; // Usage stamp for least recently used eviction
+} fragment_variant;
+static fragment_variant fragment_variants[FRAGMENT_VARIANTS_NUM];
+static int fragment_variants_num = 0;
+static uint32_t fragment_variants_stamp = 0;
+
+// Patched programs and memblocks released while the GPU may still be using them
+#define PENDING_RELEASES_CHUNK_SIZE 32 // Granularity for pending programs releases array growth
+typedef struct pending_release {
+	SceGxmVertexProgram *vprog;
+	SceGxmFragmentProgram *fprog;
+	SceGxmShaderPatcherId id; // Shader program to unregister if no patched program is set
+	void *bin; // Shader program binary to free once unregistered
+	void *mem; // vitaGL mempool memblock to free
+	uint32_t frame; // Frame the program got released during
+} pending_release;
+static pending_release *pending_releases = NULL;
+static int pending_releases_num = 0;
+uint16_t rgba_attr_regs[2]; // Register indices for rgba shader attributes (position, color)
+uint16_t texture2d_attr_regs[2]; // Register indices for texture2d shader attributes (position, texcoord)
+uint16_t texture2d_rgba_attr_regs[3]; // Register indices for texture2d+rgba shader attributes (position, texcoord, color)
+
+#ifdef HAVE_FFP_PERMUTATIONS
+// Precompiled texture2d programs permutations
+typedef enum {
+	PERM_UNREGISTERED,
+	PERM_AVAILABLE,
+	PERM_UNAVAILABLE
+} permState;
+
+typedef struct frag_perm {
+	uint8_t state;
+	SceGxmShaderPatcherId id;
+	SceGxmFragmentProgram *prog;
+	blend_config blend_cfg;
+	GLboolean has_unifs;
+	const SceGxmProgramParameter *unifs[TEX2D_UNIFS_NUM];
+	const SceGxmProgramParameter *tint_color;
+} frag_perm;
+
+typedef struct vert_perm {
+	uint8_t state;
+	SceGxmShaderPatcherId id;
+	uint16_t attr_regs[3];
+	const SceGxmProgramParameter *unifs[TEX2D_UNIFS_NUM];
+} vert_perm;
+
+static frag_perm frag_perms[FFP_FRAG_PERMS_NUM];
+static vert_perm vert_perms[FFP_VERT_PERMS_NUM];
+#endif
+
 // Internal stuffs
 blend_config blend_info; // Current blend info mode
 SceGxmMultisampleMode msaa_mode = SCE_GXM_MULTISAMPLE_NONE;
@@ -158,8 +246,27 @@ static SceGxmBlendFunc blend_func_rgb = SCE_GXM_BLEND_FUNC_ADD; // Current in-us
 static SceGxmBlendFunc blend_func_a = SCE_GXM_BLEND_FUNC_ADD; // Current in-use A blend func
 static int vertex_array_unit = -1; // Current in-use vertex array unit
 static int index_array_unit = -1; // Current in-use index array unit
-
-vector4f texenv_color = { 0.0f, 0.0f, 0.0f, 0.0f }; // Current in use texture environment color
+static int uniform_buffer_unit = -1; // Current in-use uniform buffer unit
+// Vertex array object struct
+typedef struct vertex_array_object {
+	GLboolean used; // Flag to check if the vertex array object id is reserved
+	GLboolean states[GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS][4]; // Client arrays states per texture unit (vertex, color, texcoord, normal)
+	vertexArray arrays[GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS][4]; // Client arrays per texture unit (vertex, color, texcoord, normal)
+	vertex_attrib attribs[VERTEX_ATTRIBS_NUM]; // Generic vertex attributes
+	int vertex_array_unit; // Buffer unit bound to GL_ARRAY_BUFFER
+	int index_array_unit; // Buffer unit bound to GL_ELEMENT_ARRAY_BUFFER
+	GLboolean cache_valid; // Flag to check if the resolved state below is still valid
+	int8_t cache_client_unit; // Client texture unit the streams layout got resolved for
+	stream_layout layouts[5]; // Resolved streams layout for the fixed function pipeline
+	SceGxmShaderPatcherId vprog_id; // Shader the cached vertex program got patched from
+	stream_layout vprog_layouts[5]; // Streams layout the cached vertex program got patched for
+	SceGxmVertexProgram *vprog; // Cached patched vertex program (NULL if none)
+	uint32_t vprog_gen; // Vertex variants generation the cached vertex program belongs to
+} vertex_array_object;
+
+static vertex_array_object vaos[VERTEX_ARRAYS_NUM + 1]; // Vertex array objects array (first slot holds default state)
+static vertex_array_object *cur_vao = &vaos[0]; // Current in-use vertex array object
+static int uniform_buffer_bindings[UNIFORM_BUFFER_BINDINGS_NUM] = {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1}; // Buffer units bound to uniform buffer binding points
 
 // Internal functions
 
@@ -197,7 +304,7 @@ void upload_tex2d_uniforms(const SceGxmProgramParameter *unifs[]) {
 	sceGxmSetUniformDataF(fbuffer, unifs[TEX2D_TEX_ENV_MODE_UNIF], 0, 1, &env_mode);
 	sceGxmSetUniformDataF(fbuffer, unifs[TEX2D_FOG_MODE_UNIF], 0, 1, &fogmode);
 	sceGxmSetUniformDataF(fbuffer, unifs[TEX2D_FOG_COLOR_UNIF], 0, 4, &fog_color.r);
-	sceGxmSetUniformDataF(fbuffer, unifs[TEX2D_TEX_ENV_COLOR_UNIF], 0, 4, &texenv_color.r);
+	sceGxmSetUniformDataF(fbuffer, unifs[TEX2D_TEX_ENV_COLOR_UNIF], 0, 4, &tex_unit->env_color.r);
 	sceGxmSetUniformDataF(fbuffer, unifs[TEX2D_FOG_NEAR_UNIF], 0, 1, (const float *)&fog_near);
 	sceGxmSetUniformDataF(fbuffer, unifs[TEX2D_FOG_FAR_UNIF], 0, 1, (const float *)&fog_far);
 	sceGxmSetUniformDataF(fbuffer, unifs[TEX2D_FOG_DENSITY_UNIF], 0, 1, (const float *)&fog_density);
@@ -211,39 +318,325 @@ void upload_tex2d_uniforms(const SceGxmProgramParameter *unifs[]) {
 	sceGxmSetUniformDataF(vbuffer, unifs[TEX2D_MODELVIEW_UNIF], 0, 16, (const float *)modelview_matrix);
 }
 
+vector4f *upload_const_color(void) {
+	vector4f *color = (vector4f *)gpu_pool_memalign(sizeof(vector4f), sizeof(vector4f));
+	memcpy_neon(color, &current_color.r, sizeof(vector4f));
+	return color;
+}
+
+uint8_t gl_type_to_gxm_attrib_format(GLenum type, GLboolean normalized) {
+	switch (type) {
+	case GL_BYTE:
+		return normalized ? SCE_GXM_ATTRIBUTE_FORMAT_S8N : SCE_GXM_ATTRIBUTE_FORMAT_S8;
+	case GL_UNSIGNED_BYTE:
+		return normalized ? SCE_GXM_ATTRIBUTE_FORMAT_U8N : SCE_GXM_ATTRIBUTE_FORMAT_U8;
+	case GL_SHORT:
+		return normalized ? SCE_GXM_ATTRIBUTE_FORMAT_S16N : SCE_GXM_ATTRIBUTE_FORMAT_S16;
+	case GL_UNSIGNED_SHORT:
+		return normalized ? SCE_GXM_ATTRIBUTE_FORMAT_U16N : SCE_GXM_ATTRIBUTE_FORMAT_U16;
+	case GL_HALF_FLOAT:
+		return SCE_GXM_ATTRIBUTE_FORMAT_F16;
+	default:
+		return SCE_GXM_ATTRIBUTE_FORMAT_F32;
+	}
+}
+
+stream_layout get_array_layout(vertexArray *array, GLboolean normalized, GLboolean is_mapped) {
+	stream_layout res;
+	res.format = gl_type_to_gxm_attrib_format(array->type, normalized);
+	res.num = array->num;
+	res.index_source = SCE_GXM_INDEX_SOURCE_INDEX_16BIT;
+	
+	// Client arrays are packed when copied on vitaGL mempool
+	res.stride = (is_mapped && array->stride) ? array->stride : array->size * array->num;
+	return res;
+}
+
+static pending_release *queue_release(void) {
+	// Draws of the current frame or of frames still processed by the GPU may be using the program
+	if (!(pending_releases_num % PENDING_RELEASES_CHUNK_SIZE)) {
+		pending_release *r = (pending_release *)realloc(pending_releases, (pending_releases_num + PENDING_RELEASES_CHUNK_SIZE) * sizeof(pending_release));
+		if (!r)
+			return NULL;
+		pending_releases = r;
+	}
+	pending_release *r = &pending_releases[pending_releases_num++];
+	r->vprog = NULL;
+	r->fprog = NULL;
+	r->id = NULL;
+	r->bin = NULL;
+	r->mem = NULL;
+	r->frame = get_current_frame();
+	return r;
+}
+
+void queue_program_release(SceGxmVertexProgram *vprog, SceGxmFragmentProgram *fprog) {
+	// Programs failed to be patched have nothing to release
+	if (!vprog && !fprog)
+		return;
+	pending_release *r = queue_release();
+	if (r) {
+		r->vprog = vprog;
+		r->fprog = fprog;
+	}
+}
+
+void queue_program_unregister(SceGxmShaderPatcherId id, void *bin) {
+	// Queued after the releases of its patched programs, so it gets processed after them
+	pending_release *r = queue_release();
+	if (r) {
+		r->id = id;
+		r->bin = bin;
+	}
+}
+
+void queue_mem_free(void *mem) {
+	pending_release *r = queue_release();
+	if (r)
+		r->mem = mem;
+}
+
+void release_pending_programs(GLboolean all) {
+	// Releases are queued in frames order, so we can stop at the first one of a frame not yet completed
+	int i, num = 0;
+	for (i = 0; i < pending_releases_num; i++) {
+		pending_release *r = &pending_releases[i];
+		if (!all && !is_frame_completed(r->frame))
+			break;
+		if (r->vprog)
+			sceGxmShaderPatcherReleaseVertexProgram(gxm_shader_patcher, r->vprog);
+		else if (r->fprog)
+			sceGxmShaderPatcherReleaseFragmentProgram(gxm_shader_patcher, r->fprog);
+		else if (r->mem)
+			vgl_mem_free(r->mem);
+		else {
+			sceGxmShaderPatcherForceUnregisterProgram(gxm_shader_patcher, r->id);
+			free(r->bin);
+		}
+		num++;
+	}
+	pending_releases_num -= num;
+	memmove(pending_releases, &pending_releases[num], pending_releases_num * sizeof(pending_release));
+	if (!pending_releases_num) {
+		free(pending_releases);
+		pending_releases = NULL;
+	}
+}
+
+static vertex_variant *find_vertex_variant(SceGxmVertexProgram *prog) {
+	int i;
+	for (i = 0; i < vertex_variants_num; i++) {
+		if (vertex_variants[i].prog == prog)
+			return &vertex_variants[i];
+	}
+	return NULL;
+}
+
+SceGxmVertexProgram *get_vertex_program_variant(SceGxmShaderPatcherId id, const uint16_t *regs, const stream_layout *layouts, int num) {
+	// Looking for an already patched variant while keeping track of the best eviction candidate
+	int i;
+	vertex_variant *victim = NULL;
+	for (i = 0; i < vertex_variants_num; i++) {
+		vertex_variant *v = &vertex_variants[i];
+		if ((v->id == id) && (v->num == num) && !memcmp(v->layouts, layouts, num * sizeof(stream_layout))) {
+			v->last_use = ++vertex_variants_stamp;
+			return v->prog;
+		}
+		if (!v->refs && (!victim || (v->last_use < victim->last_use)))
+			victim = v;
+	}
+	
+	// Setting up attributes and streams for the requested layout
+	SceGxmVertexAttribute attributes[VERTEX_VARIANT_STREAMS_NUM];
+	SceGxmVertexStream streams[VERTEX_VARIANT_STREAMS_NUM];
+	for (i = 0; i < num; i++) {
+		attributes[i].streamIndex = i;
+		attributes[i].offset = 0;
+		attributes[i].format = layouts[i].format;
+		attributes[i].componentCount = layouts[i].num;
+		attributes[i].regIndex = regs[i];
+		streams[i].stride = layouts[i].stride;
+		streams[i].indexSource = layouts[i].index_source;
+	}
+	SceGxmVertexProgram *prog = NULL;
+	if (sceGxmShaderPatcherCreateVertexProgram(gxm_shader_patcher, id, attributes, num, streams, num, &prog) < 0)
+		return NULL;
+	
+	// Recycling least recently used unreferenced variant if the cache is full
+	vertex_variant *v;
+	if (vertex_variants_num < VERTEX_VARIANTS_NUM)
+		v = &vertex_variants[vertex_variants_num++];
+	else if (victim) {
+		queue_program_release(victim->prog, NULL);
+		vertex_variants_gen++;
+		v = victim;
+	} else {
+		// Every variant is held, the program is left uncached and lives only for the current frame
+		queue_program_release(prog, NULL);
+		vertex_variants_gen++;
+		return prog;
+	}
+	
+	v->id = id;
+	v->num = num;
+	for (i = 0; i < num; i++) {
+		v->layouts[i].raw = layouts[i].raw;
+	}
+	v->prog = prog;
+	v->refs = 0;
+	v->last_use = ++vertex_variants_stamp;
+	return prog;
+}
+
+static GLboolean hold_vertex_program_variant(SceGxmVertexProgram *prog) {
+	vertex_variant *v = find_vertex_variant(prog);
+	if (!v)
+		return GL_FALSE;
+	v->refs++;
+	return GL_TRUE;
+}
+
+static void release_vertex_program_variant(SceGxmVertexProgram *prog) {
+	// Cached variants are kept alive until recycled
+	vertex_variant *v = find_vertex_variant(prog);
+	if (v && v->refs)
+		v->refs--;
+}
+
+static SceGxmFragmentProgram *acquire_fragment_program_variant(SceGxmShaderPatcherId id, const SceGxmProgram *vert) {
+	// Looking for an already patched variant while keeping track of the best eviction candidate
+	int i;
+	fragment_variant *victim = NULL;
+	for (i = 0; i < fragment_variants_num; i++) {
+		fragment_variant *f = &fragment_variants[i];
+		if ((f->id == id) && (f->blend.raw == blend_info.raw) && (f->msaa == msaa_mode) && (f->vert == vert)) {
+			f->refs++;
+			f->last_use = ++fragment_variants_stamp;
+			return f->prog;
+		}
+		if (!f->refs && (!victim || (f->last_use < victim->last_use)))
+			victim = f;
+	}
+	
+	SceGxmFragmentProgram *prog = NULL;
+	if (sceGxmShaderPatcherCreateFragmentProgram(gxm_shader_patcher,
+		id, SCE_GXM_OUTPUT_REGISTER_FORMAT_UCHAR4,
+		msaa_mode,
+		&blend_info.info,
+		vert, &prog) < 0)
+		return NULL;
+	
+	// Recycling least recently used unreferenced variant if the cache is full, if every variant is in use the program is left uncached
+	fragment_variant *f;
+	if (fragment_variants_num < FRAGMENT_VARIANTS_NUM)
+		f = &fragment_variants[fragment_variants_num++];
+	else if (victim) {
+		// Unreferenced variants may still be used by draws the GPU is not done with
+		queue_program_release(NULL, victim->prog);
+		f = victim;
+	} else
+		return prog;
+	
+	f->id = id;
+	f->blend.raw = blend_info.raw;
+	f->msaa = msaa_mode;
+	f->vert = vert;
+	f->prog = prog;
+	f->refs = 1;
+	f->last_use = ++fragment_variants_stamp;
+	return prog;
+}
+
+void release_fragment_program_variant(SceGxmFragmentProgram *prog) {
+	// Cached variants are kept alive until recycled
+	int i;
+	for (i = 0; i < fragment_variants_num; i++) {
+		if (fragment_variants[i].prog == prog) {
+			if (fragment_variants[i].refs)
+				fragment_variants[i].refs--;
+			return;
+		}
+	}
+	queue_program_release(NULL, prog);
+}
+
+void release_program_variants(SceGxmShaderPatcherId id) {
+	int i, num = 0;
+	for (i = 0; i < vertex_variants_num; i++) {
+		vertex_variant *v = &vertex_variants[i];
+		if (v->id == id)
+			queue_program_release(v->prog, NULL);
+		else
+			vertex_variants[num++] = *v;
+	}
+	if (num != vertex_variants_num)
+		vertex_variants_gen++;
+	vertex_variants_num = num;
+	
+	num = 0;
+	for (i = 0; i < fragment_variants_num; i++) {
+		fragment_variant *f = &fragment_variants[i];
+		if (f->id == id)
+			queue_program_release(NULL, f->prog);
+		else
+			fragment_variants[num++] = *f;
+	}
+	fragment_variants_num = num;
+}
+
 #if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
-#define SHADER_CACHE_SIZE 64
+#define FFP_CACHE_BUCKETS_NUM 64 // Number of buckets for the fixed function pipeline shaders cache lookup table
+#define FFP_CACHE_DEFAULT_SIZE 64 // Default max number of cached fixed function pipeline shaders
+#define FFP_CACHE_FRAGMENT_KEY 0x80000000 // Cache key flag for fragment shaders
+#define FFP_STATES_MAGIC 0x53464756 // Recorded fixed function pipeline states file magic ('VGFS')
+#define FFP_STATES_VERSION 3 // Recorded fixed function pipeline states file format version
+#define FFP_STATES_CHUNK_SIZE 32 // Granularity for recorded fixed function pipeline states array growth
 
 typedef union shader_mask {
+	// Shared by vertex and fragment shaders
 	struct {
-		uint32_t texenv_mode : 2;
-		uint32_t alpha_test_mode : 3;
 		uint32_t has_texture : 1;
 		uint32_t has_colors : 1;
+		uint32_t has_texture1 : 1;
+		uint32_t UNUSED : 29;
+	};
+	// Fragment shaders only
+	struct {
+		uint32_t : 3;
+		uint32_t texenv_mode : 3;
+		uint32_t alpha_test_mode : 3;
 		uint32_t fog_mode : 2;
-		uint32_t UNUSED : 23;
+		uint32_t combine_rgb : 3;
+		uint32_t combine_alpha : 3;
+		uint32_t texenv_mode1 : 3;
+		uint32_t combine_rgb1 : 3;
+		uint32_t combine_alpha1 : 3;
+	};
+	// Vertex shaders only
+	struct {
+		uint32_t : 3;
+		uint32_t clip_plane : 1;
+		uint32_t lights_num : 3;
+		uint32_t color_material : 3;
+		uint32_t has_normals : 1;
 	};
 	uint32_t raw;
 } shader_mask;
 
-typedef struct {
-	SceGxmProgram *frag;
-	SceGxmProgram *vert;
-	SceGxmShaderPatcherId frag_id;
-	SceGxmShaderPatcherId vert_id;
-	shader_mask mask;
-} cached_shader;
-cached_shader shader_cache[SHADER_CACHE_SIZE];
-uint8_t shader_cache_size = 0;
-int shader_cache_idx = -1;
-
-#define VERTEX_UNIFORMS_NUM 3
-#define FRAGMENT_UNIFORMS_NUM 7
+#define VERTEX_UNIFORMS_NUM 10
+#define FRAGMENT_UNIFORMS_NUM 10
 
 typedef enum {
 	CLIP_PLANE_EQUATION_UNIF,
 	MODELVIEW_MATRIX_UNIF,
-	WVP_MATRIX_UNIF
+	WVP_MATRIX_UNIF,
+	NORMAL_MATRIX_UNIF,
+	LIGHTS_UNIF,
+	LIGHT_MODEL_AMBIENT_UNIF,
+	MATERIAL_UNIF,
+	SHININESS_UNIF,
+	CUR_COLOR_UNIF,
+	CUR_NORMAL_UNIF
 } vert_uniform_type;
 
 typedef enum {
@@ -253,23 +646,58 @@ typedef enum {
 	TINT_COLOR_UNIF,
 	FOG_NEAR_UNIF,
 	FOG_FAR_UNIF,
-	FOG_DENSITY_UNIF
+	FOG_DENSITY_UNIF,
+	TEX_ENV_COLOR1_UNIF,
+	COMBINE_CFG_UNIF,
+	COMBINE_CFG1_UNIF
 } frag_uniform_type;
 
+// Fixed function pipeline shaders cache entry struct
+typedef struct cached_shader {
+	uint32_t key; // Shader mask, with FFP_CACHE_FRAGMENT_KEY set for fragment shaders
+	SceGxmProgram *prog; // Compiled program (NULL if compilation failed or is still pending)
+	SceGxmShaderPatcherId id; // sceGxmShaderPatcher id for the compiled program
+	shader_job *job; // Pending asynchronous compilation job (NULL if none)
+	const SceGxmProgramParameter *params[max(VERTEX_UNIFORMS_NUM, FRAGMENT_UNIFORMS_NUM)]; // Uniforms available in the program
+	SceGxmFragmentProgram *patched; // Patched fragment program for last used blend settings
+	blend_config patched_cfg; // Blend settings of the patched fragment program
+	uint16_t attr_regs[5]; // Register indices for vertex attributes
+	uint8_t attr_streams[5]; // Streams layout index for vertex attributes
+	uint8_t num_params; // Number of vertex attributes
+	struct cached_shader *bucket_next; // Next entry in the same lookup table bucket
+	struct cached_shader *lru_prev; // More recently used entry
+	struct cached_shader *lru_next; // Less recently used entry
+} cached_shader;
+
+static cached_shader *shader_cache[FFP_CACHE_BUCKETS_NUM]; // Lookup table
+static cached_shader *shader_cache_head = NULL; // Most recently used entry
+static cached_shader *shader_cache_tail = NULL; // Least recently used entry
+static uint32_t shader_cache_size = 0; // Current number of cached shaders
+static uint32_t shader_cache_capacity = FFP_CACHE_DEFAULT_SIZE; // Max number of cached shaders
+static uint32_t shader_cache_hits = 0; // Number of shader lookups served from the cache
+static uint32_t shader_cache_misses = 0; // Number of shader lookups that required a compilation
+static uint64_t shader_cache_compile_time = 0; // Total time in microseconds the rendering thread spent compiling shaders
+static cached_shader *ffp_vert_entry = NULL; // Cache entry for current vertex shader
+static cached_shader *ffp_frag_entry = NULL; // Cache entry for current fragment shader
+static char *ffp_states_path = NULL; // Output file for recorded fixed function pipeline states (NULL if not recording)
+static vglFFPState *ffp_states = NULL; // Recorded fixed function pipeline states
+static uint32_t ffp_states_num = 0; // Number of recorded fixed function pipeline states
+static vglFFPState ffp_last_vert_state; // Last recorded vertex shader state
+static vglFFPState ffp_last_frag_state; // Last recorded fragment shader state
+static GLboolean ffp_has_texture1 = GL_FALSE; // Whether current fixed function pipeline shaders sample the second texture unit
+static GLboolean ffp_has_normals = GL_FALSE; // Whether current fixed function pipeline shaders read normals from a vertex array
+static uint8_t ffp_stream_idx[5]; // Vertex stream index for position, texcoord, color, texcoord1 and normal attributes
+static matrix4x4 normal_matrix; // Inverse transpose of the modelview matrix used for normals transformation
+static matrix4x4 normal_matrix_src; // Modelview matrix normal_matrix has been calculated from
+
 uint8_t ffp_vertex_num_params = 1;
 const SceGxmProgramParameter *ffp_vertex_params[VERTEX_UNIFORMS_NUM];
 const SceGxmProgramParameter *ffp_fragment_params[FRAGMENT_UNIFORMS_NUM];
-SceGxmShaderPatcherId ffp_vertex_program_id;
-SceGxmShaderPatcherId ffp_fragment_program_id;
-SceGxmProgram *ffp_fragment_program = NULL;
-SceGxmProgram *ffp_vertex_program = NULL;
 SceGxmVertexProgram *ffp_vertex_program_patched; // Patched vertex program for the fixed function pipeline implementation
 SceGxmFragmentProgram *ffp_fragment_program_patched; // Patched fragment program for the fixed function pipeline implementation
 GLboolean ffp_dirty_frag = GL_TRUE;
 GLboolean ffp_dirty_vert = GL_TRUE;
 GLboolean ffp_dirty_vert_stream = GL_TRUE;
-blend_config ffp_blend_info;
-shader_mask ffp_mask = {.raw = 0};
 
 static void upload_ffp_uniforms() {
 	void *fbuffer, *vbuffer;
@@ -278,7 +706,10 @@ static void upload_ffp_uniforms() {
 	sceGxmReserveFragmentDefaultUniformBuffer(gxm_context, &fbuffer);
 	if (ffp_fragment_params[ALPHA_CUT_UNIF]) sceGxmSetUniformDataF(fbuffer, ffp_fragment_params[ALPHA_CUT_UNIF], 0, 1, &alpha_ref);
 	if (ffp_fragment_params[FOG_COLOR_UNIF]) sceGxmSetUniformDataF(fbuffer, ffp_fragment_params[FOG_COLOR_UNIF], 0, 4, &fog_color.r);
-	if (ffp_fragment_params[TEX_ENV_COLOR_UNIF]) sceGxmSetUniformDataF(fbuffer, ffp_fragment_params[TEX_ENV_COLOR_UNIF], 0, 4, &texenv_color.r);
+	if (ffp_fragment_params[TEX_ENV_COLOR_UNIF]) sceGxmSetUniformDataF(fbuffer, ffp_fragment_params[TEX_ENV_COLOR_UNIF], 0, 4, &texture_units[0].env_color.r);
+	if (ffp_fragment_params[TEX_ENV_COLOR1_UNIF]) sceGxmSetUniformDataF(fbuffer, ffp_fragment_params[TEX_ENV_COLOR1_UNIF], 0, 4, &texture_units[1].env_color.r);
+	if (ffp_fragment_params[COMBINE_CFG_UNIF]) sceGxmSetUniformDataF(fbuffer, ffp_fragment_params[COMBINE_CFG_UNIF], 0, 36, (const float *)texture_units[0].combine_cfg);
+	if (ffp_fragment_params[COMBINE_CFG1_UNIF]) sceGxmSetUniformDataF(fbuffer, ffp_fragment_params[COMBINE_CFG1_UNIF], 0, 36, (const float *)texture_units[1].combine_cfg);
 	if (ffp_fragment_params[TINT_COLOR_UNIF]) sceGxmSetUniformDataF(fbuffer, ffp_fragment_params[TINT_COLOR_UNIF], 0, 4, &current_color.r);
 	if (ffp_fragment_params[FOG_NEAR_UNIF]) sceGxmSetUniformDataF(fbuffer, ffp_fragment_params[FOG_NEAR_UNIF], 0, 1, (const float *)&fog_near);
 	if (ffp_fragment_params[FOG_FAR_UNIF]) sceGxmSetUniformDataF(fbuffer, ffp_fragment_params[FOG_FAR_UNIF], 0, 1, (const float *)&fog_far);
@@ -289,183 +720,417 @@ static void upload_ffp_uniforms() {
 	if (ffp_vertex_params[CLIP_PLANE_EQUATION_UNIF]) sceGxmSetUniformDataF(vbuffer, ffp_vertex_params[CLIP_PLANE_EQUATION_UNIF], 0, 4, &clip_plane0_eq.x);
 	if (ffp_vertex_params[MODELVIEW_MATRIX_UNIF]) sceGxmSetUniformDataF(vbuffer, ffp_vertex_params[MODELVIEW_MATRIX_UNIF], 0, 16, (const float *)modelview_matrix);
 	if (ffp_vertex_params[WVP_MATRIX_UNIF]) sceGxmSetUniformDataF(vbuffer, ffp_vertex_params[WVP_MATRIX_UNIF], 0, 16, (const float *)mvp_matrix);
+	
+	// Uploading lighting uniforms, if used
+	if (ffp_vertex_params[LIGHTS_UNIF]) {
+		if (memcmp(normal_matrix_src, modelview_matrix, sizeof(matrix4x4))) {
+			matrix4x4 inverted;
+			matrix4x4_copy(normal_matrix_src, modelview_matrix);
+			matrix4x4_invert(inverted, modelview_matrix);
+			matrix4x4_transpose(normal_matrix, inverted);
+		}
+		
+		// Enabled light sources are packed at the start of the lights array
+		light_source enabled_lights[MAX_LIGHTS_NUM];
+		int i, num = 0;
+		for (i = 0; i < MAX_LIGHTS_NUM; i++) {
+			if (lights_mask & (1 << i))
+				enabled_lights[num++] = lights[i];
+		}
+		sceGxmSetUniformDataF(vbuffer, ffp_vertex_params[NORMAL_MATRIX_UNIF], 0, 16, (const float *)normal_matrix);
+		sceGxmSetUniformDataF(vbuffer, ffp_vertex_params[LIGHTS_UNIF], 0, num * (sizeof(light_source) / sizeof(float)), (const float *)enabled_lights);
+		sceGxmSetUniformDataF(vbuffer, ffp_vertex_params[LIGHT_MODEL_AMBIENT_UNIF], 0, 4, &light_model_ambient.r);
+		sceGxmSetUniformDataF(vbuffer, ffp_vertex_params[MATERIAL_UNIF], 0, 16, &material_colors[0].r);
+		sceGxmSetUniformDataF(vbuffer, ffp_vertex_params[SHININESS_UNIF], 0, 1, &material_shininess);
+		if (ffp_vertex_params[CUR_COLOR_UNIF]) sceGxmSetUniformDataF(vbuffer, ffp_vertex_params[CUR_COLOR_UNIF], 0, 4, &current_color.r);
+		if (ffp_vertex_params[CUR_NORMAL_UNIF]) sceGxmSetUniformDataF(vbuffer, ffp_vertex_params[CUR_NORMAL_UNIF], 0, 3, &current_normal.x);
+	}
 }
 
-static void reload_ffp_shaders() {
-	texture_unit *tex_unit = &texture_units[client_texture_unit];
-	int texture2d_idx = tex_unit->tex_id;
+static uint32_t shader_cache_bucket(uint32_t key) {
+	key ^= key >> 16;
+	key *= 0x85EBCA6B;
+	key ^= key >> 13;
+	return key & (FFP_CACHE_BUCKETS_NUM - 1);
+}
+
+static void shader_cache_unlink(cached_shader *e) {
+	if (e->lru_prev)
+		e->lru_prev->lru_next = e->lru_next;
+	else
+		shader_cache_head = e->lru_next;
+	if (e->lru_next)
+		e->lru_next->lru_prev = e->lru_prev;
+	else
+		shader_cache_tail = e->lru_prev;
+}
+
+static void shader_cache_push_front(cached_shader *e) {
+	e->lru_prev = NULL;
+	e->lru_next = shader_cache_head;
+	if (shader_cache_head)
+		shader_cache_head->lru_prev = e;
+	else
+		shader_cache_tail = e;
+	shader_cache_head = e;
+}
+
+static void shader_cache_release(cached_shader *e) {
+	cached_shader **p = &shader_cache[shader_cache_bucket(e->key)];
+	while (*p != e)
+		p = &(*p)->bucket_next;
+	*p = e->bucket_next;
+	shader_cache_unlink(e);
 	
-	// Checking if mask changed
-	uint8_t ffp_dirty_frag_blend = GL_FALSE;
-	shader_mask mask = {.raw = 0};
-	mask.texenv_mode = tex_unit->env_mode;
-	mask.alpha_test_mode = alpha_op;
-	mask.has_texture = tex_unit->texture_array_state;
-	mask.has_colors = tex_unit->color_array_state;
-	mask.fog_mode = internal_fog_mode;
-	if (ffp_mask.raw == mask.raw) { // Fixed function pipeline config didn't change
-		ffp_dirty_vert = GL_FALSE;
-		ffp_dirty_frag = GL_FALSE;
+	// Force unregistering releases every patched program created from the entry as well, so it waits for the GPU too
+	if (e->job) {
+		uint32_t size;
+		free(finish_shader_job(e->job, &size, NULL));
+	} else if (e->prog) {
+		release_program_variants(e->id);
+		queue_program_unregister(e->id, e->prog);
+	}
+	free(e);
+	shader_cache_size--;
+}
+
+static void shader_cache_trim(uint32_t capacity) {
+	// Evicting least recently used entries, in use, pending and just compiled shaders are never evicted
+	cached_shader *e = shader_cache_tail;
+	while ((shader_cache_size > capacity) && e) {
+		cached_shader *prev = e->lru_prev;
+		if ((e != ffp_vert_entry) && (e != ffp_frag_entry) && (e != shader_cache_head) && !e->job)
+			shader_cache_release(e);
+		e = prev;
+	}
+}
+
+static void setup_ffp_shader(cached_shader *e) {
+	if (!e->prog)
+		return;
+	sceGxmShaderPatcherRegisterProgram(gxm_shader_patcher, e->prog, &e->id);
+	
+	// Checking for existing uniforms in the shader
+	if (e->key & FFP_CACHE_FRAGMENT_KEY) {
+		e->params[ALPHA_CUT_UNIF] = sceGxmProgramFindParameterByName(e->prog, "alphaCut");
+		e->params[FOG_COLOR_UNIF] = sceGxmProgramFindParameterByName(e->prog, "fogColor");
+		e->params[TEX_ENV_COLOR_UNIF] = sceGxmProgramFindParameterByName(e->prog, "texEnvColor");
+		e->params[TINT_COLOR_UNIF] = sceGxmProgramFindParameterByName(e->prog, "tintColor");
+		e->params[FOG_NEAR_UNIF] = sceGxmProgramFindParameterByName(e->prog, "fog_near");
+		e->params[FOG_FAR_UNIF] = sceGxmProgramFindParameterByName(e->prog, "fog_far");
+		e->params[FOG_DENSITY_UNIF] = sceGxmProgramFindParameterByName(e->prog, "fog_density");
+		e->params[TEX_ENV_COLOR1_UNIF] = sceGxmProgramFindParameterByName(e->prog, "texEnvColor1");
+		e->params[COMBINE_CFG_UNIF] = sceGxmProgramFindParameterByName(e->prog, "combineCfg");
+		e->params[COMBINE_CFG1_UNIF] = sceGxmProgramFindParameterByName(e->prog, "combineCfg1");
 	} else {
+		e->params[CLIP_PLANE_EQUATION_UNIF] = sceGxmProgramFindParameterByName(e->prog, "clip_plane0_eq");
+		e->params[MODELVIEW_MATRIX_UNIF] = sceGxmProgramFindParameterByName(e->prog, "modelview");
+		e->params[WVP_MATRIX_UNIF] = sceGxmProgramFindParameterByName(e->prog, "wvp");
+		e->params[NORMAL_MATRIX_UNIF] = sceGxmProgramFindParameterByName(e->prog, "normal_mat");
+		e->params[LIGHTS_UNIF] = sceGxmProgramFindParameterByName(e->prog, "lights");
+		e->params[LIGHT_MODEL_AMBIENT_UNIF] = sceGxmProgramFindParameterByName(e->prog, "lightModelAmbient");
+		e->params[MATERIAL_UNIF] = sceGxmProgramFindParameterByName(e->prog, "material");
+		e->params[SHININESS_UNIF] = sceGxmProgramFindParameterByName(e->prog, "shininess");
+		e->params[CUR_COLOR_UNIF] = sceGxmProgramFindParameterByName(e->prog, "curColor");
+		e->params[CUR_NORMAL_UNIF] = sceGxmProgramFindParameterByName(e->prog, "curNormal");
+		
+		// Checking for existing vertex attributes in the shader, streams are packed in position, texcoord, color, texcoord1, normal order
+		const char *attr_names[5] = {"position", "texcoord", "color", "texcoord1", "normal"};
 		int i;
-		for (i = 0; i < shader_cache_size; i++) {
-			if (shader_cache[i].mask.raw == mask.raw) {
-				ffp_vertex_program = shader_cache[i].vert;
-				ffp_fragment_program = shader_cache[i].frag;
-				ffp_vertex_program_id = shader_cache[i].vert_id;
-				ffp_fragment_program_id = shader_cache[i].frag_id;
-				ffp_dirty_vert_stream = GL_TRUE;
-				ffp_dirty_frag_blend = GL_TRUE;
-				ffp_dirty_vert = GL_FALSE;
-				ffp_dirty_frag = GL_FALSE;
-				break;
+		e->num_params = 0;
+		for (i = 0; i < 5; i++) {
+			const SceGxmProgramParameter *param = sceGxmProgramFindParameterByName(e->prog, attr_names[i]);
+			if (param) {
+				e->attr_regs[e->num_params] = sceGxmProgramParameterGetResourceIndex(param);
+				e->attr_streams[e->num_params++] = i;
 			}
 		}
-		ffp_mask.raw = mask.raw;
 	}
-	
-	uint8_t new_shader_flag = ffp_dirty_vert || ffp_dirty_frag;
+}
 
-	// Checking if vertex shader requires a recompilation
-	if (ffp_dirty_vert) {
-		
-		// Compiling the new shader
-		char vshader[8192];
-		sprintf(vshader, ffp_vert_src, clip_plane0, tex_unit->texture_array_state, tex_unit->color_array_state);
-		uint32_t size = strlen(vshader);
-		SceGxmProgram *t = shark_compile_shader_extended(vshader, &size, SHARK_VERTEX_SHADER, compiler_opts, compiler_fastmath, compiler_fastprecision, compiler_fastint);
-		ffp_vertex_program = (SceGxmProgram*)malloc(size);
-		memcpy_neon((void *)ffp_vertex_program, (void *)t, size);
-		sceGxmShaderPatcherRegisterProgram(gxm_shader_patcher, ffp_vertex_program, &ffp_vertex_program_id);
+static void wait_ffp_shader(cached_shader *e) {
+	if (e->job) {
+		uint32_t size;
+		e->prog = finish_shader_job(e->job, &size, NULL);
+		e->job = NULL;
+		setup_ffp_shader(e);
+	}
+}
+
+static GLboolean is_ffp_shader_ready(cached_shader *e) {
+	// Swapping in asynchronously compiled programs once they're available
+	if (e->job) {
+		if (!is_shader_job_done(e->job))
+			return GL_FALSE;
+		wait_ffp_shader(e);
+	}
+	return e->prog != NULL;
+}
+
+static cached_shader *get_ffp_shader(uint32_t key) {
+	// Looking for an already compiled shader
+	uint32_t bucket = shader_cache_bucket(key);
+	cached_shader *e = shader_cache[bucket];
+	while (e) {
+		if (e->key == key) {
+			shader_cache_unlink(e);
+			shader_cache_push_front(e);
+			shader_cache_hits++;
+			return e;
+		}
+		e = e->bucket_next;
+	}
+	
+	// Compiling the new shader, its source is fully derived from the mask so that states can be precached
+	shader_mask mask = {.raw = key};
+	char shader[8192];
+	shark_type type;
+	if (key & FFP_CACHE_FRAGMENT_KEY) {
+		sprintf(shader, ffp_frag_src, mask.alpha_test_mode, mask.has_texture, mask.has_colors, mask.fog_mode, mask.texenv_mode, mask.combine_rgb, mask.combine_alpha,
+			mask.has_texture1, mask.texenv_mode1, mask.combine_rgb1, mask.combine_alpha1);
+		type = SHARK_FRAGMENT_SHADER;
+	} else {
+		sprintf(shader, ffp_vert_src, mask.clip_plane, mask.has_texture, mask.has_colors, mask.has_texture1, mask.lights_num, mask.color_material, mask.has_normals);
+		type = SHARK_VERTEX_SHADER;
+	}
+	e = (cached_shader *)malloc(sizeof(cached_shader));
+	if (!e)
+		return NULL;
+	e->key = key;
+	e->prog = NULL;
+	e->patched = NULL;
+	shader_cache_misses++;
+	
+	// Queuing compilation on the worker thread if asynchronous compilation is enabled, failed compilations are cached too
+	uint32_t size = strlen(shader);
+	e->job = submit_shader_job(shader, size, type);
+	if (!e->job) {
+		uint64_t start = sceKernelGetProcessTimeWide();
+		e->prog = compile_shader_cached(shader, &size, type);
+		shader_cache_compile_time += sceKernelGetProcessTimeWide() - start;
 		shark_clear_output();
-		
-		// Checking for existing uniforms in the shader
-		ffp_vertex_params[CLIP_PLANE_EQUATION_UNIF] = sceGxmProgramFindParameterByName(ffp_vertex_program, "clip_plane0_eq");
-		ffp_vertex_params[MODELVIEW_MATRIX_UNIF] = sceGxmProgramFindParameterByName(ffp_vertex_program, "modelview");
-		ffp_vertex_params[WVP_MATRIX_UNIF] = sceGxmProgramFindParameterByName(ffp_vertex_program, "wvp");
-		
-		// Clearing dirty flags
-		ffp_dirty_vert = GL_FALSE;
-		ffp_dirty_vert_stream = GL_TRUE;
+		setup_ffp_shader(e);
 	}
 	
-	// Checking if vertex shader requires stream info update
-	if (ffp_dirty_vert_stream) {
+	// Inserting the new entry and evicting least recently used ones if required
+	e->bucket_next = shader_cache[bucket];
+	shader_cache[bucket] = e;
+	shader_cache_push_front(e);
+	shader_cache_size++;
+	shader_cache_trim(shader_cache_capacity);
+	return e;
+}
 
-		// Setting up shader stream info
-		ffp_vertex_num_params = 1;
-		SceGxmVertexAttribute ffp_vertex_attribute[3];
-		SceGxmVertexStream ffp_vertex_stream[3];
-		
-		// Vertex positions
-		const SceGxmProgramParameter *param = sceGxmProgramFindParameterByName(ffp_vertex_program, "position");
-		ffp_vertex_attribute[0].streamIndex = 0;
-		ffp_vertex_attribute[0].offset = 0;
-		ffp_vertex_attribute[0].format = SCE_GXM_ATTRIBUTE_FORMAT_F32;
-		ffp_vertex_attribute[0].componentCount = 3;
-		ffp_vertex_attribute[0].regIndex = sceGxmProgramParameterGetResourceIndex(param);
-		ffp_vertex_stream[0].stride = sizeof(vector3f);
-		ffp_vertex_stream[0].indexSource = SCE_GXM_INDEX_SOURCE_INDEX_16BIT;
-		
-		// Vertex texture coordinates
-		param = sceGxmProgramFindParameterByName(ffp_vertex_program, "texcoord");
-		if (param) {
-			ffp_vertex_attribute[1].streamIndex = 1;
-			ffp_vertex_attribute[1].offset = 0;
-			ffp_vertex_attribute[1].format = SCE_GXM_ATTRIBUTE_FORMAT_F32;
-			ffp_vertex_attribute[1].componentCount = 2;
-			ffp_vertex_attribute[1].regIndex = sceGxmProgramParameterGetResourceIndex(param);
-			ffp_vertex_stream[1].stride = sizeof(vector2f);
-			ffp_vertex_stream[1].indexSource = SCE_GXM_INDEX_SOURCE_INDEX_16BIT;
-			ffp_vertex_num_params++;
+static void record_ffp_state(const vglFFPState *st, vglFFPState *last) {
+	// Skipping lookup when the state didn't change since last draw
+	if (!memcmp(st, last, sizeof(vglFFPState)))
+		return;
+	*last = *st;
+	uint32_t i;
+	for (i = 0; i < ffp_states_num; i++) {
+		if (!memcmp(st, &ffp_states[i], sizeof(vglFFPState)))
+			return;
+	}
+	if (!(ffp_states_num % FFP_STATES_CHUNK_SIZE)) {
+		vglFFPState *states = (vglFFPState *)realloc(ffp_states, (ffp_states_num + FFP_STATES_CHUNK_SIZE) * sizeof(vglFFPState));
+		if (!states)
+			return;
+		ffp_states = states;
+	}
+	ffp_states[ffp_states_num++] = *st;
+}
+
+static void precache_ffp_states(const vglFFPState *states, uint32_t num) {
+	// Queuing all compilations first so that the worker thread, if enabled, can go through them while we patch
+	uint32_t i, j;
+	for (i = 0; i < num; i++) {
+		get_ffp_shader(states[i].shader_mask);
+	}
+	
+	uint32_t blend = blend_info.raw;
+	for (i = 0; i < num; i++) {
+		cached_shader *e = get_ffp_shader(states[i].shader_mask);
+		if (!e)
+			continue;
+		wait_ffp_shader(e);
+		if (!e->prog)
+			continue;
+		if (e->key & FFP_CACHE_FRAGMENT_KEY) {
+			// Patched variant stays cached once released
+			blend_info.raw = states[i].config[0];
+			release_fragment_program_variant(acquire_fragment_program_variant(e->id, NULL));
+		} else {
+			stream_layout layouts[5];
+			for (j = 0; j < e->num_params; j++) {
+				layouts[j].raw = states[i].config[j];
+			}
+			get_vertex_program_variant(e->id, e->attr_regs, layouts, e->num_params);
 		}
-		
-		// Vertex colors
-		param = sceGxmProgramFindParameterByName(ffp_vertex_program, "color");
-		if (param) {
-			ffp_vertex_attribute[ffp_vertex_num_params].streamIndex = ffp_vertex_num_params;
-			ffp_vertex_attribute[ffp_vertex_num_params].offset = 0;
-			ffp_vertex_attribute[ffp_vertex_num_params].format = tex_unit->color_object_type == GL_FLOAT ? SCE_GXM_ATTRIBUTE_FORMAT_F32 : SCE_GXM_ATTRIBUTE_FORMAT_U8N;
-			int componentCount = tex_unit->color_array.num > 0 ? tex_unit->color_array.num : 4; // TODO: This is ugly and probably wrong
-			ffp_vertex_attribute[ffp_vertex_num_params].componentCount = componentCount;
-			ffp_vertex_attribute[ffp_vertex_num_params].regIndex = sceGxmProgramParameterGetResourceIndex(param);
-			ffp_vertex_stream[ffp_vertex_num_params].stride = componentCount * (tex_unit->color_object_type == GL_FLOAT ? sizeof(float) : sizeof(uint8_t));
-			ffp_vertex_stream[ffp_vertex_num_params].indexSource = SCE_GXM_INDEX_SOURCE_INDEX_16BIT;
-			ffp_vertex_num_params++;
+	}
+	blend_info.raw = blend;
+}
+
+static GLboolean reload_ffp_shaders(const stream_layout *layouts) {
+	texture_unit *tex_unit = &texture_units[client_texture_unit];
+	texture_unit *tex_unit1 = &texture_units[1];
+	
+	// Second texture unit is used only when enabled with a valid texture and texcoords array
+	ffp_has_texture1 = (client_texture_unit == 0) && tex_unit->texture_array_state && tex_unit1->enabled && tex_unit1->texture_array_state && texture_slots[tex_unit1->tex_id].valid;
+	
+	// Lighting is evaluated per vertex, so fragment shader always gets a color from vertex shader when enabled
+	int lights_num = 0;
+	if (lighting_state) {
+		int i;
+		for (i = 0; i < MAX_LIGHTS_NUM; i++) {
+			if (lights_mask & (1 << i))
+				lights_num++;
 		}
-		
-		// Creating patched vertex shader
-		sceGxmShaderPatcherCreateVertexProgram(gxm_shader_patcher,
-			ffp_vertex_program_id, ffp_vertex_attribute,
-			ffp_vertex_num_params, ffp_vertex_stream, ffp_vertex_num_params, &ffp_vertex_program_patched);
-		
-		// Clearing dirty flags
-		ffp_dirty_vert_stream = GL_FALSE;
 	}
 	
-	// Checking if fragment shader requires a recompilation
-	if (ffp_dirty_frag) {
-		
-		// Compiling the new shader
-		char fshader[8192];
-		sprintf(fshader, ffp_frag_src, alpha_op, tex_unit->texture_array_state, tex_unit->color_array_state, internal_fog_mode, tex_unit->env_mode);
-		uint32_t size = strlen(fshader);
-		SceGxmProgram *t = shark_compile_shader_extended(fshader, &size, SHARK_FRAGMENT_SHADER, compiler_opts, compiler_fastmath, compiler_fastprecision, compiler_fastint);
-		ffp_fragment_program = (SceGxmProgram*)malloc(size);
-		memcpy_neon((void *)ffp_fragment_program, (void *)t, size);
-		sceGxmShaderPatcherRegisterProgram(gxm_shader_patcher, ffp_fragment_program, &ffp_fragment_program_id);
-		shark_clear_output();
+	// A null normals layout means the draw can't provide a normals array, so current normal is used instead
+	ffp_has_normals = lights_num && tex_unit->normal_array_state && layouts[4].raw;
+	
+	// Calculating masks for current fixed function pipeline config
+	shader_mask vert_mask = {.raw = 0};
+	vert_mask.clip_plane = clip_plane0 ? 1 : 0;
+	vert_mask.has_texture = tex_unit->texture_array_state;
+	vert_mask.has_colors = tex_unit->color_array_state;
+	vert_mask.has_texture1 = ffp_has_texture1;
+	vert_mask.lights_num = lights_num;
+	vert_mask.has_normals = ffp_has_normals;
+	if (lights_num && color_material_state) {
+		switch (color_material_mode) {
+		case GL_AMBIENT_AND_DIFFUSE:
+			vert_mask.color_material = 1;
+			break;
+		case GL_AMBIENT:
+			vert_mask.color_material = 2;
+			break;
+		case GL_DIFFUSE:
+			vert_mask.color_material = 3;
+			break;
+		case GL_SPECULAR:
+			vert_mask.color_material = 4;
+			break;
+		default:
+			vert_mask.color_material = 5;
+			break;
+		}
+	}
+	shader_mask frag_mask = {.raw = 0};
+	frag_mask.texenv_mode = tex_unit->env_mode;
+	frag_mask.alpha_test_mode = alpha_op;
+	frag_mask.has_texture = tex_unit->texture_array_state;
+	frag_mask.has_colors = tex_unit->color_array_state || lights_num;
+	frag_mask.fog_mode = internal_fog_mode;
+	if (tex_unit->env_mode == COMBINE) {
+		frag_mask.combine_rgb = tex_unit->combine_rgb;
+		frag_mask.combine_alpha = tex_unit->combine_alpha;
+	}
+	if (ffp_has_texture1) {
+		frag_mask.has_texture1 = GL_TRUE;
+		frag_mask.texenv_mode1 = tex_unit1->env_mode;
+		if (tex_unit1->env_mode == COMBINE) {
+			frag_mask.combine_rgb1 = tex_unit1->combine_rgb;
+			frag_mask.combine_alpha1 = tex_unit1->combine_alpha;
+		}
+	}
+	frag_mask.raw |= FFP_CACHE_FRAGMENT_KEY;
+	
+	// Checking if shaders changed, precompiled shaders are used while new ones are not ready
+	cached_shader *v = ffp_vert_entry;
+	if (!v || (v->key != vert_mask.raw)) {
+		v = get_ffp_shader(vert_mask.raw);
+		if (!v)
+			return GL_FALSE;
+	}
+	cached_shader *f = ffp_frag_entry;
+	if (!f || (f->key != frag_mask.raw)) {
+		f = get_ffp_shader(frag_mask.raw);
+		if (!f)
+			return GL_FALSE;
+	}
+	if (!is_ffp_shader_ready(v) || !is_ffp_shader_ready(f))
+		return GL_FALSE;
+	if (v != ffp_vert_entry) {
+		ffp_vert_entry = v;
+		memcpy(ffp_vertex_params, v->params, sizeof(ffp_vertex_params));
+	}
+	if (f != ffp_frag_entry) {
+		ffp_frag_entry = f;
+		memcpy(ffp_fragment_params, f->params, sizeof(ffp_fragment_params));
+	}
+	ffp_dirty_vert = GL_FALSE;
+	ffp_dirty_frag = GL_FALSE;
+	
+	// Grabbing vertex program variant for current streams layout
+	stream_layout ffp_layouts[5];
+	int i;
+	for (i = 0; i < v->num_params; i++) {
+		ffp_layouts[i] = layouts[v->attr_streams[i]];
+		ffp_stream_idx[v->attr_streams[i]] = i;
+	}
+	
+	// Bound vertex array object keeps its last patched vertex program, as long as it's still cached
+	SceGxmVertexProgram *vprog;
+	if (cur_vao->vprog && (cur_vao->vprog_gen == vertex_variants_gen) && (cur_vao->vprog_id == v->id) && !memcmp(cur_vao->vprog_layouts, ffp_layouts, v->num_params * sizeof(stream_layout)))
+		vprog = cur_vao->vprog;
+	else {
+		vprog = get_vertex_program_variant(v->id, v->attr_regs, ffp_layouts, v->num_params);
 		
-		// Checking for existing uniforms in the shader
-		ffp_fragment_params[ALPHA_CUT_UNIF] = sceGxmProgramFindParameterByName(ffp_fragment_program, "alphaCut");
-		ffp_fragment_params[FOG_COLOR_UNIF] = sceGxmProgramFindParameterByName(ffp_fragment_program, "fogColor");
-		ffp_fragment_params[TEX_ENV_COLOR_UNIF] = sceGxmProgramFindParameterByName(ffp_fragment_program, "texEnvColor");
-		ffp_fragment_params[TINT_COLOR_UNIF] = sceGxmProgramFindParameterByName(ffp_fragment_program, "tintColor");
-		ffp_fragment_params[FOG_NEAR_UNIF] = sceGxmProgramFindParameterByName(ffp_fragment_program, "fog_near");
-		ffp_fragment_params[FOG_FAR_UNIF] = sceGxmProgramFindParameterByName(ffp_fragment_program, "fog_far");
-		ffp_fragment_params[FOG_DENSITY_UNIF] = sceGxmProgramFindParameterByName(ffp_fragment_program, "fog_density");
-
-		// Clearing dirty flags
-		ffp_dirty_frag = GL_FALSE;
-		ffp_dirty_frag_blend = GL_TRUE;
+		// Uncached programs are released once the GPU is done with the current frame, so they can't be kept
+		if (find_vertex_variant(vprog)) {
+			memcpy(cur_vao->vprog_layouts, ffp_layouts, v->num_params * sizeof(stream_layout));
+			cur_vao->vprog_id = v->id;
+			cur_vao->vprog_gen = vertex_variants_gen;
+			cur_vao->vprog = vprog;
+		} else
+			cur_vao->vprog = NULL;
 	}
 	
-	// Checking if fragment shader requires a blend settings change
-	if (ffp_dirty_frag_blend || (ffp_blend_info.raw != blend_info.raw)) {
-		rebuild_frag_shader(ffp_fragment_program_id, &ffp_fragment_program_patched, NULL);
-			
-		// Updating current fixed function pipeline blend config
-		ffp_blend_info.raw = blend_info.raw;
+	// Holding the patched vertex program since next draws may reuse it without a reload, an uncached one is patched again next draw
+	ffp_dirty_vert_stream = GL_FALSE;
+	if (vprog != ffp_vertex_program_patched) {
+		if (ffp_vertex_program_patched)
+			release_vertex_program_variant(ffp_vertex_program_patched);
+		ffp_vertex_program_patched = vprog;
+		if (!hold_vertex_program_variant(vprog))
+			ffp_dirty_vert_stream = GL_TRUE;
 	}
+	ffp_vertex_num_params = v->num_params;
 	
-	if (new_shader_flag) {
-		shader_cache_idx = (shader_cache_idx + 1) % SHADER_CACHE_SIZE;
-		if (shader_cache_size < SHADER_CACHE_SIZE)
-			shader_cache_size++;
-		else {
-			sceGxmShaderPatcherForceUnregisterProgram(gxm_shader_patcher, ffp_vertex_program_id);
-			sceGxmShaderPatcherForceUnregisterProgram(gxm_shader_patcher, ffp_fragment_program_id);
-			free(shader_cache[shader_cache_idx].frag);
-			free(shader_cache[shader_cache_idx].vert);
+	// Recording used states if requested
+	if (ffp_states_path) {
+		vglFFPState st = {v->key, {0, 0, 0, 0, 0}};
+		for (i = 0; i < v->num_params; i++) {
+			st.config[i] = ffp_layouts[i].raw;
 		}
-		shader_cache[shader_cache_idx].mask.raw = mask.raw;
-		shader_cache[shader_cache_idx].frag = ffp_fragment_program;
-		shader_cache[shader_cache_idx].vert = ffp_vertex_program;
-		shader_cache[shader_cache_idx].frag_id = ffp_fragment_program_id;
-		shader_cache[shader_cache_idx].vert_id = ffp_vertex_program_id;
+		record_ffp_state(&st, &ffp_last_vert_state);
+		st.shader_mask = f->key;
+		st.config[0] = blend_info.raw;
+		st.config[1] = st.config[2] = st.config[3] = st.config[4] = 0;
+		record_ffp_state(&st, &ffp_last_frag_state);
+	}
+	
+	// Checking if fragment shader requires a blend settings change
+	if (!f->patched || (f->patched_cfg.raw != blend_info.raw)) {
+		rebuild_frag_shader(f->id, &f->patched, NULL);
+		f->patched_cfg.raw = blend_info.raw;
 	}
+	ffp_fragment_program_patched = f->patched;
 	
 	sceGxmSetVertexProgram(gxm_context, ffp_vertex_program_patched);
 	sceGxmSetFragmentProgram(gxm_context, ffp_fragment_program_patched);
+	return GL_TRUE;
 }
 #endif
 
 void rebuild_frag_shader(SceGxmShaderPatcherId pid, SceGxmFragmentProgram **prog, const SceGxmProgram *vert) {
-	sceGxmShaderPatcherCreateFragmentProgram(gxm_shader_patcher,
-		pid, SCE_GXM_OUTPUT_REGISTER_FORMAT_UCHAR4,
-		msaa_mode,
-		&blend_info.info,
-		vert, prog);
+	// Swapping held patched program with the variant matching current blend settings
+	SceGxmFragmentProgram *old = *prog;
+	*prog = acquire_fragment_program_variant(pid, vert);
+	if (old)
+		release_fragment_program_variant(old);
 }
 
 void update_precompiled_ffp_frag_shader(SceGxmShaderPatcherId pid, SceGxmFragmentProgram **prog, blend_config *cfg) {
@@ -478,6 +1143,138 @@ void update_precompiled_ffp_frag_shader(SceGxmShaderPatcherId pid, SceGxmFragmen
 	sceGxmSetFragmentProgram(gxm_context, *prog);
 }
 
+#ifdef HAVE_FFP_PERMUTATIONS
+static frag_perm *get_frag_perm(GLboolean has_colors) {
+	// State mask layout: texenv (3 bits), alpha test (1 bit), fog mode (2 bits), color array (1 bit)
+	texture_unit *tex_unit = &texture_units[client_texture_unit];
+	uint32_t mask = tex_unit->env_mode | ((alpha_op != ALWAYS) << 3) | (internal_fog_mode << 4) | (has_colors << 6);
+	frag_perm *p = &frag_perms[mask];
+	if (p->state != PERM_UNREGISTERED)
+		return p->state == PERM_AVAILABLE ? p : NULL;
+
+	// Lazily registering the permutation, uber shader is used if this fails
+	p->state = PERM_UNAVAILABLE;
+	if (!texture2d_perm_f_table[mask] || sceGxmShaderPatcherRegisterProgram(gxm_shader_patcher, (const SceGxmProgram *)texture2d_perm_f_table[mask], &p->id) < 0)
+		return NULL;
+	const SceGxmProgram *prog = sceGxmShaderPatcherGetProgramFromId(p->id);
+	p->has_unifs = sceGxmProgramGetDefaultUniformBufferSize(prog) > 0;
+	p->unifs[TEX2D_ALPHA_CUT_UNIF] = sceGxmProgramFindParameterByName(prog, "alphaCut");
+	p->unifs[TEX2D_ALPHA_MODE_UNIF] = sceGxmProgramFindParameterByName(prog, "alphaOp");
+	p->unifs[TEX2D_FOG_COLOR_UNIF] = sceGxmProgramFindParameterByName(prog, "fogColor");
+	p->unifs[TEX2D_FOG_NEAR_UNIF] = sceGxmProgramFindParameterByName(prog, "fog_near");
+	p->unifs[TEX2D_FOG_FAR_UNIF] = sceGxmProgramFindParameterByName(prog, "fog_far");
+	p->unifs[TEX2D_FOG_DENSITY_UNIF] = sceGxmProgramFindParameterByName(prog, "fog_density");
+	p->unifs[TEX2D_TEX_ENV_COLOR_UNIF] = sceGxmProgramFindParameterByName(prog, "texEnvColor");
+	p->tint_color = sceGxmProgramFindParameterByName(prog, "tintColor");
+	rebuild_frag_shader(p->id, &p->prog, NULL);
+	p->blend_cfg.raw = blend_info.raw;
+	p->state = PERM_AVAILABLE;
+	return p;
+}
+
+static vert_perm *get_vert_perm(GLboolean has_colors) {
+	// State mask layout: clip plane (1 bit), color array (1 bit)
+	uint32_t mask = (clip_plane0 ? 1 : 0) | (has_colors << 1);
+	vert_perm *p = &vert_perms[mask];
+	if (p->state != PERM_UNREGISTERED)
+		return p->state == PERM_AVAILABLE ? p : NULL;
+
+	// Lazily registering the permutation, uber shader is used if this fails
+	p->state = PERM_UNAVAILABLE;
+	if (!texture2d_perm_v_table[mask] || sceGxmShaderPatcherRegisterProgram(gxm_shader_patcher, (const SceGxmProgram *)texture2d_perm_v_table[mask], &p->id) < 0)
+		return NULL;
+	const SceGxmProgram *prog = sceGxmShaderPatcherGetProgramFromId(p->id);
+	p->attr_regs[0] = sceGxmProgramParameterGetResourceIndex(sceGxmProgramFindParameterByName(prog, "position"));
+	p->attr_regs[1] = sceGxmProgramParameterGetResourceIndex(sceGxmProgramFindParameterByName(prog, "texcoord"));
+	if (has_colors)
+		p->attr_regs[2] = sceGxmProgramParameterGetResourceIndex(sceGxmProgramFindParameterByName(prog, "color"));
+	p->unifs[TEX2D_WVP_UNIF] = sceGxmProgramFindParameterByName(prog, "wvp");
+	p->unifs[TEX2D_CLIP_PLANEO_EQUATION_UNIF] = sceGxmProgramFindParameterByName(prog, "clip_plane0_eq");
+	p->unifs[TEX2D_MODELVIEW_UNIF] = sceGxmProgramFindParameterByName(prog, "modelview");
+	p->state = PERM_AVAILABLE;
+	return p;
+}
+
+static GLboolean setup_tex2d_perm_programs(GLboolean has_colors, const stream_layout *layouts) {
+	frag_perm *f = get_frag_perm(has_colors);
+	vert_perm *v = get_vert_perm(has_colors);
+	if (!f || !v)
+		return GL_FALSE;
+
+	sceGxmSetVertexProgram(gxm_context, get_vertex_program_variant(v->id, v->attr_regs, layouts, has_colors ? 3 : 2));
+	update_precompiled_ffp_frag_shader(f->id, &f->prog, &f->blend_cfg);
+
+	// Uploading only the uniforms the permutation actually uses
+	if (f->has_unifs) {
+		void *fbuffer;
+		sceGxmReserveFragmentDefaultUniformBuffer(gxm_context, &fbuffer);
+		if (f->unifs[TEX2D_ALPHA_CUT_UNIF]) {
+			float alpha_operation = (float)alpha_op;
+			sceGxmSetUniformDataF(fbuffer, f->unifs[TEX2D_ALPHA_CUT_UNIF], 0, 1, &alpha_ref);
+			sceGxmSetUniformDataF(fbuffer, f->unifs[TEX2D_ALPHA_MODE_UNIF], 0, 1, &alpha_operation);
+		}
+		if (f->unifs[TEX2D_FOG_COLOR_UNIF])
+			sceGxmSetUniformDataF(fbuffer, f->unifs[TEX2D_FOG_COLOR_UNIF], 0, 4, &fog_color.r);
+		if (f->unifs[TEX2D_FOG_NEAR_UNIF])
+			sceGxmSetUniformDataF(fbuffer, f->unifs[TEX2D_FOG_NEAR_UNIF], 0, 1, (const float *)&fog_near);
+		if (f->unifs[TEX2D_FOG_FAR_UNIF])
+			sceGxmSetUniformDataF(fbuffer, f->unifs[TEX2D_FOG_FAR_UNIF], 0, 1, (const float *)&fog_far);
+		if (f->unifs[TEX2D_FOG_DENSITY_UNIF])
+			sceGxmSetUniformDataF(fbuffer, f->unifs[TEX2D_FOG_DENSITY_UNIF], 0, 1, (const float *)&fog_density);
+		if (f->unifs[TEX2D_TEX_ENV_COLOR_UNIF])
+			sceGxmSetUniformDataF(fbuffer, f->unifs[TEX2D_TEX_ENV_COLOR_UNIF], 0, 4, &texture_units[client_texture_unit].env_color.r);
+		if (f->tint_color)
+			sceGxmSetUniformDataF(fbuffer, f->tint_color, 0, 4, &current_color.r);
+	}
+
+	void *vbuffer;
+	sceGxmReserveVertexDefaultUniformBuffer(gxm_context, &vbuffer);
+	sceGxmSetUniformDataF(vbuffer, v->unifs[TEX2D_WVP_UNIF], 0, 16, (const float *)mvp_matrix);
+	if (v->unifs[TEX2D_CLIP_PLANEO_EQUATION_UNIF]) {
+		sceGxmSetUniformDataF(vbuffer, v->unifs[TEX2D_CLIP_PLANEO_EQUATION_UNIF], 0, 4, &clip_plane0_eq.x);
+		sceGxmSetUniformDataF(vbuffer, v->unifs[TEX2D_MODELVIEW_UNIF], 0, 16, (const float *)modelview_matrix);
+	}
+	return GL_TRUE;
+}
+
+static void release_tex2d_perm_programs(void) {
+	int i;
+	for (i = 0; i < FFP_FRAG_PERMS_NUM; i++) {
+		if (frag_perms[i].state == PERM_AVAILABLE) {
+			release_fragment_program_variant(frag_perms[i].prog);
+			release_program_variants(frag_perms[i].id);
+			queue_program_unregister(frag_perms[i].id, NULL);
+		}
+		frag_perms[i].prog = NULL;
+		frag_perms[i].state = PERM_UNREGISTERED;
+	}
+	for (i = 0; i < FFP_VERT_PERMS_NUM; i++) {
+		if (vert_perms[i].state == PERM_AVAILABLE) {
+			release_program_variants(vert_perms[i].id);
+			queue_program_unregister(vert_perms[i].id, NULL);
+		}
+		vert_perms[i].state = PERM_UNREGISTERED;
+	}
+}
+#endif
+
+void setup_tex2d_programs(GLboolean has_colors, const stream_layout *layouts) {
+#ifdef HAVE_FFP_PERMUTATIONS
+	// Using a specialized permutation for current state if available
+	if (setup_tex2d_perm_programs(has_colors, layouts))
+		return;
+#endif
+	if (has_colors) {
+		sceGxmSetVertexProgram(gxm_context, get_vertex_program_variant(texture2d_rgba_vertex_id, texture2d_rgba_attr_regs, layouts, 3));
+		update_precompiled_ffp_frag_shader(texture2d_rgba_fragment_id, &texture2d_rgba_fragment_program_patched, &texture2d_rgba_blend_cfg);
+		upload_tex2d_uniforms(texture2d_rgba_generic_unifs);
+	} else {
+		sceGxmSetVertexProgram(gxm_context, get_vertex_program_variant(texture2d_vertex_id, texture2d_attr_regs, layouts, 2));
+		update_precompiled_ffp_frag_shader(texture2d_fragment_id, &texture2d_fragment_program_patched, &texture2d_blend_cfg);
+		upload_tex2d_uniforms(texture2d_generic_unifs);
+	}
+}
+
 void change_blend_factor() {
 	blend_info.info.colorMask = blend_color_mask;
 	blend_info.info.colorFunc = blend_func_rgb;
@@ -636,6 +1433,8 @@ void vglInitWithCustomSizes(uint32_t gpu_pool_size, int width, int height, int r
 
 		const SceGxmProgramParameter *rgba_position = sceGxmProgramFindParameterByName(rgba_vertex_program, "aPosition");
 		const SceGxmProgramParameter *rgba_color = sceGxmProgramFindParameterByName(rgba_vertex_program, "aColor");
+		rgba_attr_regs[0] = sceGxmProgramParameterGetResourceIndex(rgba_position);
+		rgba_attr_regs[1] = sceGxmProgramParameterGetResourceIndex(rgba_color);
 
 		SceGxmVertexAttribute rgba_vertex_attribute[2];
 		SceGxmVertexStream rgba_vertex_stream[2];
@@ -665,6 +1464,15 @@ void vglInitWithCustomSizes(uint32_t gpu_pool_size, int width, int height, int r
 			rgba_vertex_id, rgba_vertex_attribute,
 			2, rgba_vertex_stream, 2, &rgba_u8n_vertex_program_patched);
 
+		// Constant color variant: color stream is fetched by instance index so a single vector4f feeds the whole draw
+		rgba_vertex_attribute[1].format = SCE_GXM_ATTRIBUTE_FORMAT_F32;
+		rgba_vertex_stream[1].stride = sizeof(vector4f);
+		rgba_vertex_stream[1].indexSource = SCE_GXM_INDEX_SOURCE_INSTANCE_16BIT;
+
+		sceGxmShaderPatcherCreateVertexProgram(gxm_shader_patcher,
+			rgba_vertex_id, rgba_vertex_attribute,
+			2, rgba_vertex_stream, 2, &rgba_const_vertex_program_patched);
+
 		SceGxmVertexAttribute rgb_vertex_attribute[2];
 		SceGxmVertexStream rgb_vertex_stream[2];
 		rgb_vertex_attribute[0].streamIndex = 0;
@@ -711,6 +1519,8 @@ void vglInitWithCustomSizes(uint32_t gpu_pool_size, int width, int height, int r
 
 		const SceGxmProgramParameter *texture2d_position = sceGxmProgramFindParameterByName(texture2d_vertex_program, "position");
 		const SceGxmProgramParameter *texture2d_texcoord = sceGxmProgramFindParameterByName(texture2d_vertex_program, "texcoord");
+		texture2d_attr_regs[0] = sceGxmProgramParameterGetResourceIndex(texture2d_position);
+		texture2d_attr_regs[1] = sceGxmProgramParameterGetResourceIndex(texture2d_texcoord);
 
 		texture2d_generic_unifs[TEX2D_ALPHA_CUT_UNIF] = sceGxmProgramFindParameterByName(texture2d_fragment_program, "alphaCut");
 		texture2d_generic_unifs[TEX2D_ALPHA_MODE_UNIF] = sceGxmProgramFindParameterByName(texture2d_fragment_program, "alphaOp");
@@ -765,6 +1575,9 @@ void vglInitWithCustomSizes(uint32_t gpu_pool_size, int width, int height, int r
 		const SceGxmProgramParameter *texture2d_rgba_position = sceGxmProgramFindParameterByName(texture2d_rgba_vertex_program, "position");
 		const SceGxmProgramParameter *texture2d_rgba_texcoord = sceGxmProgramFindParameterByName(texture2d_rgba_vertex_program, "texcoord");
 		const SceGxmProgramParameter *texture2d_rgba_color = sceGxmProgramFindParameterByName(texture2d_rgba_vertex_program, "color");
+		texture2d_rgba_attr_regs[0] = sceGxmProgramParameterGetResourceIndex(texture2d_rgba_position);
+		texture2d_rgba_attr_regs[1] = sceGxmProgramParameterGetResourceIndex(texture2d_rgba_texcoord);
+		texture2d_rgba_attr_regs[2] = sceGxmProgramParameterGetResourceIndex(texture2d_rgba_color);
 
 		texture2d_rgba_generic_unifs[TEX2D_ALPHA_CUT_UNIF] = sceGxmProgramFindParameterByName(texture2d_rgba_fragment_program, "alphaCut");
 		texture2d_rgba_generic_unifs[TEX2D_ALPHA_MODE_UNIF] = sceGxmProgramFindParameterByName(texture2d_rgba_fragment_program, "alphaOp");
@@ -837,7 +1650,7 @@ void vglInitWithCustomSizes(uint32_t gpu_pool_size, int width, int height, int r
 	// Init texture units
 	int i, j;
 	for (i = 0; i < GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS; i++) {
-		texture_units[i].env_mode = MODULATE;
+		reset_texture_env(&texture_units[i]);
 		texture_units[i].tex_id = 0;
 		texture_units[i].enabled = GL_FALSE;
 	}
@@ -902,6 +1715,12 @@ void vglEnd(void) {
 	vgl_mem_free(depth_vertices);
 	vgl_mem_free(depth_clear_indices);
 	vgl_mem_free(scissor_test_vertices);
+	if (quad_indices)
+		vgl_mem_free(quad_indices);
+	if (remap_table) {
+		free(remap_table);
+		remap_table = NULL;
+	}
 
 	// Releasing shader programs from sceGxmShaderPatcher
 	sceGxmShaderPatcherReleaseFragmentProgram(gxm_shader_patcher, scissor_test_fragment_program);
@@ -909,9 +1728,44 @@ void vglEnd(void) {
 	sceGxmShaderPatcherReleaseVertexProgram(gxm_shader_patcher, clear_vertex_program_patched);
 	sceGxmShaderPatcherReleaseFragmentProgram(gxm_shader_patcher, clear_fragment_program_patched);
 	sceGxmShaderPatcherReleaseVertexProgram(gxm_shader_patcher, rgba_vertex_program_patched);
-	sceGxmShaderPatcherReleaseFragmentProgram(gxm_shader_patcher, rgba_fragment_program_patched);
+	sceGxmShaderPatcherReleaseVertexProgram(gxm_shader_patcher, rgba_const_vertex_program_patched);
+	release_fragment_program_variant(rgba_fragment_program_patched);
 	sceGxmShaderPatcherReleaseVertexProgram(gxm_shader_patcher, texture2d_vertex_program_patched);
-	sceGxmShaderPatcherReleaseFragmentProgram(gxm_shader_patcher, texture2d_fragment_program_patched);
+	release_fragment_program_variant(texture2d_fragment_program_patched);
+	release_fragment_program_variant(texture2d_rgba_fragment_program_patched);
+#ifdef HAVE_FFP_PERMUTATIONS
+	release_tex2d_perm_programs();
+#endif
+	int i;
+	for (i = 0; i < vertex_variants_num; i++) {
+		sceGxmShaderPatcherReleaseVertexProgram(gxm_shader_patcher, vertex_variants[i].prog);
+	}
+	vertex_variants_num = 0;
+	for (i = 0; i < fragment_variants_num; i++) {
+		sceGxmShaderPatcherReleaseFragmentProgram(gxm_shader_patcher, fragment_variants[i].prog);
+	}
+	fragment_variants_num = 0;
+
+	// Freeing client arrays cache
+	array_cache_reset();
+
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+	// Freeing fixed function pipeline shaders cache
+	while (shader_cache_head)
+		shader_cache_release(shader_cache_head);
+	ffp_vert_entry = NULL;
+	ffp_frag_entry = NULL;
+	
+	// Dumping recorded fixed function pipeline states
+	vglRecordFFPStates(NULL);
+#endif
+#ifdef HAVE_SHARK
+	// Terminating shaders compiler worker thread
+	vglEnableAsyncShaderCompiler(GL_FALSE);
+#endif
+
+	// Releasing patched programs left waiting for the GPU
+	release_pending_programs(GL_TRUE);
 
 	// Unregistering shader programs from sceGxmShaderPatcher
 	sceGxmShaderPatcherUnregisterProgram(gxm_shader_patcher, clear_vertex_id);
@@ -973,33 +1827,173 @@ void glBindBuffer(GLenum target, GLuint buffer) {
 	switch (target) {
 	case GL_ARRAY_BUFFER:
 		vertex_array_unit = buffer - BUFFERS_ADDR;
+		cur_vao->cache_valid = GL_FALSE;
 		break;
 	case GL_ELEMENT_ARRAY_BUFFER:
 		index_array_unit = buffer - BUFFERS_ADDR;
 		break;
+	case GL_UNIFORM_BUFFER:
+		uniform_buffer_unit = buffer - BUFFERS_ADDR;
+		break;
+	default:
+		SET_GL_ERROR(GL_INVALID_ENUM)
+		break;
+	}
+}
+
+void glBindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+#ifndef SKIP_ERROR_HANDLING
+	if ((buffer != 0x0000) && ((buffer >= BUFFERS_ADDR + BUFFERS_NUM) || (buffer < BUFFERS_ADDR))) {
+		SET_GL_ERROR(GL_INVALID_VALUE)
+	}
+#endif
+	switch (target) {
+	case GL_UNIFORM_BUFFER:
+#ifndef SKIP_ERROR_HANDLING
+		if (index >= UNIFORM_BUFFER_BINDINGS_NUM) {
+			SET_GL_ERROR(GL_INVALID_VALUE)
+		}
+#endif
+		// Binding to an indexed target also binds to the generic one
+		uniform_buffer_unit = buffer - BUFFERS_ADDR;
+		uniform_buffer_bindings[index] = uniform_buffer_unit;
+		break;
 	default:
 		SET_GL_ERROR(GL_INVALID_ENUM)
 		break;
 	}
 }
 
+void *get_uniform_buffer_binding(GLuint index) {
+	int idx = uniform_buffer_bindings[index];
+	return idx >= 0 ? gpu_buffers[idx].ptr : NULL;
+}
+
+int get_array_buffer_unit(void) {
+	return vertex_array_unit;
+}
+
+void *get_buffer_memblock(int unit) {
+	return gpu_buffers[unit].ptr;
+}
+
+GLuint get_vertex_array_binding(void) {
+	return cur_vao - vaos;
+}
+
+static void store_vertex_array(vertex_array_object *vao) {
+	int i;
+	for (i = 0; i < GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS; i++) {
+		texture_unit *tex_unit = &texture_units[i];
+		vao->states[i][0] = tex_unit->vertex_array_state;
+		vao->states[i][1] = tex_unit->color_array_state;
+		vao->states[i][2] = tex_unit->texture_array_state;
+		vao->states[i][3] = tex_unit->normal_array_state;
+		vao->arrays[i][0] = tex_unit->vertex_array;
+		vao->arrays[i][1] = tex_unit->color_array;
+		vao->arrays[i][2] = tex_unit->texture_array;
+		vao->arrays[i][3] = tex_unit->normal_array;
+	}
+	memcpy(vao->attribs, vertex_attribs, sizeof(vertex_attribs));
+	vao->vertex_array_unit = vertex_array_unit;
+	vao->index_array_unit = index_array_unit;
+}
+
+static void restore_vertex_array(vertex_array_object *vao) {
+	int i;
+	for (i = 0; i < GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS; i++) {
+		texture_unit *tex_unit = &texture_units[i];
+		tex_unit->vertex_array_state = vao->states[i][0];
+		tex_unit->color_array_state = vao->states[i][1];
+		tex_unit->texture_array_state = vao->states[i][2];
+		tex_unit->normal_array_state = vao->states[i][3];
+		tex_unit->vertex_array = vao->arrays[i][0];
+		tex_unit->color_array = vao->arrays[i][1];
+		tex_unit->texture_array = vao->arrays[i][2];
+		tex_unit->normal_array = vao->arrays[i][3];
+	}
+	memcpy(vertex_attribs, vao->attribs, sizeof(vertex_attribs));
+	vertex_array_unit = vao->vertex_array_unit;
+	index_array_unit = vao->index_array_unit;
+}
+
 void glDeleteBuffers(GLsizei n, const GLuint *gl_buffers) {
 #ifndef SKIP_ERROR_HANDLING
 	if (n < 0) {
 		SET_GL_ERROR(GL_INVALID_VALUE)
-		return;
+		return;
+	}
+#endif
+	int i, j;
+	for (j = 0; j < n; j++) {
+		if (gl_buffers[j] >= BUFFERS_ADDR && gl_buffers[j] < (BUFFERS_ADDR + BUFFERS_NUM)) {
+			uint8_t idx = gl_buffers[j] - BUFFERS_ADDR;
+			buffers[idx] = gl_buffers[j];
+			if (gpu_buffers[idx].ptr != NULL) {
+				vgl_mem_free(gpu_buffers[idx].ptr);
+				gpu_buffers[idx].ptr = NULL;
+				gpu_buffers[idx].size = 0;
+			}
+		}
+	}
+}
+
+void glGenVertexArrays(GLsizei n, GLuint *res) {
+#ifndef SKIP_ERROR_HANDLING
+	if (n < 0) {
+		SET_GL_ERROR(GL_INVALID_VALUE)
+	}
+#endif
+	int i, j = 0, k;
+	for (i = 1; (i <= VERTEX_ARRAYS_NUM) && (j < n); i++) {
+		vertex_array_object *vao = &vaos[i];
+		if (!vao->used) {
+			// Vertex array objects start with default client arrays state
+			memset(vao, 0, sizeof(vertex_array_object));
+			for (k = 0; k < VERTEX_ATTRIBS_NUM; k++) {
+				vao->attribs[k].buffer = -1;
+			}
+			vao->vertex_array_unit = -1;
+			vao->index_array_unit = -1;
+			vao->used = GL_TRUE;
+			res[j++] = i;
+		}
+	}
+}
+
+void glBindVertexArray(GLuint array) {
+#ifndef SKIP_ERROR_HANDLING
+	if ((array > VERTEX_ARRAYS_NUM) || (array && !vaos[array].used)) {
+		SET_GL_ERROR(GL_INVALID_OPERATION)
+	}
+#endif
+	vertex_array_object *vao = &vaos[array];
+	if (vao == cur_vao)
+		return;
+
+	// Swapping client arrays state, resolved streams layout and vertex program stay cached in the objects
+	store_vertex_array(cur_vao);
+	restore_vertex_array(vao);
+	cur_vao = vao;
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+	ffp_dirty_vert = GL_TRUE;
+	ffp_dirty_frag = GL_TRUE;
+#endif
+}
+
+void glDeleteVertexArrays(GLsizei n, const GLuint *arrays) {
+#ifndef SKIP_ERROR_HANDLING
+	if (n < 0) {
+		SET_GL_ERROR(GL_INVALID_VALUE)
 	}
 #endif
-	int i, j;
-	for (j = 0; j < n; j++) {
-		if (gl_buffers[j] >= BUFFERS_ADDR && gl_buffers[j] < (BUFFERS_ADDR + BUFFERS_NUM)) {
-			uint8_t idx = gl_buffers[j] - BUFFERS_ADDR;
-			buffers[idx] = gl_buffers[j];
-			if (gpu_buffers[idx].ptr != NULL) {
-				vgl_mem_free(gpu_buffers[idx].ptr);
-				gpu_buffers[idx].ptr = NULL;
-				gpu_buffers[idx].size = 0;
-			}
+	int i;
+	for (i = 0; i < n; i++) {
+		if (arrays[i] && (arrays[i] <= VERTEX_ARRAYS_NUM) && vaos[arrays[i]].used) {
+			// Deleting the bound vertex array object reverts to the default one
+			if (cur_vao == &vaos[arrays[i]])
+				glBindVertexArray(0);
+			vaos[arrays[i]].used = GL_FALSE;
 		}
 	}
 }
@@ -1013,6 +2007,9 @@ void glBufferData(GLenum target, GLsizei size, const GLvoid *data, GLenum usage)
 	case GL_ELEMENT_ARRAY_BUFFER:
 		idx = index_array_unit;
 		break;
+	case GL_UNIFORM_BUFFER:
+		idx = uniform_buffer_unit;
+		break;
 	default:
 		SET_GL_ERROR(GL_INVALID_ENUM)
 		break;
@@ -1042,6 +2039,26 @@ void glBufferData(GLenum target, GLsizei size, const GLvoid *data, GLenum usage)
 	}
 #endif
 
+	// Reordering triangle lists indices for post-transform vertex cache efficiency if requested
+	if (optimize_indices && (target == GL_ELEMENT_ARRAY_BUFFER) && data) {
+		uint16_t *tmp = (uint16_t *)malloc(size);
+		if (tmp) {
+			memcpy_neon(tmp, data, size);
+#ifdef ENABLE_LOG
+			float acmr = calc_triangle_indices_acmr(tmp, size / sizeof(uint16_t));
+#endif
+			if (optimize_triangle_indices(tmp, size / sizeof(uint16_t))) {
+#ifdef ENABLE_LOG
+				LOG("Index buffer %d optimized, ACMR: %f -> %f\n", buffers[idx], acmr, calc_triangle_indices_acmr(tmp, size / sizeof(uint16_t)));
+#endif
+				memcpy_neon(gpu_buffers[idx].ptr, tmp, size);
+				free(tmp);
+				return;
+			}
+			free(tmp);
+		}
+	}
+
 	memcpy_neon(gpu_buffers[idx].ptr, data, size);
 }
 
@@ -1054,6 +2071,9 @@ void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void
 	case GL_ELEMENT_ARRAY_BUFFER:
 		idx = index_array_unit;
 		break;
+	case GL_UNIFORM_BUFFER:
+		idx = uniform_buffer_unit;
+		break;
 	default:
 		SET_GL_ERROR(GL_INVALID_ENUM)
 		break;
@@ -1072,6 +2092,14 @@ void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void
 }
 
 void glBlendFunc(GLenum sfactor, GLenum dfactor) {
+	flush_imm_batch();
+	// Recording command if a display list is being compiled
+	if (cur_display_list) {
+		GLenum args[2] = { sfactor, dfactor };
+		if (record_display_list_cmd(DLIST_CMD_BLEND_FUNC, args, sizeof(args)))
+			return;
+	}
+
 	switch (sfactor) {
 	case GL_ZERO:
 		blend_sfactor_rgb = blend_sfactor_a = SCE_GXM_BLEND_FACTOR_ZERO;
@@ -1153,6 +2181,7 @@ void glBlendFunc(GLenum sfactor, GLenum dfactor) {
 }
 
 void glBlendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha) {
+	flush_imm_batch();
 	switch (srcRGB) {
 	case GL_ZERO:
 		blend_sfactor_rgb = SCE_GXM_BLEND_FACTOR_ZERO;
@@ -1310,6 +2339,7 @@ void glBlendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum d
 }
 
 void glBlendEquation(GLenum mode) {
+	flush_imm_batch();
 	switch (mode) {
 	case GL_FUNC_ADD:
 		blend_func_rgb = blend_func_a = SCE_GXM_BLEND_FUNC_ADD;
@@ -1335,6 +2365,7 @@ void glBlendEquation(GLenum mode) {
 }
 
 void glBlendEquationSeparate(GLenum modeRGB, GLenum modeAlpha) {
+	flush_imm_batch();
 	switch (modeRGB) {
 	case GL_FUNC_ADD:
 		blend_func_rgb = SCE_GXM_BLEND_FUNC_ADD;
@@ -1380,6 +2411,7 @@ void glBlendEquationSeparate(GLenum modeRGB, GLenum modeAlpha) {
 }
 
 void glColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha) {
+	flush_imm_batch();
 	blend_color_mask = SCE_GXM_COLOR_MASK_NONE;
 	if (red)
 		blend_color_mask += SCE_GXM_COLOR_MASK_R;
@@ -1407,16 +2439,26 @@ void glVertexPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *poin
 		tex_unit->vertex_array.size = sizeof(GLfloat);
 		break;
 	case GL_SHORT:
+	case GL_UNSIGNED_SHORT:
+	case GL_HALF_FLOAT:
 		tex_unit->vertex_array.size = sizeof(GLshort);
 		break;
+	case GL_BYTE:
+		tex_unit->vertex_array.size = sizeof(GLbyte);
+		break;
 	default:
 		SET_GL_ERROR(GL_INVALID_ENUM)
 		break;
 	}
 
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+	if ((tex_unit->vertex_array.num != size) || (tex_unit->vertex_array.type != type)) ffp_dirty_vert_stream = GL_TRUE;
+#endif
+	tex_unit->vertex_array.type = type;
 	tex_unit->vertex_array.num = size;
 	tex_unit->vertex_array.stride = stride;
 	tex_unit->vertex_array.pointer = pointer;
+	cur_vao->cache_valid = GL_FALSE;
 }
 
 void glColorPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer) {
@@ -1438,11 +2480,44 @@ void glColorPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *point
 		break;
 	}
 #if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
-	if (tex_unit->color_array.num != size) ffp_dirty_vert_stream = GL_TRUE;
+	if ((tex_unit->color_array.num != size) || (tex_unit->color_array.type != type)) ffp_dirty_vert_stream = GL_TRUE;
 #endif
+	tex_unit->color_array.type = type;
 	tex_unit->color_array.num = size;
 	tex_unit->color_array.stride = stride;
 	tex_unit->color_array.pointer = pointer;
+	cur_vao->cache_valid = GL_FALSE;
+}
+
+void glNormalPointer(GLenum type, GLsizei stride, const GLvoid *pointer) {
+#ifndef SKIP_ERROR_HANDLING
+	if (stride < 0) {
+		SET_GL_ERROR(GL_INVALID_VALUE)
+	}
+#endif
+	texture_unit *tex_unit = &texture_units[client_texture_unit];
+	switch (type) {
+	case GL_FLOAT:
+		tex_unit->normal_array.size = sizeof(GLfloat);
+		break;
+	case GL_SHORT:
+		tex_unit->normal_array.size = sizeof(GLshort);
+		break;
+	case GL_BYTE:
+		tex_unit->normal_array.size = sizeof(GLbyte);
+		break;
+	default:
+		SET_GL_ERROR(GL_INVALID_ENUM)
+		break;
+	}
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+	if (tex_unit->normal_array.type != type) ffp_dirty_vert_stream = GL_TRUE;
+#endif
+	tex_unit->normal_array.type = type;
+	tex_unit->normal_array.num = 3;
+	tex_unit->normal_array.stride = stride;
+	tex_unit->normal_array.pointer = pointer;
+	cur_vao->cache_valid = GL_FALSE;
 }
 
 void glTexCoordPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer) {
@@ -1457,122 +2532,154 @@ void glTexCoordPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *po
 		tex_unit->texture_array.size = sizeof(GLfloat);
 		break;
 	case GL_SHORT:
+	case GL_UNSIGNED_SHORT:
+	case GL_HALF_FLOAT:
 		tex_unit->texture_array.size = sizeof(GLshort);
 		break;
+	case GL_BYTE:
+		tex_unit->texture_array.size = sizeof(GLbyte);
+		break;
 	default:
 		SET_GL_ERROR(GL_INVALID_ENUM)
 		break;
 	}
 
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+	if ((tex_unit->texture_array.num != size) || (tex_unit->texture_array.type != type)) ffp_dirty_vert_stream = GL_TRUE;
+#endif
+	tex_unit->texture_array.type = type;
 	tex_unit->texture_array.num = size;
 	tex_unit->texture_array.stride = stride;
 	tex_unit->texture_array.pointer = pointer;
+	cur_vao->cache_valid = GL_FALSE;
 }
 
-void _glDrawArrays_SetupVertices(vector3f **verts, vector2f **texcoords, uint8_t **clrs, uint16_t **idxs, GLint first, GLsizei count, GLboolean fake_clrs) {
-	texture_unit *tex_unit = &texture_units[client_texture_unit];
-	uint16_t n;
-	uint16_t *indices;
-	vector3f *vertices;
-	uint8_t *colors;
-	vector2f *uv_map;
-	if (vertex_array_unit >= 0) {
-		if (verts != NULL) {
-			if (tex_unit->vertex_array.stride == 0)
-				vertices = (vector3f *)(((uint32_t)gpu_buffers[vertex_array_unit].ptr + (uint32_t)tex_unit->vertex_array.pointer) + (first * (tex_unit->vertex_array.num * tex_unit->vertex_array.size)));
-			else
-				vertices = (vector3f *)(((uint32_t)gpu_buffers[vertex_array_unit].ptr + (uint32_t)tex_unit->vertex_array.pointer) + (first * tex_unit->vertex_array.stride));
-		}
-		if (clrs != NULL) {
-			if (tex_unit->color_array.stride == 0)
-				colors = (uint8_t *)(((uint32_t)gpu_buffers[vertex_array_unit].ptr + (uint32_t)tex_unit->color_array.pointer) + (first * (tex_unit->color_array.num * tex_unit->color_array.size)));
-			else
-				colors = (uint8_t *)(((uint32_t)gpu_buffers[vertex_array_unit].ptr + (uint32_t)tex_unit->color_array.pointer) + (first * tex_unit->color_array.stride));
-		}
-		if (uv_map != NULL) {
-			if (tex_unit->texture_array.stride == 0)
-				uv_map = (vector2f *)(((uint32_t)gpu_buffers[vertex_array_unit].ptr + (uint32_t)tex_unit->texture_array.pointer) + (first * (tex_unit->texture_array.num * tex_unit->texture_array.size)));
-			else
-				uv_map = (vector2f *)(((uint32_t)gpu_buffers[vertex_array_unit].ptr + (uint32_t)tex_unit->texture_array.pointer) + (first * tex_unit->texture_array.stride));
-		}
-		indices = (uint16_t *)gpu_pool_memalign(count * sizeof(uint16_t), sizeof(uint16_t));
-		for (n = 0; n < count; n++) {
-			indices[n] = n;
-		}
-	} else {
-		uint8_t *ptr;
-		uint8_t *ptr_tex;
-		uint8_t *ptr_clr;
-		uint8_t vec_set = GL_FALSE;
-		uint8_t tex_set = (texcoords == NULL);
-		uint8_t clr_set = (clrs == NULL);
-		
-		vertices = (vector3f *)gpu_pool_memalign(count * sizeof(vector3f), sizeof(vector3f));
-		if (tex_unit->vertex_array.stride == 0) {
-			ptr = ((uint8_t *)tex_unit->vertex_array.pointer) + (first * (tex_unit->vertex_array.num * tex_unit->vertex_array.size));
-			memcpy_neon(&vertices[0], ptr, count * sizeof(vector3f));
-			vec_set = GL_TRUE;
-		} else
-			ptr = ((uint8_t *)tex_unit->vertex_array.pointer) + (first * tex_unit->vertex_array.stride);
-			
-		if (!tex_set) {
-			uv_map = (vector2f *)gpu_pool_memalign(count * sizeof(vector2f), sizeof(vector2f));
-			if (tex_unit->texture_array.stride == 0) {
-				ptr_tex = ((uint8_t *)tex_unit->texture_array.pointer) + (first * (tex_unit->texture_array.num * tex_unit->texture_array.size));
-				memcpy_neon(&uv_map[0], ptr_tex, count * sizeof(vector2f));
-				tex_set = GL_TRUE;
-			} else
-				ptr_tex = ((uint8_t *)tex_unit->texture_array.pointer) + (first * tex_unit->texture_array.stride);
+uint16_t *_glDrawArrays_GetQuadIndices(void) {
+	// Lazily building a persistent indices set covering the whole 16 bit vertices range
+	if (quad_indices == NULL) {
+		vglMemType type = VGL_MEM_RAM;
+		quad_indices = gpu_alloc_mapped(MAX_QUADS_NUM * 6 * sizeof(uint16_t), &type);
+		if (quad_indices == NULL)
+			return NULL;
+		int i;
+		uint16_t *ptr = quad_indices;
+		for (i = 0; i < MAX_QUADS_NUM * 4; i += 4) {
+			ptr[0] = i;
+			ptr[1] = i + 1;
+			ptr[2] = i + 3;
+			ptr[3] = i + 1;
+			ptr[4] = i + 2;
+			ptr[5] = i + 3;
+			ptr += 6;
 		}
+	}
+	return quad_indices;
+}
 
-		if (!clr_set) {
-			if (tex_unit->color_array_state || fake_clrs)
-				colors = (uint8_t *)gpu_pool_memalign(count * tex_unit->color_array.num * tex_unit->color_array.size, tex_unit->color_array.num * tex_unit->color_array.size);
-			if (tex_unit->color_array_state && !fake_clrs) {
-				if (tex_unit->color_array.stride == 0) {
-					ptr_clr = ((uint8_t *)tex_unit->color_array.pointer) + (first * ((tex_unit->color_array.num * tex_unit->color_array.size)));
-					memcpy_neon(&colors[0], ptr_clr, count * tex_unit->color_array.num * tex_unit->color_array.size);
-					clr_set = GL_TRUE;
-				} else
-					ptr_clr = ((uint8_t *)tex_unit->color_array.pointer) + (first * tex_unit->color_array.stride);
-			}
+uint8_t *_glDraw_CopyVertexArray(vertexArray *array, GLint first, uint32_t count) {
+	uint32_t size = array->size * array->num;
+	uint8_t *res = (uint8_t *)gpu_pool_memalign(count * size, array->size);
+	
+	// Packed arrays can be copied with a single transfer
+	if ((array->stride == 0) || (array->stride == size))
+		memcpy_neon(res, (uint8_t *)array->pointer + first * size, count * size);
+	else {
+		int i;
+		uint8_t *dst = res;
+		uint8_t *src = (uint8_t *)array->pointer + first * array->stride;
+		for (i = 0; i < count; i++) {
+			memcpy_neon(dst, src, size);
+			dst += size;
+			src += array->stride;
 		}
-		
-		vector4f *colors_float = (vector4f*)colors;
-		indices = (uint16_t *)gpu_pool_memalign(count * sizeof(uint16_t), sizeof(uint16_t));
+	}
+	return res;
+}
+
+GLboolean _glDraw_IsVertexArrayMapped(vertexArray *array) {
+	// Client arrays allocated on vitaGL mempools (eg. through vglAlloc) can be read directly by sceGxm
+	return (vertex_array_unit >= 0) || vgl_mem_is_mapped(array->pointer);
+}
+
+uint8_t *_glDraw_GetMappedVertexArray(vertexArray *array, GLint first) {
+	uint32_t stride = array->stride ? array->stride : array->size * array->num;
+	uint8_t *base = vertex_array_unit >= 0 ? (uint8_t *)gpu_buffers[vertex_array_unit].ptr : NULL;
+	return base + (uint32_t)array->pointer + first * stride;
+}
+
+uint8_t *_glDraw_GetVertexArray(vertexArray *array, GLint first, uint32_t count) {
+	if (_glDraw_IsVertexArrayMapped(array))
+		return _glDraw_GetMappedVertexArray(array, first);
+	uint32_t size = array->size * array->num;
+	uint32_t stride = array->stride ? array->stride : size;
+	uint8_t *res = (uint8_t *)array_cache_get((uint8_t *)array->pointer + first * stride, stride, size, count);
+	if (res)
+		return res;
+	return _glDraw_CopyVertexArray(array, first, count);
+}
+
+void _glDraw_GetStreamLayouts(stream_layout *layouts) {
+	// Bound vertex array object keeps resolved streams layout until its arrays change
+	if (cur_vao->cache_valid && (cur_vao->cache_client_unit == client_texture_unit)) {
+		memcpy(layouts, cur_vao->layouts, sizeof(cur_vao->layouts));
+		return;
+	}
+	texture_unit *tex_unit = &texture_units[client_texture_unit];
+	
+	// Positions keep GL integer semantic while texcoords and colors are normalized
+	layouts[0] = get_array_layout(&tex_unit->vertex_array, GL_FALSE, _glDraw_IsVertexArrayMapped(&tex_unit->vertex_array));
+	if (tex_unit->texture_array_state)
+		layouts[1] = get_array_layout(&tex_unit->texture_array, GL_TRUE, _glDraw_IsVertexArrayMapped(&tex_unit->texture_array));
+	if (tex_unit->color_array_state)
+		layouts[2] = get_array_layout(&tex_unit->color_array, GL_TRUE, _glDraw_IsVertexArrayMapped(&tex_unit->color_array));
+	else {
+		layouts[2].raw = 0;
+		layouts[2].format = SCE_GXM_ATTRIBUTE_FORMAT_F32;
+		layouts[2].num = 4;
+		layouts[2].index_source = SCE_GXM_INDEX_SOURCE_INSTANCE_16BIT;
+		layouts[2].stride = sizeof(vector4f);
+	}
+	if (texture_units[1].texture_array_state)
+		layouts[3] = get_array_layout(&texture_units[1].texture_array, GL_TRUE, _glDraw_IsVertexArrayMapped(&texture_units[1].texture_array));
+	if (tex_unit->normal_array_state)
+		layouts[4] = get_array_layout(&tex_unit->normal_array, GL_TRUE, _glDraw_IsVertexArrayMapped(&tex_unit->normal_array));
+	else
+		layouts[4].raw = 0;
+	
+	memcpy(cur_vao->layouts, layouts, sizeof(cur_vao->layouts));
+	cur_vao->cache_client_unit = client_texture_unit;
+	cur_vao->cache_valid = GL_TRUE;
+}
+
+void _glDrawArrays_SetupVertices(vector3f **verts, vector2f **texcoords, uint8_t **clrs, vector2f **texcoords1, uint8_t **nors, uint16_t **idxs, GLint first, GLsizei count) {
+	texture_unit *tex_unit = &texture_units[client_texture_unit];
+	GLboolean has_colors = (clrs != NULL) && tex_unit->color_array_state;
+	*verts = (vector3f *)_glDraw_GetVertexArray(&tex_unit->vertex_array, first, count);
+	if (texcoords) *texcoords = (vector2f *)_glDraw_GetVertexArray(&tex_unit->texture_array, first, count);
+	if (has_colors) *clrs = _glDraw_GetVertexArray(&tex_unit->color_array, first, count);
+	if (texcoords1) *texcoords1 = (vector2f *)_glDraw_GetVertexArray(&texture_units[1].texture_array, first, count);
+	if (nors) *nors = _glDraw_GetVertexArray(&tex_unit->normal_array, first, count);
+	
+	// Indices are generated only if not provided by the caller
+	if (*idxs == NULL) {
+		uint16_t n;
+		uint16_t *indices = (uint16_t *)gpu_pool_memalign(count * sizeof(uint16_t), sizeof(uint16_t));
 		for (n = 0; n < count; n++) {
-			if (!vec_set) {
-				memcpy_neon(&vertices[n], ptr, tex_unit->vertex_array.size * tex_unit->vertex_array.num);
-				ptr += tex_unit->vertex_array.stride;
-			}
-			if (!tex_set) {
-				memcpy_neon(&uv_map[n], ptr_tex, tex_unit->texture_array.size * tex_unit->texture_array.num);
-				ptr_tex += tex_unit->texture_array.stride;
-			}
-			if (!clr_set) {
-				if (fake_clrs) {
-					memcpy_neon(&colors_float[n], &current_color.r, sizeof(vector4f));
-				} else {
-					memcpy_neon(&colors[n * tex_unit->color_array.num * tex_unit->color_array.size], ptr_clr, tex_unit->color_array.size * tex_unit->color_array.num);
-					ptr_clr += tex_unit->color_array.stride;
-				}
-			}
 			indices[n] = n;
 		}
+		*idxs = indices;
 	}
-	
-	*verts = vertices;
-	if (texcoords) *texcoords = uv_map;
-	if (clrs) *clrs = colors;
-	*idxs = indices;
 }
 
 void glDrawArrays(GLenum mode, GLint first, GLsizei count) {
+	flush_imm_batch();
 	texture_unit *tex_unit = &texture_units[client_texture_unit];
 	int texture2d_idx = tex_unit->tex_id;
 	SceGxmPrimitiveType gxm_p;
 	if (tex_unit->vertex_array_state) {
 		GLboolean skip_draw = GL_FALSE;
+		uint16_t *indices = NULL;
+		GLsizei idx_count = count;
 		switch (mode) {
 		case GL_POINTS:
 			gxm_p = SCE_GXM_PRIMITIVE_POINTS;
@@ -1597,6 +2704,24 @@ void glDrawArrays(GLenum mode, GLint first, GLsizei count) {
 			if (no_polygons_mode)
 				skip_draw = GL_TRUE;
 			break;
+		case GL_QUADS:
+			gxm_p = SCE_GXM_PRIMITIVE_TRIANGLES;
+			if (no_polygons_mode || ((count % 4) != 0) || (count > MAX_QUADS_NUM * 4))
+				skip_draw = GL_TRUE;
+			else {
+				indices = _glDrawArrays_GetQuadIndices();
+				idx_count = (count / 4) * 6;
+				if (indices == NULL)
+					skip_draw = GL_TRUE;
+			}
+			break;
+		case GL_QUAD_STRIP: // Same vertices ordering of a triangle strip
+			gxm_p = SCE_GXM_PRIMITIVE_TRIANGLE_STRIP;
+			count &= ~1;
+			idx_count = count;
+			if (no_polygons_mode)
+				skip_draw = GL_TRUE;
+			break;
 		default:
 			SET_GL_ERROR(GL_INVALID_ENUM)
 			break;
@@ -1606,70 +2731,66 @@ void glDrawArrays(GLenum mode, GLint first, GLsizei count) {
 				matrix4x4_multiply(mvp_matrix, projection_matrix, modelview_matrix);
 				mvp_modified = GL_FALSE;
 			}
+			stream_layout layouts[5];
+			_glDraw_GetStreamLayouts(layouts);
 #if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
-			if (is_shark_online) {
-				uint16_t *indices;
+			if (is_shark_online && reload_ffp_shaders(layouts)) {
 				vector3f *vertices = NULL;
 				vector2f *uv_map = NULL;
 				uint8_t *colors = NULL;
-				reload_ffp_shaders();
+				vector2f *uv_map1 = NULL;
+				uint8_t *normals = NULL;
 				if (tex_unit->texture_array_state) {
 					if (!(texture_slots[texture2d_idx].valid))
 						return;
 					sceGxmSetFragmentTexture(gxm_context, 0, &texture_slots[texture2d_idx].gxm_tex);
-					_glDrawArrays_SetupVertices(&vertices, &uv_map, ffp_vertex_num_params > 2 ? &colors : NULL, &indices, first, count, GL_FALSE);
+					_glDrawArrays_SetupVertices(&vertices, &uv_map, &colors, ffp_has_texture1 ? &uv_map1 : NULL, ffp_has_normals ? &normals : NULL, &indices, first, count);
 					sceGxmSetVertexStream(gxm_context, 1, uv_map);
-					if (ffp_vertex_num_params > 2) sceGxmSetVertexStream(gxm_context, 2, colors);
-				} else if (ffp_vertex_num_params > 1) {
-					_glDrawArrays_SetupVertices(&vertices, NULL, &colors, &indices, first, count, GL_FALSE);
-					sceGxmSetVertexStream(gxm_context, 1, colors);
-				} else {
-					_glDrawArrays_SetupVertices(&vertices, NULL, NULL, &indices, first, count, GL_FALSE);
-				}
+					if (ffp_has_texture1) {
+						sceGxmSetFragmentTexture(gxm_context, 1, &texture_slots[texture_units[1].tex_id].gxm_tex);
+						sceGxmSetVertexStream(gxm_context, ffp_stream_idx[3], uv_map1);
+					}
+				} else
+					_glDrawArrays_SetupVertices(&vertices, NULL, &colors, NULL, ffp_has_normals ? &normals : NULL, &indices, first, count);
+				if (tex_unit->color_array_state) sceGxmSetVertexStream(gxm_context, ffp_stream_idx[2], colors);
+				if (ffp_has_normals) sceGxmSetVertexStream(gxm_context, ffp_stream_idx[4], normals);
 				sceGxmSetVertexStream(gxm_context, 0, vertices);
 				upload_ffp_uniforms();
-				sceGxmDraw(gxm_context, gxm_p, SCE_GXM_INDEX_FORMAT_U16, indices, count);
+				sceGxmDraw(gxm_context, gxm_p, SCE_GXM_INDEX_FORMAT_U16, indices, idx_count);
 			} else {
 #endif
 				if (tex_unit->texture_array_state) {
 					if (!(texture_slots[texture2d_idx].valid))
 						return;
-					if (tex_unit->color_array_state) {
-						sceGxmSetVertexProgram(gxm_context, texture2d_rgba_vertex_program_patched);
-						update_precompiled_ffp_frag_shader(texture2d_rgba_fragment_id, &texture2d_rgba_fragment_program_patched, &texture2d_rgba_blend_cfg);
-						upload_tex2d_uniforms(texture2d_rgba_generic_unifs);
-					} else {
-						sceGxmSetVertexProgram(gxm_context, texture2d_vertex_program_patched);
-						update_precompiled_ffp_frag_shader(texture2d_fragment_id, &texture2d_fragment_program_patched, &texture2d_blend_cfg);
-						upload_tex2d_uniforms(texture2d_generic_unifs);
-					}
+					setup_tex2d_programs(tex_unit->color_array_state, layouts);
 					sceGxmSetFragmentTexture(gxm_context, 0, &texture_slots[texture2d_idx].gxm_tex);
-					uint16_t *indices;
 					vector3f *vertices = NULL;
 					vector2f *uv_map = NULL;
 					uint8_t *colors = NULL;
-					_glDrawArrays_SetupVertices(&vertices, &uv_map, &colors, &indices, first, count, GL_FALSE);
+					_glDrawArrays_SetupVertices(&vertices, &uv_map, &colors, NULL, NULL, &indices, first, count);
 					sceGxmSetVertexStream(gxm_context, 0, vertices);
 					sceGxmSetVertexStream(gxm_context, 1, uv_map);
 					if (tex_unit->color_array_state)
 						sceGxmSetVertexStream(gxm_context, 2, colors);
-					sceGxmDraw(gxm_context, gxm_p, SCE_GXM_INDEX_FORMAT_U16, indices, count);
+					sceGxmDraw(gxm_context, gxm_p, SCE_GXM_INDEX_FORMAT_U16, indices, idx_count);
 				} else {
-					if (tex_unit->color_array_state && (tex_unit->color_array.num == 3))
-						sceGxmSetVertexProgram(gxm_context, rgb_vertex_program_patched);
-					else
-						sceGxmSetVertexProgram(gxm_context, rgba_vertex_program_patched);
+					layouts[1] = layouts[2];
+					sceGxmSetVertexProgram(gxm_context, get_vertex_program_variant(rgba_vertex_id, rgba_attr_regs, layouts, 2));
 					update_precompiled_ffp_frag_shader(rgba_fragment_id, &rgba_fragment_program_patched, &rgba_blend_cfg);
 					vector3f *vertices = NULL;
 					uint8_t *colors = NULL;
-					uint16_t *indices;
 					void *vbuffer;
 					sceGxmReserveVertexDefaultUniformBuffer(gxm_context, &vbuffer);
 					sceGxmSetUniformDataF(vbuffer, rgba_wvp, 0, 16, (const float *)mvp_matrix);
-					_glDrawArrays_SetupVertices(&vertices, NULL, &colors, &indices, first, count, tex_unit->color_array_state ? GL_FALSE : GL_TRUE);
+					if (tex_unit->color_array_state) {
+						_glDrawArrays_SetupVertices(&vertices, NULL, &colors, NULL, NULL, &indices, first, count);
+						sceGxmSetVertexStream(gxm_context, 1, colors);
+					} else {
+						_glDrawArrays_SetupVertices(&vertices, NULL, NULL, NULL, NULL, &indices, first, count);
+						sceGxmSetVertexStream(gxm_context, 1, upload_const_color());
+					}
 					sceGxmSetVertexStream(gxm_context, 0, vertices);
-					sceGxmSetVertexStream(gxm_context, 1, colors);
-					sceGxmDraw(gxm_context, gxm_p, SCE_GXM_INDEX_FORMAT_U16, indices, count);
+					sceGxmDraw(gxm_context, gxm_p, SCE_GXM_INDEX_FORMAT_U16, indices, idx_count);
 				}
 #if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
 			}
@@ -1678,6 +2799,41 @@ void glDrawArrays(GLenum mode, GLint first, GLsizei count) {
 	}
 }
 
+void _glDrawElements_ConvertQuadIndices(uint16_t *dst, const uint16_t *src, GLsizei quads_num) {
+	int i = 0;
+	
+	// Converting 4 quads per iteration: (a, b, c, d) -> (a, b, d, b, c, d)
+	for (; i + 4 <= quads_num; i += 4) {
+		uint16x4x4_t q = vld4_u16(src);
+		uint16x4x2_t ab = vzip_u16(q.val[0], q.val[1]);
+		uint16x4x2_t db = vzip_u16(q.val[3], q.val[1]);
+		uint16x4x2_t cd = vzip_u16(q.val[2], q.val[3]);
+		uint32x2x3_t t;
+		t.val[0] = vreinterpret_u32_u16(ab.val[0]);
+		t.val[1] = vreinterpret_u32_u16(db.val[0]);
+		t.val[2] = vreinterpret_u32_u16(cd.val[0]);
+		vst3_u32((uint32_t *)dst, t);
+		t.val[0] = vreinterpret_u32_u16(ab.val[1]);
+		t.val[1] = vreinterpret_u32_u16(db.val[1]);
+		t.val[2] = vreinterpret_u32_u16(cd.val[1]);
+		vst3_u32((uint32_t *)&dst[12], t);
+		src += 16;
+		dst += 24;
+	}
+	
+	// Converting remaining quads
+	for (; i < quads_num; i++) {
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[3];
+		dst[3] = src[1];
+		dst[4] = src[2];
+		dst[5] = src[3];
+		src += 4;
+		dst += 6;
+	}
+}
+
 uint64_t _glDrawElements_CountVertices(GLsizei count, uint16_t *ptr_idx) {
 	int j = 0;
 	uint64_t vertex_count_int = 0;
@@ -1689,142 +2845,101 @@ uint64_t _glDrawElements_CountVertices(GLsizei count, uint16_t *ptr_idx) {
 	return vertex_count_int;
 }
 
-void _glDrawElements_SetupVertices(int dim, vector3f **verts, vector2f **texcoords, uint8_t **clrs, GLsizei count, const GLvoid *gl_indices) {
-	texture_unit *tex_unit = &texture_units[client_texture_unit];
-	switch (dim) {
-		case 1: // Position
-			{
-				vector3f *vertices;
-				if (vertex_array_unit >= 0)
-					vertices = (vector3f *)((uint32_t)gpu_buffers[vertex_array_unit].ptr + (uint32_t)tex_unit->vertex_array.pointer);
-				else {
-					uint64_t vertex_count_int =  _glDrawElements_CountVertices(count, (uint16_t*)gl_indices);
-					vertices = (vector3f *)gpu_pool_memalign(vertex_count_int * sizeof(vector3f), sizeof(vector3f));
-					if ((!vertex_array_unit) && tex_unit->vertex_array.stride == 0)
-						memcpy_neon(vertices, tex_unit->vertex_array.pointer, vertex_count_int * (tex_unit->vertex_array.size * tex_unit->vertex_array.num));
-					if ((!vertex_array_unit) && tex_unit->vertex_array.stride != 0)
-						memset(vertices, 0, (vertex_count_int * sizeof(texture2d_vertex)));
-					uint8_t *ptr = ((uint8_t *)tex_unit->vertex_array.pointer);
-					int n = 0;
-					for (n = 0; n < vertex_count_int; n++) {
-						if ((!vertex_array_unit) && tex_unit->vertex_array.stride != 0)
-							memcpy_neon(&vertices[n], ptr, tex_unit->vertex_array.size * tex_unit->vertex_array.num);
-						if (!vertex_array_unit)
-							ptr += tex_unit->vertex_array.stride;
-					}
-				}
-				*verts = vertices;
-			}
-			break;
-		case 2: // Position + Colors
-			{
-				vector3f *vertices;
-				uint8_t *colors;
-				if (vertex_array_unit >= 0) {
-					colors = (uint8_t *)((uint32_t)gpu_buffers[vertex_array_unit].ptr + (uint32_t)tex_unit->color_array.pointer);
-					vertices = (vector3f *)((uint32_t)gpu_buffers[vertex_array_unit].ptr + (uint32_t)tex_unit->vertex_array.pointer);
-				} else {
-					uint64_t vertex_count_int =  _glDrawElements_CountVertices(count, (uint16_t*)gl_indices);
-					vertices = (vector3f *)gpu_pool_memalign(vertex_count_int * sizeof(vector3f), sizeof(vector3f));
-					colors = (uint8_t *)gpu_pool_memalign(vertex_count_int * tex_unit->color_array.num * tex_unit->color_array.size, tex_unit->color_array.num * tex_unit->color_array.size);
-					if (tex_unit->vertex_array.stride == 0)
-						memcpy_neon(vertices, tex_unit->vertex_array.pointer, vertex_count_int * (tex_unit->vertex_array.size * tex_unit->vertex_array.num));
-					if (tex_unit->color_array.stride == 0)
-						memcpy_neon(colors, tex_unit->color_array.pointer, vertex_count_int * (tex_unit->color_array.size * tex_unit->color_array.num));
-					if ((tex_unit->vertex_array.stride != 0) || (tex_unit->color_array.stride != 0)) {
-						if (tex_unit->vertex_array.stride != 0)
-							memset(vertices, 0, (vertex_count_int * sizeof(texture2d_vertex)));
-						uint8_t *ptr = ((uint8_t *)tex_unit->vertex_array.pointer);
-						uint8_t *ptr_clr = ((uint8_t *)tex_unit->color_array.pointer);
-						int n;
-						for (n = 0; n < vertex_count_int; n++) {
-							if (tex_unit->vertex_array.stride != 0)
-								memcpy_neon(&vertices[n], ptr, tex_unit->vertex_array.size * tex_unit->vertex_array.num);
-							if (tex_unit->color_array.stride != 0)
-								memcpy_neon(&colors[n * tex_unit->color_array.num * tex_unit->color_array.size], ptr_clr, tex_unit->color_array.size * tex_unit->color_array.num);
-							ptr += tex_unit->vertex_array.stride;
-							ptr_clr += tex_unit->color_array.stride;
-						}
-					}
-				}
-				*verts = vertices;
-				*clrs = colors;
-			}
-			break;
-		case 3: // Position + Texcoords + Colors
-			{
-				vector3f *vertices;
-				uint8_t *colors;
-				vector2f *uv_map;
-				if (vertex_array_unit >= 0) {
-					vertices = (vector3f *)((uint32_t)gpu_buffers[vertex_array_unit].ptr + (uint32_t)tex_unit->vertex_array.pointer);
-					uv_map = (vector2f *)((uint32_t)gpu_buffers[vertex_array_unit].ptr + (uint32_t)tex_unit->texture_array.pointer);
-					if (tex_unit->color_array_state)
-						colors = (uint8_t *)((uint32_t)gpu_buffers[vertex_array_unit].ptr + (uint32_t)tex_unit->color_array.pointer);
-				} else {
-					uint64_t vertex_count_int =  _glDrawElements_CountVertices(count, (uint16_t*)gl_indices);
-					vertices = (vector3f *)gpu_pool_memalign(vertex_count_int * sizeof(vector3f), sizeof(vector3f));
-					uv_map = (vector2f *)gpu_pool_memalign(vertex_count_int * sizeof(vector2f), sizeof(vector2f));
-					colors = (uint8_t *)gpu_pool_memalign(vertex_count_int * sizeof(vector4f), sizeof(vector4f));
-					if (tex_unit->vertex_array.stride == 0)
-						memcpy_neon(vertices, tex_unit->vertex_array.pointer, vertex_count_int * (tex_unit->vertex_array.size * tex_unit->vertex_array.num));
-					if (tex_unit->texture_array.stride == 0)
-						memcpy_neon(uv_map, tex_unit->texture_array.pointer, vertex_count_int * (tex_unit->texture_array.size * tex_unit->texture_array.num));
-					if (tex_unit->color_array_state && (tex_unit->color_array.stride == 0))
-						memcpy_neon(colors, tex_unit->color_array.pointer, vertex_count_int * (tex_unit->color_array.size * tex_unit->color_array.num));
-					if ((tex_unit->vertex_array.stride != 0) || (tex_unit->texture_array.stride != 0)) {
-						if (tex_unit->vertex_array.stride != 0)
-							memset(vertices, 0, (vertex_count_int * sizeof(texture2d_vertex)));
-						uint8_t *ptr = ((uint8_t *)tex_unit->vertex_array.pointer);
-						uint8_t *ptr_tex = ((uint8_t *)tex_unit->texture_array.pointer);
-						int n = 0;
-						for (n = 0; n < vertex_count_int; n++) {
-							if (tex_unit->vertex_array.stride != 0)
-								memcpy_neon(&vertices[n], ptr, tex_unit->vertex_array.size * tex_unit->vertex_array.num);
-							if (tex_unit->texture_array.stride != 0)
-								memcpy_neon(&uv_map[n], ptr_tex, tex_unit->texture_array.size * tex_unit->texture_array.num);
-							ptr += tex_unit->vertex_array.stride;
-							ptr_tex += tex_unit->texture_array.stride;
-						}
-					}
-				}
-				*verts = vertices;
-				*clrs = colors;
-				*texcoords = uv_map;
+GLboolean _glDrawElements_CompactVertices(vertexArray **arrays, uint8_t **dsts, int num, GLsizei count, uint16_t **idxs) {
+	int i, j;
+	
+	// Lazily allocating the remap table, generation stamp is stored in the upper 16 bits of every entry
+	if (!remap_table) {
+		remap_table = (uint32_t *)calloc(0x10000, sizeof(uint32_t));
+		if (!remap_table)
+			return GL_FALSE;
+	}
+	if (++remap_gen == 0) {
+		memset(remap_table, 0, 0x10000 * sizeof(uint32_t));
+		remap_gen = 1;
+	}
+	uint32_t stamp = (uint32_t)remap_gen << 16;
+	
+	// Referenced vertices are at most as many as indices
+	const uint8_t *srcs[3];
+	uint32_t sizes[3], strides[3];
+	for (j = 0; j < num; j++) {
+		sizes[j] = arrays[j]->size * arrays[j]->num;
+		strides[j] = arrays[j]->stride ? arrays[j]->stride : sizes[j];
+		srcs[j] = (const uint8_t *)arrays[j]->pointer;
+		dsts[j] = (uint8_t *)gpu_pool_memalign(count * sizes[j], arrays[j]->size);
+	}
+	
+	// Remapping indices to a dense set while gathering referenced vertices
+	const uint16_t *src = *idxs;
+	uint16_t *dst = (uint16_t *)gpu_pool_memalign(count * sizeof(uint16_t), sizeof(uint16_t));
+	uint32_t n = 0;
+	for (i = 0; i < count; i++) {
+		uint16_t idx = src[i];
+		uint32_t entry = remap_table[idx];
+		if ((entry & 0xFFFF0000) != stamp) {
+			entry = stamp | n;
+			remap_table[idx] = entry;
+			for (j = 0; j < num; j++) {
+				memcpy(&dsts[j][n * sizes[j]], &srcs[j][idx * strides[j]], sizes[j]);
 			}
-			break;
-		case 4: // Position + Fake Colors
-			{
-				vector3f *vertices;
-				uint8_t *colors;
-				uint64_t vertex_count_int =  _glDrawElements_CountVertices(count, (uint16_t*)gl_indices);
-				if (vertex_array_unit >= 0)
-					vertices = (vector3f *)((uint32_t)gpu_buffers[vertex_array_unit].ptr + (uint32_t)tex_unit->vertex_array.pointer);
-				else
-					vertices = (vector3f *)gpu_pool_memalign(vertex_count_int * sizeof(vector3f), sizeof(vector3f));
-				colors = (uint8_t *)gpu_pool_memalign(vertex_count_int * tex_unit->color_array.num * tex_unit->color_array.size, tex_unit->color_array.num * tex_unit->color_array.size);
-				if ((!vertex_array_unit) && tex_unit->vertex_array.stride == 0)
-					memcpy_neon(vertices, tex_unit->vertex_array.pointer, vertex_count_int * (tex_unit->vertex_array.size * tex_unit->vertex_array.num));
-				if ((!vertex_array_unit) && tex_unit->vertex_array.stride != 0)
-					memset(vertices, 0, (vertex_count_int * sizeof(texture2d_vertex)));
-				uint8_t *ptr = ((uint8_t *)tex_unit->vertex_array.pointer);
-				int n = 0;
-				vector4f *colors_float = (vector4f*)colors;
-				for (n = 0; n < vertex_count_int; n++) {
-					if ((!vertex_array_unit) && tex_unit->vertex_array.stride != 0)
-						memcpy_neon(&vertices[n], ptr, tex_unit->vertex_array.size * tex_unit->vertex_array.num);
-					memcpy_neon(&colors_float[n], &current_color.r, sizeof(vector4f));
-					if (!vertex_array_unit)
-						ptr += tex_unit->vertex_array.stride;
-				}
-				*verts = vertices;
-				*clrs = colors;
+			n++;
+		}
+		dst[i] = entry & 0xFFFF;
+	}
+	*idxs = dst;
+	return GL_TRUE;
+}
+
+void _glDrawElements_SetupVertices(vector3f **verts, vector2f **texcoords, uint8_t **clrs, vector2f **texcoords1, uint8_t **nors, GLsizei count, uint16_t **idxs) {
+	texture_unit *tex_unit = &texture_units[client_texture_unit];
+	GLboolean has_colors = (clrs != NULL) && tex_unit->color_array_state;
+	GLboolean verts_mapped = _glDraw_IsVertexArrayMapped(&tex_unit->vertex_array);
+	GLboolean texcoords_mapped = texcoords ? _glDraw_IsVertexArrayMapped(&tex_unit->texture_array) : verts_mapped;
+	GLboolean clrs_mapped = has_colors ? _glDraw_IsVertexArrayMapped(&tex_unit->color_array) : verts_mapped;
+	GLboolean texcoords1_mapped = texcoords1 ? _glDraw_IsVertexArrayMapped(&texture_units[1].texture_array) : verts_mapped;
+	GLboolean nors_mapped = nors ? _glDraw_IsVertexArrayMapped(&tex_unit->normal_array) : verts_mapped;
+	
+	// Vertices count is required only if at least one array needs to be copied on vitaGL mempool
+	uint64_t vertex_count_int = 0;
+	if (!verts_mapped || !texcoords_mapped || !clrs_mapped || !texcoords1_mapped || !nors_mapped) {
+		vertex_count_int = _glDrawElements_CountVertices(count, *idxs);
+		
+		// If the draw references a small subset of a big client array, copying only used vertices is cheaper
+		if (!verts_mapped && !texcoords_mapped && !clrs_mapped && !texcoords1_mapped && !nors_mapped && (vertex_count_int > COMPACTION_RATIO * count)) {
+			vertexArray *arrays[5];
+			uint8_t *dsts[5];
+			int num = 0;
+			arrays[num++] = &tex_unit->vertex_array;
+			if (texcoords)
+				arrays[num++] = &tex_unit->texture_array;
+			if (has_colors)
+				arrays[num++] = &tex_unit->color_array;
+			if (texcoords1)
+				arrays[num++] = &texture_units[1].texture_array;
+			if (nors)
+				arrays[num++] = &tex_unit->normal_array;
+			if (_glDrawElements_CompactVertices(arrays, dsts, num, count, idxs)) {
+				num = 0;
+				*verts = (vector3f *)dsts[num++];
+				if (texcoords) *texcoords = (vector2f *)dsts[num++];
+				if (has_colors) *clrs = dsts[num++];
+				if (texcoords1) *texcoords1 = (vector2f *)dsts[num++];
+				if (nors) *nors = dsts[num];
+				return;
 			}
-			break;
+		}
 	}
+	
+	*verts = (vector3f *)_glDraw_GetVertexArray(&tex_unit->vertex_array, 0, vertex_count_int);
+	if (texcoords) *texcoords = (vector2f *)_glDraw_GetVertexArray(&tex_unit->texture_array, 0, vertex_count_int);
+	if (has_colors) *clrs = _glDraw_GetVertexArray(&tex_unit->color_array, 0, vertex_count_int);
+	if (texcoords1) *texcoords1 = (vector2f *)_glDraw_GetVertexArray(&texture_units[1].texture_array, 0, vertex_count_int);
+	if (nors) *nors = _glDraw_GetVertexArray(&tex_unit->normal_array, 0, vertex_count_int);
 }
 
 void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *gl_indices) {
+	flush_imm_batch();
 	SceGxmPrimitiveType gxm_p;
 	texture_unit *tex_unit = &texture_units[client_texture_unit];
 	int texture2d_idx = tex_unit->tex_id;
@@ -1861,15 +2976,34 @@ void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *gl_in
 			if (no_polygons_mode)
 				skip_draw = GL_TRUE;
 			break;
+		case GL_QUADS:
+			gxm_p = SCE_GXM_PRIMITIVE_TRIANGLES;
+			if (no_polygons_mode || ((count % 4) != 0))
+				skip_draw = GL_TRUE;
+			break;
+		case GL_QUAD_STRIP: // Same vertices ordering of a triangle strip
+			gxm_p = SCE_GXM_PRIMITIVE_TRIANGLE_STRIP;
+			count &= ~1;
+			if (no_polygons_mode)
+				skip_draw = GL_TRUE;
+			break;
 		default:
 			SET_GL_ERROR(GL_INVALID_ENUM)
 			break;
 		}
 		if (!skip_draw) {
 			uint16_t *indices;
-			if (index_array_unit >= 0)
+			GLsizei idx_count = count;
+			if (mode == GL_QUADS) {
+				const uint16_t *src = index_array_unit >= 0 ? (uint16_t *)((uint32_t)gpu_buffers[index_array_unit].ptr + (uint32_t)gl_indices) : gl_indices;
+				idx_count = (count / 4) * 6;
+				indices = (uint16_t *)gpu_pool_memalign(idx_count * sizeof(uint16_t), sizeof(uint32_t));
+				_glDrawElements_ConvertQuadIndices(indices, src, count / 4);
+			} else if (index_array_unit >= 0)
 				indices = (uint16_t *)((uint32_t)gpu_buffers[index_array_unit].ptr + (uint32_t)gl_indices);
-			else {
+			else if (vgl_mem_is_mapped(gl_indices))
+				indices = (uint16_t *)gl_indices;
+			else if (!(indices = (uint16_t *)array_cache_get(gl_indices, sizeof(uint16_t), sizeof(uint16_t), count))) {
 				indices = (uint16_t *)gpu_pool_memalign(count * sizeof(uint16_t), sizeof(uint16_t));
 				memcpy_neon(indices, gl_indices, sizeof(uint16_t) * count);
 			}
@@ -1877,67 +3011,66 @@ void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *gl_in
 				matrix4x4_multiply(mvp_matrix, projection_matrix, modelview_matrix);
 				mvp_modified = GL_FALSE;
 			}
+			stream_layout layouts[5];
+			_glDraw_GetStreamLayouts(layouts);
 #if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
-			if (is_shark_online) {
+			if (is_shark_online && reload_ffp_shaders(layouts)) {
 				vector3f *vertices = NULL;
 				vector2f *uv_map = NULL;
 				uint8_t *colors = NULL;
-				reload_ffp_shaders();
+				vector2f *uv_map1 = NULL;
+				uint8_t *normals = NULL;
 				if (tex_unit->texture_array_state) {
 					if (!(texture_slots[texture2d_idx].valid))
 						return;
 					sceGxmSetFragmentTexture(gxm_context, 0, &texture_slots[texture2d_idx].gxm_tex);
-					_glDrawElements_SetupVertices(3, &vertices, &uv_map, &colors, count, gl_indices);
+					_glDrawElements_SetupVertices(&vertices, &uv_map, &colors, ffp_has_texture1 ? &uv_map1 : NULL, ffp_has_normals ? &normals : NULL, idx_count, &indices);
 					sceGxmSetVertexStream(gxm_context, 1, uv_map);
-					if (ffp_vertex_num_params > 2) sceGxmSetVertexStream(gxm_context, 2, colors);
-				} else if (ffp_vertex_num_params > 1) {
-					_glDrawElements_SetupVertices(2, &vertices, NULL, &colors, count, gl_indices);
-					sceGxmSetVertexStream(gxm_context, 1, colors);
-				} else {
-					_glDrawElements_SetupVertices(1, &vertices, NULL, NULL, count, gl_indices);
-				}
+					if (ffp_has_texture1) {
+						sceGxmSetFragmentTexture(gxm_context, 1, &texture_slots[texture_units[1].tex_id].gxm_tex);
+						sceGxmSetVertexStream(gxm_context, ffp_stream_idx[3], uv_map1);
+					}
+				} else
+					_glDrawElements_SetupVertices(&vertices, NULL, &colors, NULL, ffp_has_normals ? &normals : NULL, idx_count, &indices);
+				if (tex_unit->color_array_state) sceGxmSetVertexStream(gxm_context, ffp_stream_idx[2], colors);
+				if (ffp_has_normals) sceGxmSetVertexStream(gxm_context, ffp_stream_idx[4], normals);
 				sceGxmSetVertexStream(gxm_context, 0, vertices);
 				upload_ffp_uniforms();
-				sceGxmDraw(gxm_context, gxm_p, SCE_GXM_INDEX_FORMAT_U16, indices, count);
+				sceGxmDraw(gxm_context, gxm_p, SCE_GXM_INDEX_FORMAT_U16, indices, idx_count);
 			} else {
 #endif
 				if (tex_unit->texture_array_state) {
 					if (!(texture_slots[texture2d_idx].valid))
 						return;
-					if (tex_unit->color_array_state) {
-						sceGxmSetVertexProgram(gxm_context, texture2d_rgba_vertex_program_patched);
-						update_precompiled_ffp_frag_shader(texture2d_rgba_fragment_id, &texture2d_rgba_fragment_program_patched, &texture2d_rgba_blend_cfg);
-						upload_tex2d_uniforms(texture2d_rgba_generic_unifs);
-					} else {
-						sceGxmSetVertexProgram(gxm_context, texture2d_vertex_program_patched);
-						update_precompiled_ffp_frag_shader(texture2d_fragment_id, &texture2d_fragment_program_patched, &texture2d_blend_cfg);
-						upload_tex2d_uniforms(texture2d_generic_unifs);
-					}
+					setup_tex2d_programs(tex_unit->color_array_state, layouts);
 					sceGxmSetFragmentTexture(gxm_context, 0, &texture_slots[texture2d_idx].gxm_tex);
 					vector3f *vertices = NULL;
 					vector2f *uv_map = NULL;
 					uint8_t *colors = NULL;
-					_glDrawElements_SetupVertices(3, &vertices, &uv_map, &colors, count, gl_indices);
+					_glDrawElements_SetupVertices(&vertices, &uv_map, &colors, NULL, NULL, idx_count, &indices);
 					sceGxmSetVertexStream(gxm_context, 0, vertices);
 					sceGxmSetVertexStream(gxm_context, 1, uv_map);
 					if (tex_unit->color_array_state)
 						sceGxmSetVertexStream(gxm_context, 2, colors);
-					sceGxmDraw(gxm_context, gxm_p, SCE_GXM_INDEX_FORMAT_U16, indices, count);
+					sceGxmDraw(gxm_context, gxm_p, SCE_GXM_INDEX_FORMAT_U16, indices, idx_count);
 				} else {
-					if (tex_unit->color_array_state && (tex_unit->color_array.num == 3))
-						sceGxmSetVertexProgram(gxm_context, rgb_vertex_program_patched);
-					else
-						sceGxmSetVertexProgram(gxm_context, rgba_vertex_program_patched);
+					layouts[1] = layouts[2];
+					sceGxmSetVertexProgram(gxm_context, get_vertex_program_variant(rgba_vertex_id, rgba_attr_regs, layouts, 2));
 					update_precompiled_ffp_frag_shader(rgba_fragment_id, &rgba_fragment_program_patched, &rgba_blend_cfg);
 					void *vbuffer;
 					sceGxmReserveVertexDefaultUniformBuffer(gxm_context, &vbuffer);
 					sceGxmSetUniformDataF(vbuffer, rgba_wvp, 0, 16, (const float *)mvp_matrix);
 					vector3f *vertices = NULL;
 					uint8_t *colors = NULL;
-					_glDrawElements_SetupVertices(tex_unit->color_array_state ? 2 : 4, &vertices, NULL, &colors, count, gl_indices);
+					if (tex_unit->color_array_state) {
+						_glDrawElements_SetupVertices(&vertices, NULL, &colors, NULL, NULL, idx_count, &indices);
+						sceGxmSetVertexStream(gxm_context, 1, colors);
+					} else {
+						_glDrawElements_SetupVertices(&vertices, NULL, NULL, NULL, NULL, idx_count, &indices);
+						sceGxmSetVertexStream(gxm_context, 1, upload_const_color());
+					}
 					sceGxmSetVertexStream(gxm_context, 0, vertices);
-					sceGxmSetVertexStream(gxm_context, 1, colors);
-					sceGxmDraw(gxm_context, gxm_p, SCE_GXM_INDEX_FORMAT_U16, indices, count);
+					sceGxmDraw(gxm_context, gxm_p, SCE_GXM_INDEX_FORMAT_U16, indices, idx_count);
 				}
 #if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
 			}
@@ -1948,6 +3081,7 @@ void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *gl_in
 
 void glEnableClientState(GLenum array) {
 	texture_unit *tex_unit = &texture_units[client_texture_unit];
+	cur_vao->cache_valid = GL_FALSE;
 	switch (array) {
 	case GL_VERTEX_ARRAY:
 		tex_unit->vertex_array_state = GL_TRUE;
@@ -1966,6 +3100,12 @@ void glEnableClientState(GLenum array) {
 #endif
 		tex_unit->texture_array_state = GL_TRUE;
 		break;
+	case GL_NORMAL_ARRAY:
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+		ffp_dirty_vert = GL_TRUE;
+#endif
+		tex_unit->normal_array_state = GL_TRUE;
+		break;
 	default:
 		SET_GL_ERROR(GL_INVALID_ENUM)
 		break;
@@ -1974,6 +3114,7 @@ void glEnableClientState(GLenum array) {
 
 void glDisableClientState(GLenum array) {
 	texture_unit *tex_unit = &texture_units[client_texture_unit];
+	cur_vao->cache_valid = GL_FALSE;
 	switch (array) {
 	case GL_VERTEX_ARRAY:
 		tex_unit->vertex_array_state = GL_FALSE;
@@ -1992,6 +3133,12 @@ void glDisableClientState(GLenum array) {
 #endif
 		tex_unit->texture_array_state = GL_FALSE;
 		break;
+	case GL_NORMAL_ARRAY:
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+		ffp_dirty_vert = GL_TRUE;
+#endif
+		tex_unit->normal_array_state = GL_FALSE;
+		break;
 	default:
 		SET_GL_ERROR(GL_INVALID_ENUM)
 		break;
@@ -2177,6 +3324,7 @@ void vglIndexPointerMapped(const GLvoid *pointer) {
 }
 
 void vglDrawObjects(GLenum mode, GLsizei count, GLboolean implicit_wvp) {
+	flush_imm_batch();
 	SceGxmPrimitiveType gxm_p;
 #ifndef SKIP_ERROR_HANDLING
 	if (phase == MODEL_CREATION) {
@@ -2214,7 +3362,7 @@ void vglDrawObjects(GLenum mode, GLsizei count, GLboolean implicit_wvp) {
 	}
 	if (!skip_draw) {
 		if (cur_program != 0) {
-			_vglDrawObjects_CustomShadersIMPL(mode, count, implicit_wvp);
+			_vglDrawObjects_CustomShadersIMPL(mode, count, 1, implicit_wvp);
 			sceGxmDraw(gxm_context, gxm_p, SCE_GXM_INDEX_FORMAT_U16, texture_units[client_texture_unit].index_object, count);
 		} else {
 			texture_unit *tex_unit = &texture_units[client_texture_unit];
@@ -2225,15 +3373,35 @@ void vglDrawObjects(GLenum mode, GLsizei count, GLboolean implicit_wvp) {
 					mvp_modified = GL_FALSE;
 				}
 #if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
-				if (is_shark_online) {
-					reload_ffp_shaders();
+				// Objects arrays are always fed as packed float positions and texcoords
+				stream_layout layouts[5];
+				int componentCount = tex_unit->color_array.num > 0 ? tex_unit->color_array.num : 4; // TODO: This is ugly and probably wrong
+				layouts[0].raw = 0;
+				layouts[0].format = SCE_GXM_ATTRIBUTE_FORMAT_F32;
+				layouts[0].num = 3;
+				layouts[0].stride = sizeof(vector3f);
+				layouts[1].raw = 0;
+				layouts[1].format = SCE_GXM_ATTRIBUTE_FORMAT_F32;
+				layouts[1].num = 2;
+				layouts[1].stride = sizeof(vector2f);
+				layouts[2].raw = 0;
+				layouts[2].format = tex_unit->color_object_type == GL_FLOAT ? SCE_GXM_ATTRIBUTE_FORMAT_F32 : SCE_GXM_ATTRIBUTE_FORMAT_U8N;
+				layouts[2].num = componentCount;
+				layouts[2].stride = componentCount * (tex_unit->color_object_type == GL_FLOAT ? sizeof(float) : sizeof(uint8_t));
+				layouts[3] = layouts[1];
+				layouts[4].raw = 0; // Objects have no normals array, current normal is used for lighting
+				if (is_shark_online && reload_ffp_shaders(layouts)) {
 					if (tex_unit->texture_array_state) {
 						if (!(texture_slots[texture2d_idx].valid))
 							return;
 						sceGxmSetFragmentTexture(gxm_context, 0, &texture_slots[texture2d_idx].gxm_tex);
 						sceGxmSetVertexStream(gxm_context, 1, tex_unit->texture_object);
-						if (ffp_vertex_num_params > 2) sceGxmSetVertexStream(gxm_context, 2, tex_unit->color_object);
-					} else if (ffp_vertex_num_params > 1) sceGxmSetVertexStream(gxm_context, 1, tex_unit->color_object);
+						if (ffp_has_texture1) {
+							sceGxmSetFragmentTexture(gxm_context, 1, &texture_slots[texture_units[1].tex_id].gxm_tex);
+							sceGxmSetVertexStream(gxm_context, ffp_stream_idx[3], texture_units[1].texture_object);
+						}
+					}
+					if (tex_unit->color_array_state) sceGxmSetVertexStream(gxm_context, ffp_stream_idx[2], tex_unit->color_object);
 					sceGxmSetVertexStream(gxm_context, 0, tex_unit->vertex_object);
 					upload_ffp_uniforms();
 					sceGxmDraw(gxm_context, gxm_p, SCE_GXM_INDEX_FORMAT_U16, tex_unit->index_object, count);
@@ -2264,7 +3432,9 @@ void vglDrawObjects(GLenum mode, GLsizei count, GLboolean implicit_wvp) {
 							sceGxmDraw(gxm_context, gxm_p, SCE_GXM_INDEX_FORMAT_U16, tex_unit->index_object, count);
 						}
 					} else {
-						if (tex_unit->color_array_state && (tex_unit->color_array.num == 3)) {
+						if (!tex_unit->color_array_state)
+							sceGxmSetVertexProgram(gxm_context, rgba_const_vertex_program_patched);
+						else if (tex_unit->color_array.num == 3) {
 							if (tex_unit->color_object_type == GL_FLOAT)
 								sceGxmSetVertexProgram(gxm_context, rgb_vertex_program_patched);
 							else
@@ -2280,16 +3450,10 @@ void vglDrawObjects(GLenum mode, GLsizei count, GLboolean implicit_wvp) {
 						sceGxmReserveVertexDefaultUniformBuffer(gxm_context, &vbuffer);
 						sceGxmSetUniformDataF(vbuffer, rgba_wvp, 0, 16, (const float *)mvp_matrix);
 						sceGxmSetVertexStream(gxm_context, 0, tex_unit->vertex_object);
-						if (tex_unit->color_array_state) {
+						if (tex_unit->color_array_state)
 							sceGxmSetVertexStream(gxm_context, 1, tex_unit->color_object);
-						} else {
-							vector4f *colors = (vector4f *)gpu_pool_memalign(count * sizeof(vector4f), sizeof(vector4f));
-							int n;
-							for (n = 0; n < count; n++) {
-								memcpy_neon(&colors[n], &current_color.r, sizeof(vector4f));
-							}
-							sceGxmSetVertexStream(gxm_context, 1, colors);
-						}
+						else
+							sceGxmSetVertexStream(gxm_context, 1, upload_const_color());
 						sceGxmDraw(gxm_context, gxm_p, SCE_GXM_INDEX_FORMAT_U16, tex_unit->index_object, count);
 					}
 #if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
@@ -2300,6 +3464,52 @@ void vglDrawObjects(GLenum mode, GLsizei count, GLboolean implicit_wvp) {
 	}
 }
 
+void vglDrawObjectsInstanced(GLenum mode, GLsizei count, GLsizei instances, GLboolean implicit_wvp) {
+	flush_imm_batch();
+	SceGxmPrimitiveType gxm_p;
+#ifndef SKIP_ERROR_HANDLING
+	if (phase == MODEL_CREATION) {
+		SET_GL_ERROR(GL_INVALID_OPERATION)
+	} else if (cur_program == 0) {
+		SET_GL_ERROR(GL_INVALID_OPERATION)
+	} else if ((count < 0) || (instances < 0) || (instances > 0xFFFF)) {
+		SET_GL_ERROR(GL_INVALID_VALUE)
+	}
+#endif
+	GLboolean skip_draw = GL_FALSE;
+	switch (mode) {
+	case GL_POINTS:
+		gxm_p = SCE_GXM_PRIMITIVE_POINTS;
+		break;
+	case GL_LINES:
+		gxm_p = SCE_GXM_PRIMITIVE_LINES;
+		break;
+	case GL_TRIANGLES:
+		gxm_p = SCE_GXM_PRIMITIVE_TRIANGLES;
+		if (no_polygons_mode)
+			skip_draw = GL_TRUE;
+		break;
+	case GL_TRIANGLE_STRIP:
+		gxm_p = SCE_GXM_PRIMITIVE_TRIANGLE_STRIP;
+		if (no_polygons_mode)
+			skip_draw = GL_TRUE;
+		break;
+	case GL_TRIANGLE_FAN:
+		gxm_p = SCE_GXM_PRIMITIVE_TRIANGLE_FAN;
+		if (no_polygons_mode)
+			skip_draw = GL_TRUE;
+		break;
+	default:
+		SET_GL_ERROR(GL_INVALID_ENUM)
+		break;
+	}
+	if (!skip_draw && instances) {
+		// Index buffer is wrapped every count indices, each wrap increments the instance index
+		_vglDrawObjects_CustomShadersIMPL(mode, count, instances, implicit_wvp);
+		sceGxmDrawInstanced(gxm_context, gxm_p, SCE_GXM_INDEX_FORMAT_U16, texture_units[client_texture_unit].index_object, count * instances, count);
+	}
+}
+
 size_t vglMemFree(vglMemType type) {
 #ifndef SKIP_ERROR_HANDLING
 	if (type >= VGL_MEM_TYPE_COUNT)
@@ -2335,4 +3545,94 @@ void vglUseExtraMem(GLboolean use) {
 
 GLboolean vglHasRuntimeShaderCompiler(void) {
 	return is_shark_online;
-}
\ No newline at end of file
+}
+
+void vglSetFFPShaderCacheSize(uint32_t size) {
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+	shader_cache_capacity = size < 4 ? 4 : size;
+	if (shader_cache_size > shader_cache_capacity) {
+		waitRenderingDone();
+		shader_cache_trim(shader_cache_capacity);
+	}
+#endif
+}
+
+void vglGetFFPShaderCacheStats(uint32_t *hits, uint32_t *misses, uint64_t *compile_time) {
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+	if (hits)
+		*hits = shader_cache_hits;
+	if (misses)
+		*misses = shader_cache_misses;
+	if (compile_time)
+		*compile_time = shader_cache_compile_time;
+#else
+	if (hits)
+		*hits = 0;
+	if (misses)
+		*misses = 0;
+	if (compile_time)
+		*compile_time = 0;
+#endif
+}
+
+void vglPrecacheFFPStates(const vglFFPState *states, uint32_t num) {
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+	if (is_shark_online)
+		precache_ffp_states(states, num);
+#endif
+}
+
+GLboolean vglPrecacheFFPStatesFromFile(const char *path) {
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return GL_FALSE;
+	
+	// Validating file header
+	uint32_t hdr[3];
+	if ((fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) || (hdr[0] != FFP_STATES_MAGIC) || (hdr[1] != FFP_STATES_VERSION)) {
+		fclose(f);
+		return GL_FALSE;
+	}
+	vglFFPState *states = (vglFFPState *)malloc(hdr[2] * sizeof(vglFFPState));
+	if (!states) {
+		fclose(f);
+		return GL_FALSE;
+	}
+	GLboolean res = fread(states, sizeof(vglFFPState), hdr[2], f) == hdr[2];
+	fclose(f);
+	if (res)
+		vglPrecacheFFPStates(states, hdr[2]);
+	free(states);
+	return res;
+#else
+	return GL_FALSE;
+#endif
+}
+
+void vglRecordFFPStates(const char *path) {
+#if defined(HAVE_SHARK) && defined(HAVE_SHARK_FFP)
+	// Dumping states recorded so far
+	if (ffp_states_path) {
+		FILE *f = fopen(ffp_states_path, "wb");
+		if (f) {
+			uint32_t hdr[3] = {FFP_STATES_MAGIC, FFP_STATES_VERSION, ffp_states_num};
+			fwrite(hdr, 1, sizeof(hdr), f);
+			fwrite(ffp_states, sizeof(vglFFPState), ffp_states_num, f);
+			fclose(f);
+		}
+		free(ffp_states_path);
+		free(ffp_states);
+		ffp_states_path = NULL;
+		ffp_states = NULL;
+		ffp_states_num = 0;
+	}
+	
+	// Starting a new recording session
+	if (path) {
+		ffp_states_path = strdup(path);
+		memset(&ffp_last_vert_state, 0, sizeof(vglFFPState));
+		memset(&ffp_last_frag_state, 0, sizeof(vglFFPState));
+	}
+#endif
+}
@@ -71,6 +71,7 @@ extern "C" {
 #define GL_TRIANGLE_STRIP                     0x0005
 #define GL_TRIANGLE_FAN                       0x0006
 #define GL_QUADS                              0x0007
+#define GL_QUAD_STRIP                         0x0008
 #define GL_ADD                                0x0104
 #define GL_NEVER                              0x0200
 #define GL_NEVER                              0x0200
@@ -105,6 +106,9 @@ extern "C" {
 #define GL_CCW                                0x0901
 #define GL_POLYGON_MODE                       0x0B40
 #define GL_CULL_FACE                          0x0B44
+#define GL_LIGHTING                           0x0B50
+#define GL_LIGHT_MODEL_AMBIENT                0x0B53
+#define GL_COLOR_MATERIAL                     0x0B57
 #define GL_FOG                                0x0B60
 #define GL_FOG_DENSITY                        0x0B62
 #define GL_FOG_START                          0x0B63
@@ -120,6 +124,8 @@ extern "C" {
 #define GL_BLEND                              0x0BE2
 #define GL_SCISSOR_BOX                        0x0C10
 #define GL_SCISSOR_TEST                       0x0C11
+#define GL_ALPHA_SCALE                        0x0D1C
+#define GL_MAX_LIGHTS                         0x0D31
 #define GL_MAX_TEXTURE_SIZE                   0x0D33
 #define GL_MAX_MODELVIEW_STACK_DEPTH          0x0D36
 #define GL_MAX_PROJECTION_STACK_DEPTH         0x0D38
@@ -128,17 +134,31 @@ extern "C" {
 #define GL_STENCIL_BITS                       0x0D57
 #define GL_TEXTURE_2D                         0x0DE1
 #define GL_DONT_CARE                          0x1100
+#define GL_COMPILE                            0x1300
+#define GL_COMPILE_AND_EXECUTE                0x1301
 #define GL_FASTEST                            0x1101
 #define GL_NICEST                             0x1102
+#define GL_AMBIENT                            0x1200
+#define GL_DIFFUSE                            0x1201
+#define GL_SPECULAR                           0x1202
+#define GL_POSITION                           0x1203
+#define GL_CONSTANT_ATTENUATION               0x1207
+#define GL_LINEAR_ATTENUATION                 0x1208
+#define GL_QUADRATIC_ATTENUATION              0x1209
 #define GL_BYTE                               0x1400
 #define GL_UNSIGNED_BYTE                      0x1401
 #define GL_SHORT                              0x1402
 #define GL_UNSIGNED_SHORT                     0x1403
 #define GL_FLOAT                              0x1406
+#define GL_HALF_FLOAT                         0x140B
 #define GL_FIXED                              0x140C
 #define GL_INVERT                             0x150A
+#define GL_EMISSION                           0x1600
+#define GL_SHININESS                          0x1601
+#define GL_AMBIENT_AND_DIFFUSE                0x1602
 #define GL_MODELVIEW                          0x1700
 #define GL_PROJECTION                         0x1701
+#define GL_TEXTURE                            0x1702
 #define GL_COLOR_INDEX                        0x1900
 #define GL_RED                                0x1903
 #define GL_GREEN                              0x1904
@@ -179,6 +199,14 @@ extern "C" {
 #define GL_POLYGON_OFFSET_POINT               0x2A01
 #define GL_POLYGON_OFFSET_LINE                0x2A02
 #define GL_CLIP_PLANE0                        0x3000
+#define GL_LIGHT0                             0x4000
+#define GL_LIGHT1                             0x4001
+#define GL_LIGHT2                             0x4002
+#define GL_LIGHT3                             0x4003
+#define GL_LIGHT4                             0x4004
+#define GL_LIGHT5                             0x4005
+#define GL_LIGHT6                             0x4006
+#define GL_LIGHT7                             0x4007
 #define GL_FUNC_ADD                           0x8006
 #define GL_MIN                                0x8007
 #define GL_MAX                                0x8008
@@ -191,6 +219,7 @@ extern "C" {
 #define GL_INTENSITY                          0x8049
 #define GL_TEXTURE_BINDING_2D                 0x8069
 #define GL_VERTEX_ARRAY                       0x8074
+#define GL_NORMAL_ARRAY                       0x8075
 #define GL_COLOR_ARRAY                        0x8076
 #define GL_TEXTURE_COORD_ARRAY                0x8078
 #define GL_BLEND_DST_RGB                      0x80C8
@@ -241,9 +270,32 @@ extern "C" {
 #define GL_TEXTURE30                          0x84DE
 #define GL_TEXTURE31                          0x84DF
 #define GL_ACTIVE_TEXTURE                     0x84E0
+#define GL_SUBTRACT                           0x84E7
 #define GL_TEXTURE_COMPRESSION_HINT           0x84EF
 #define GL_TEXTURE_LOD_BIAS                   0x8501
 #define GL_INCR_WRAP                          0x8507
+#define GL_COMBINE                            0x8570
+#define GL_COMBINE_RGB                        0x8571
+#define GL_COMBINE_ALPHA                      0x8572
+#define GL_RGB_SCALE                          0x8573
+#define GL_ADD_SIGNED                         0x8574
+#define GL_INTERPOLATE                        0x8575
+#define GL_CONSTANT                           0x8576
+#define GL_PRIMARY_COLOR                      0x8577
+#define GL_PREVIOUS                           0x8578
+#define GL_SRC0_RGB                           0x8580
+#define GL_SRC1_RGB                           0x8581
+#define GL_SRC2_RGB                           0x8582
+#define GL_SRC0_ALPHA                         0x8588
+#define GL_SRC1_ALPHA                         0x8589
+#define GL_SRC2_ALPHA                         0x858A
+#define GL_OPERAND0_RGB                       0x8590
+#define GL_OPERAND1_RGB                       0x8591
+#define GL_OPERAND2_RGB                       0x8592
+#define GL_OPERAND0_ALPHA                     0x8598
+#define GL_OPERAND1_ALPHA                     0x8599
+#define GL_OPERAND2_ALPHA                     0x859A
+#define GL_VERTEX_ARRAY_BINDING               0x85B5
 #define GL_NUM_COMPRESSED_TEXTURE_FORMATS     0x86A2
 #define GL_COMPRESSED_TEXTURE_FORMATS         0x86A3
 #define GL_MIRROR_CLAMP_EXT                   0x8742
@@ -259,6 +311,8 @@ extern "C" {
 #define GL_DYNAMIC_DRAW                       0x88E8
 #define GL_DYNAMIC_READ                       0x88E9
 #define GL_DYNAMIC_COPY                       0x88EA
+#define GL_UNIFORM_BUFFER                     0x8A11
+#define GL_MAX_UNIFORM_BUFFER_BINDINGS        0x8A2F
 #define GL_FRAGMENT_SHADER                    0x8B30
 #define GL_VERTEX_SHADER                      0x8B31
 #define GL_SHADER_TYPE                        0x8B4F
@@ -274,6 +328,9 @@ extern "C" {
 #define GL_FRAMEBUFFER                        0x8D40
 #define GL_COMPRESSED_RGBA_PVRTC_2BPPV2_IMG   0x9137
 #define GL_COMPRESSED_RGBA_PVRTC_4BPPV2_IMG   0x9138
+#define GL_COMPLETION_STATUS_KHR              0x91B1
+#define GL_INDICES_OPTIMIZATION_HINT_VGL      0xF000
+#define GL_INVALID_INDEX                      0xFFFFFFFF
 
 #define GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS   2
 #define GL_MAX_TEXTURE_LOD_BIAS               31
@@ -294,15 +351,19 @@ void glAlphaFunc(GLenum func, GLfloat ref);
 void glArrayElement(GLint i);
 void glAttachShader(GLuint prog, GLuint shad);
 void glBegin(GLenum mode);
+void glBindAttribLocation(GLuint prog, GLuint index, const GLchar *name);
 void glBindBuffer(GLenum target, GLuint buffer);
+void glBindBufferBase(GLenum target, GLuint index, GLuint buffer);
 void glBindFramebuffer(GLenum target, GLuint framebuffer);
 void glBindTexture(GLenum target, GLuint texture);
+void glBindVertexArray(GLuint array);
 void glBlendEquation(GLenum mode);
 void glBlendEquationSeparate(GLenum modeRGB, GLenum modeAlpha);
 void glBlendFunc(GLenum sfactor, GLenum dfactor);
 void glBlendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha);
 void glBufferData(GLenum target, GLsizei size, const GLvoid *data, GLenum usage);
 void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data);
+void glCallList(GLuint list);
 void glClear(GLbitfield mask);
 void glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
 void glClearDepth(GLdouble depth);
@@ -318,6 +379,7 @@ void glColor4fv(const GLfloat *v);
 void glColor4ub(GLubyte red, GLubyte green, GLubyte blue, GLubyte alpha);
 void glColor4ubv(const GLubyte *v);
 void glColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+void glColorMaterial(GLenum face, GLenum mode);
 void glColorPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer);
 void glColorTable(GLenum target, GLenum internalformat, GLsizei width, GLenum format, GLenum type, const GLvoid *data);
 void glCompileShader(GLuint shader);
@@ -327,20 +389,25 @@ GLuint glCreateShader(GLenum shaderType);
 void glCullFace(GLenum mode);
 void glDeleteBuffers(GLsizei n, const GLuint *gl_buffers);
 void glDeleteFramebuffers(GLsizei n, GLuint *framebuffers);
+void glDeleteLists(GLuint list, GLsizei range);
 void glDeleteProgram(GLuint prog);
 void glDeleteShader(GLuint shad);
 void glDeleteTextures(GLsizei n, const GLuint *textures);
+void glDeleteVertexArrays(GLsizei n, const GLuint *arrays);
 void glDepthFunc(GLenum func);
 void glDepthMask(GLboolean flag);
 void glDepthRange(GLdouble nearVal, GLdouble farVal);
 void glDepthRangef(GLfloat nearVal, GLfloat farVal);
 void glDisable(GLenum cap);
 void glDisableClientState(GLenum array);
+void glDisableVertexAttribArray(GLuint index);
 void glDrawArrays(GLenum mode, GLint first, GLsizei count);
 void glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices);
 void glEnable(GLenum cap);
 void glEnableClientState(GLenum array);
+void glEnableVertexAttribArray(GLuint index);
 void glEnd(void);
+void glEndList(void);
 void glFinish(void);
 void glFogf(GLenum pname, GLfloat param);
 void glFogfv(GLenum pname, const GLfloat *params);
@@ -351,7 +418,10 @@ void glFrustum(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLd
 void glGenBuffers(GLsizei n, GLuint *buffers);
 void glGenerateMipmap(GLenum target);
 void glGenFramebuffers(GLsizei n, GLuint *ids);
+GLuint glGenLists(GLsizei range);
 void glGenTextures(GLsizei n, GLuint *textures);
+void glGenVertexArrays(GLsizei n, GLuint *arrays);
+GLint glGetAttribLocation(GLuint prog, const GLchar *name);
 void glGetBooleanv(GLenum pname, GLboolean *params);
 void glGetFloatv(GLenum pname, GLfloat *data);
 GLenum glGetError(void);
@@ -359,15 +429,26 @@ void glGetIntegerv(GLenum pname, GLint *data);
 void glGetShaderInfoLog(GLuint handle, GLsizei maxLength, GLsizei *length, GLchar *infoLog);
 void glGetShaderiv(GLuint handle, GLenum pname, GLint *params);
 const GLubyte *glGetString(GLenum name);
+GLuint glGetUniformBlockIndex(GLuint prog, const GLchar *name);
 GLint glGetUniformLocation(GLuint prog, const GLchar *name);
 void glHint(GLenum target, GLenum mode);
 GLboolean glIsEnabled(GLenum cap);
+GLboolean glIsList(GLuint list);
+void glLightf(GLenum light, GLenum pname, GLfloat param);
+void glLightfv(GLenum light, GLenum pname, const GLfloat *params);
+void glLightModelfv(GLenum pname, const GLfloat *params);
 void glLineWidth(GLfloat width);
 void glLinkProgram(GLuint progr);
 void glLoadIdentity(void);
 void glLoadMatrixf(const GLfloat *m);
+void glMaterialf(GLenum face, GLenum pname, GLfloat param);
+void glMaterialfv(GLenum face, GLenum pname, const GLfloat *params);
 void glMatrixMode(GLenum mode);
 void glMultMatrixf(const GLfloat *m);
+void glNewList(GLuint list, GLenum mode);
+void glNormal3f(GLfloat nx, GLfloat ny, GLfloat nz);
+void glNormal3fv(const GLfloat *v);
+void glNormalPointer(GLenum type, GLsizei stride, const GLvoid *pointer);
 void glOrtho(GLdouble left, GLdouble right, GLdouble bottom, GLdouble top, GLdouble nearVal, GLdouble farVal);
 void glPointSize(GLfloat size);
 void glPolygonMode(GLenum face, GLenum mode);
@@ -406,11 +487,13 @@ void glUniform2fv(GLint location, GLsizei count, const GLfloat *value);
 void glUniform3fv(GLint location, GLsizei count, const GLfloat *value);
 void glUniform4f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3);
 void glUniform4fv(GLint location, GLsizei count, const GLfloat *value);
+void glUniformBlockBinding(GLuint prog, GLuint blockIndex, GLuint blockBinding);
 void glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value);
 void glUseProgram(GLuint program);
 void glVertex2f(GLfloat x, GLfloat y);
 void glVertex3f(GLfloat x, GLfloat y, GLfloat z);
 void glVertex3fv(const GLfloat *v);
+void glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const GLvoid *pointer);
 void glVertexPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer);
 void glViewport(GLint x, GLint y, GLsizei width, GLsizei height);
 
@@ -421,6 +504,7 @@ void gluPerspective(GLdouble fovy, GLdouble aspect, GLdouble zNear, GLdouble zFa
 void vglColorPointer(GLint size, GLenum type, GLsizei stride, GLuint count, const GLvoid *pointer);
 void vglColorPointerMapped(GLenum type, const GLvoid *pointer);
 void vglDrawObjects(GLenum mode, GLsizei count, GLboolean implicit_wvp);
+void vglDrawObjectsInstanced(GLenum mode, GLsizei count, GLsizei instances, GLboolean implicit_wvp);
 void vglIndexPointer(GLenum type, GLsizei stride, GLuint count, const GLvoid *pointer);
 void vglIndexPointerMapped(const GLvoid *pointer);
 void vglTexCoordPointer(GLint size, GLenum type, GLsizei stride, GLuint count, const GLvoid *pointer);
@@ -431,6 +515,7 @@ void vglVertexPointerMapped(const GLvoid *pointer);
 // VGL_EXT_gxp_shaders extension implementation
 void vglBindAttribLocation(GLuint prog, GLuint index, const GLchar *name, const GLuint num, const GLenum type);
 GLint vglBindPackedAttribLocation(GLuint prog, const GLchar *name, const GLuint num, const GLenum type, GLuint offset, GLint stride);
+void vglVertexAttribDivisor(GLuint prog, GLuint index, GLuint divisor);
 void vglVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, GLuint count, const GLvoid *pointer);
 void vglVertexAttribPointerMapped(GLuint index, const GLvoid *pointer);
 
@@ -443,20 +528,39 @@ typedef enum {
 	VGL_MEM_TYPE_COUNT
 } vglMemType;
 
+// Fixed function pipeline state used for shaders warm-up
+typedef struct {
+	uint32_t shader_mask; // Fixed function pipeline shader mask
+	uint32_t config[5]; // Vertex streams layouts for vertex shaders, blend config for fragment shaders (first slot)
+} vglFFPState;
+
 // vgl*
 void *vglAlloc(uint32_t size, vglMemType type);
+void vglEnableAsyncShaderCompiler(GLboolean usage);
+void vglEnableClientArrayCache(GLboolean usage);
+void vglEnableImmediateBatching(GLboolean usage);
 void vglEnableRuntimeShaderCompiler(GLboolean usage);
 void vglEnd(void);
 void *vglForceAlloc(uint32_t size);
 void vglFree(void *addr);
+void vglGetClientArrayCacheStats(uint32_t *hits, uint32_t *misses);
+void vglGetFFPShaderCacheStats(uint32_t *hits, uint32_t *misses, uint64_t *compile_time);
 SceGxmTexture *vglGetGxmTexture(GLenum target);
 void *vglGetTexDataPointer(GLenum target);
+void vglGetUniformUploadStats(uint32_t *bytes, uint32_t *reused_draws);
 GLboolean vglHasRuntimeShaderCompiler(void);
 void vglInit(uint32_t gpu_pool_size);
 void vglInitExtended(uint32_t gpu_pool_size, int width, int height, int ram_threshold, SceGxmMultisampleMode msaa);
 void vglInitWithCustomSizes(uint32_t gpu_pool_size, int width, int height, int ram_pool_size, int cdram_pool_size, int phycont_pool_size, SceGxmMultisampleMode msaa);
 size_t vglMemFree(vglMemType type);
+void vglPrecacheFFPStates(const vglFFPState *states, uint32_t num);
+GLboolean vglPrecacheFFPStatesFromFile(const char *path);
+void vglRecordFFPStates(const char *path);
+void vglSetClientArrayCacheSize(uint32_t size);
+void vglSetFFPShaderCacheSize(uint32_t size);
 void vglSetParamBufferSize(uint32_t size);
+void vglSetShaderCacheDir(const char *path);
+void vglSetShaderCacheSize(uint32_t size);
 void vglSetupRuntimeShaderCompiler(shark_opt opt_level, int32_t use_fastmath, int32_t use_fastprecision, int32_t use_fastint);
 void vglStartRendering();
 void vglStopRendering();